@@ -49,6 +49,8 @@
 #include "group.h"
 #include "art.h"
 #include "art_sort.h"
+#include "artcache.h"
+#include "hdrindex.h"
 #include "misc.h"
 #include "post.h"
 /* #include "clientlib.h" */
@@ -143,6 +145,7 @@ int Slrn_Kill_Score_Max = -9999;
 FILE *Slrn_Kill_Log_FP = NULL;
 int Slrn_Article_Window_Border = 0;
 int Slrn_Reads_Per_Update = 50;
+int Slrn_Header_Page_Size = 0;
 int Slrn_Sig_Is_End_Of_Article = 0;
 #if SLRN_HAS_SPOILERS
 int Slrn_Spoiler_Char = 42;
@@ -197,6 +200,11 @@ static Slrn_Group_Type *Current_Group; /* group being processed */
 
 static int Total_Num_Headers;	       /* headers retrieved from server.  This
 					* number is used only by update meters */
+/* If Slrn_Header_Page_Size is set, only the newest articles of a group are
+ * retrieved when entering it; older ones are fetched on demand, one page at
+ * a time, starting below this number. */
+static NNTP_Artnum_Type Lowest_Requested_Number;
+static int Page_Unread_Only;	       /* if non-zero, skip read articles */
 static int Last_Cursor_Row;	       /* row where --> cursor last was */
 static Slrn_Header_Type *Header_Showing;    /* header whose article is selected */
 static Slrn_Header_Type *Last_Read_Header;
@@ -232,6 +240,7 @@ static void toggle_header_formats (void);
 static void slrn_art_hangup (int);
 static void hide_or_unhide_quotes (void);
 static void art_update_screen (void);
+static void forget_header_row (Slrn_Header_Type *);
 static void art_next_unread (void);
 static void art_quit (void);
 static int select_header (Slrn_Header_Type *, int);
@@ -460,12 +469,13 @@ static void remove_from_hash_table (Slrn_Header_Type *h) /*{{{*/
 
 static void free_this_header (Slrn_Header_Type *h)
 {
+   forget_header_row (h);
    slrn_free (h->tree_ptr);
    slrn_free (h->subject);
    slrn_free (h->from);
    slrn_free (h->date);
    slrn_free (h->msgid);
-   slrn_free (h->refs);
+   slrn_free_references (h->refs, h->num_refs);
    slrn_free (h->xref);
    slrn_free (h->realname);
    slrn_free_additional_headers (h->add_hdrs);
@@ -689,7 +699,7 @@ static char *extract_header (Slrn_Header_Type *h, char *hdr, unsigned int len) /
    if (0 == slrn_case_strncmp ("Date: ", hdr, len))
      return h->date;
    if (0 == slrn_case_strncmp ("References: ", hdr, len))
-     return slrn_skip_whitespace (h->refs);
+     return slrn_references_string (h->refs, h->num_refs);
    if (0 == slrn_case_strncmp ("Xref: ", hdr, len))
      return h->xref;
    if (0 == slrn_case_strncmp ("Lines: ", hdr, len))
@@ -1735,7 +1745,8 @@ static Slrn_Header_Type *find_header_from_serverid (NNTP_Artnum_Type id) /*{{{*/
 static void kill_cross_references (Slrn_Header_Type *h) /*{{{*/
 {
    char *b;
-   char *group, *g;
+   char *g;
+   unsigned int len;
    NNTP_Artnum_Type num;
 
    if ((h->xref == NULL) || (*h->xref == 0))
@@ -1763,16 +1774,16 @@ static void kill_cross_references (Slrn_Header_Type *h) /*{{{*/
 	/* now we are looking at the groupname */
 	g = b;
 	while (*b && (*b != ':')) b++;
-	if ((g == b) || (b[0] == 0) || (b[1] == 0)
-	    || (NULL == (group = slrn_strnmalloc (g, (unsigned int)(b-g), 0))))
+	if ((g == b) || (b[0] == 0) || (b[1] == 0))
 	  break;
+	len = (unsigned int) (b - g);
 	b++;			       /* skip ':' */
 	num = NNTP_STR_TO_ARTNUM (b);
 	while ((*b <= '9') && (*b >= '0')) b++;
 	if ((num != h->number)
-	    || strcmp (group, Slrn_Current_Group_Name))
-	  slrn_mark_articles_as_read (group, num, num);
-	SLfree (group);
+	    || strncmp (g, Slrn_Current_Group_Name, len)
+	    || (Slrn_Current_Group_Name[len] != 0))
+	  slrn_mark_article_as_read_later (g, len, num);
      }
 }
 
@@ -2172,13 +2183,10 @@ static void get_header_real_name (Slrn_Header_Type *h) /*{{{*/
 
 /*}}}*/
 
-Slrn_Header_Type *_art_find_header_from_msgid (char *r0, char *r1) /*{{{*/
+static Slrn_Header_Type *find_header_with_hash (char *r0, unsigned int len, /*{{{*/
+						unsigned long hash)
 {
-   unsigned long hash;
    Slrn_Header_Type *h;
-   unsigned int len;
-   len = (unsigned int) (r1 - r0);
-   hash = slrn_compute_hash ((unsigned char *) r0, (unsigned char *) r1);
 
    h = Header_Table[hash % HEADER_TABLE_SIZE];
    while (h != NULL)
@@ -2195,6 +2203,23 @@ Slrn_Header_Type *_art_find_header_from_msgid (char *r0, char *r1) /*{{{*/
 
 /*}}}*/
 
+Slrn_Header_Type *_art_find_header_from_msgid (char *r0, char *r1) /*{{{*/
+{
+   return find_header_with_hash (r0, (unsigned int) (r1 - r0),
+				 slrn_compute_hash ((unsigned char *) r0,
+						    (unsigned char *) r1));
+}
+
+/*}}}*/
+
+/* The same for an interned Message-Id, whose hash is already known */
+Slrn_Header_Type *_art_find_header_from_ref (Slrn_Msgid_Type *ref) /*{{{*/
+{
+   return find_header_with_hash (ref->name, ref->len, ref->hash);
+}
+
+/*}}}*/
+
 Slrn_Header_Type *slrn_find_header_with_msgid (char *msgid) /*{{{*/
 {
    return _art_find_header_from_msgid (msgid, msgid + strlen (msgid));
@@ -2455,6 +2480,75 @@ static Slrn_Article_Type *read_article (Slrn_Header_Type *h, int kill_refs) /*{{
 }
 /*}}}*/
 
+/* Called while article mode is waiting for a keypress.  Finishes finding
+ * the quotes of the current article, then fetches the next unread articles
+ * (in display order) into the article cache, one per call, so that moving
+ * to them does not have to wait for the server.  Returns non-zero if it
+ * should be called again.
+ */
+static Slrn_Header_Type *Prefetch_Stop_Header;   /* nothing to do here */
+static Slrn_Header_Type *Prefetch_Stop_Showing;
+
+static int art_idle_prefetch (void) /*{{{*/
+{
+   Slrn_Header_Type *h;
+   unsigned long budget, used;
+   int count;
+
+   if (slrn_art_mark_more_quotes (Slrn_Current_Article, 256))
+     return 1;
+
+   if ((Slrn_Prefetch_Depth <= 0) || (Slrn_Prefetch_Cache_Size <= 0)
+       || (Slrn_Current_Header == NULL)
+       || ((Prefetch_Stop_Header == Slrn_Current_Header)
+	   && (Prefetch_Stop_Showing == Header_Showing)))
+     return 0;
+
+   /* Do not let the prefetched articles push each other out of the cache */
+   budget = 512UL * (unsigned long) Slrn_Prefetch_Cache_Size;
+   used = 0;
+   count = 0;
+
+   for (h = Slrn_Current_Header; h != NULL; h = h->next)
+     {
+	unsigned int size;
+	int status;
+
+	if ((h->flags & (HEADER_READ|HEADER_WITHOUT_BODY))
+	    || (h == Header_Showing))
+	  continue;
+
+	if (count++ == Slrn_Prefetch_Depth)
+	  break;
+
+	if (0 != (size = slrn_art_cache_article_size (h->msgid)))
+	  {
+	     used += size;
+	     continue;
+	  }
+
+	if ((h->bytes > 0) && (used + (unsigned long) h->bytes > budget))
+	  break;
+
+	status = slrn_art_cache_prefetch (h->number, h->msgid);
+	if (status == 0)	       /* already in the disk cache */
+	  continue;
+
+	size = slrn_art_cache_article_size (h->msgid);
+	if ((status == -1) || (used + size > budget))
+	  break;
+
+	Prefetch_Stop_Header = NULL;
+	return 1;
+     }
+
+   Prefetch_Stop_Header = Slrn_Current_Header;
+   Prefetch_Stop_Showing = Header_Showing;
+   return 0;
+}
+
+/*}}}*/
+
 /* On errors, free a and return -1 */
 #if 0
 static int art_undo_modifications (Slrn_Article_Type *a)
@@ -2549,6 +2643,8 @@ static int select_header (Slrn_Header_Type *h, int kill_refs) /*{{{*/
 	slrn_free (h->from);
 	h->from = from;
 	get_header_real_name (h);
+	slrn_hdr_index_forget (h);
+	forget_header_row (h);
      }
 
    if (last_header_showing != h)
@@ -2849,6 +2945,7 @@ void slrn_subject_strip_was (char *subject) /*{{{*/
 static char *subject_skip_re (char *subject) /*{{{*/
 {
    SLRegexp_Type **r;
+   unsigned char *any;
    unsigned int len;
 
    while (1)
@@ -2864,6 +2961,9 @@ static char *subject_skip_re (char *subject) /*{{{*/
 	  }
 
 	r = Slrn_Strip_Re_Regexp;
+	any = slrn_regexp_first_bytes (r, -1);
+	if ((any != NULL) && (0 == SLRN_BYTE_IN_SET (any, *subject)))
+	  break;
 	len = strlen (subject);
 
 	while (*r != NULL)
@@ -3851,6 +3951,8 @@ static void supersede (void) /*{{{*/
 
 /*{{{ header movement functions */
 
+static int page_in_older_headers (int);
+
 int slrn_header_cursor_pos (void)
 {
    return Last_Cursor_Row;
@@ -3872,7 +3974,10 @@ unsigned int slrn_header_down_n (unsigned int n, int err) /*{{{*/
 
 static void header_down (void) /*{{{*/
 {
-   slrn_header_down_n (1, 1);
+   if ((0 == slrn_header_down_n (1, 0))
+       && ((0 == page_in_older_headers (0))
+	   || (0 == slrn_header_down_n (1, 0))))
+     slrn_error (_("End of buffer."));
 }
 
 /*}}}*/
@@ -3894,7 +3999,10 @@ unsigned int slrn_header_up_n (unsigned int n, int err) /*{{{*/
 
 static void header_up (void) /*{{{*/
 {
-   slrn_header_up_n (1, 1);
+   if ((0 == slrn_header_up_n (1, 0))
+       && ((0 == page_in_older_headers (1))
+	   || (0 == slrn_header_up_n (1, 0))))
+     slrn_error (_("Top of buffer."));
 }
 
 /*}}}*/
@@ -3902,7 +4010,9 @@ static void header_up (void) /*{{{*/
 static void header_pageup (void) /*{{{*/
 {
    Slrn_Full_Screen_Update = 1;
-   if (-1 == SLscroll_pageup (&Slrn_Header_Window))
+   if ((-1 == SLscroll_pageup (&Slrn_Header_Window))
+       && ((0 == page_in_older_headers (1))
+	   || (-1 == SLscroll_pageup (&Slrn_Header_Window))))
      slrn_error (_("Top of buffer."));
    Slrn_Current_Header = (Slrn_Header_Type *) Slrn_Header_Window.current_line;
 }
@@ -3912,7 +4022,9 @@ static void header_pageup (void) /*{{{*/
 static void header_pagedn (void) /*{{{*/
 {
    Slrn_Full_Screen_Update = 1;
-   if (-1 == SLscroll_pagedown (&Slrn_Header_Window))
+   if ((-1 == SLscroll_pagedown (&Slrn_Header_Window))
+       && ((0 == page_in_older_headers (0))
+	   || (-1 == SLscroll_pagedown (&Slrn_Header_Window))))
      slrn_error (_("End of buffer."));
    Slrn_Current_Header = (Slrn_Header_Type *) Slrn_Header_Window.current_line;
 }
@@ -5113,35 +5225,27 @@ static void header_generic_search (int dir, int type) /*{{{*/
      return;
 #endif
 
+   /* In large groups, the index rules out most headers at once. */
+   slrn_hdr_index_search ((type == 's') ? SLRN_HDR_INDEX_SUBJECT : SLRN_HDR_INDEX_FROM,
+			  search_str, 0);
+
    if (dir > 0) l = Slrn_Current_Header->next;
    else l = Slrn_Current_Header->prev;
 
    while (l != NULL)
      {
-	if (type == 's')
-	  {
-	     if ((l->subject != NULL)
-#if SLANG_VERSION < 20000
-		 && (NULL != SLsearch ((unsigned char *) l->subject,
-				       (unsigned char *) l->subject + strlen (l->subject),
-				       &st))
-#else
-		 && (NULL != SLsearch_forward (st, (SLuchar_Type *) l->subject,
-					       (SLuchar_Type *) l->subject + strlen (l->subject)))
-#endif
-		     )
-	       break;
-	  }
-	else if ((l->from != NULL)
+	char *str = (type == 's') ? l->subject : l->from;
+
+	if ((str != NULL) && slrn_hdr_index_match (l)
 #if SLANG_VERSION < 20000
-		 && (NULL != SLsearch ((unsigned char *) l->from,
-				       (unsigned char *) l->from + strlen (l->from),
-				       &st))
+	    && (NULL != SLsearch ((unsigned char *) str,
+				  (unsigned char *) str + strlen (str),
+				  &st))
 #else
-		 && (NULL != SLsearch_forward (st, (SLuchar_Type *) l->from,
-					       (SLuchar_Type *) l->from + strlen (l->from)))
+	    && (NULL != SLsearch_forward (st, (SLuchar_Type *) str,
+					  (SLuchar_Type *) str + strlen (str)))
 #endif
-		     )
+	    )
 	  break;
 
 	if (dir > 0) l = l->next; else l = l->prev;
@@ -5197,60 +5301,65 @@ static void author_search_backward (void) /*{{{*/
 
 /*{{{ kill list functions */
 
-typedef struct Kill_List_Type /*{{{*/
+/* The killed articles are kept as a sorted range list.  As headers are
+ * mostly scored in ascending order, new numbers are appended at the last
+ * range without walking the list. */
+typedef struct /*{{{*/
 {
-#define MAX_DKILLS 50
-   NNTP_Artnum_Type range_min[MAX_DKILLS];
-   NNTP_Artnum_Type range_max[MAX_DKILLS];
-   unsigned int active_index;
-   struct Kill_List_Type *next;
+   Slrn_Range_Type *ranges;
+   Slrn_Range_Type *last;	       /* highest range, or NULL if unknown */
 }
 
 /*}}}*/
 
 Kill_List_Type;
 
-static Kill_List_Type *Kill_List;
-static Kill_List_Type *Missing_Article_List;
+static Kill_List_Type Kill_List;
+static Kill_List_Type Missing_Article_List;
 
-static Kill_List_Type *add_to_specified_kill_list (NNTP_Artnum_Type num, Kill_List_Type *root) /*{{{*/
+static void add_to_specified_kill_list (NNTP_Artnum_Type num, Kill_List_Type *k) /*{{{*/
 {
-   unsigned int active_index;
+   Slrn_Range_Type *last;
 
-   if (num < 0) return root;
+   if (num < 0) return;
 
-   if (root != NULL)
+   if (NULL == (last = k->last))
      {
-	active_index = root->active_index;
-	if (num == root->range_max[active_index] + 1)
-	  {
-	     root->range_max[active_index] = num;   /* extend range */
-	     return root;
-	  }
-	active_index++;		       /* need new range */
+	last = k->ranges;
+	while ((last != NULL) && (last->next != NULL))
+	  last = last->next;
+     }
+
+   if (last == NULL)
+     {
+	k->ranges = k->last = slrn_ranges_add (NULL, num, num);
+	return;
      }
-   else active_index = MAX_DKILLS;
 
-   if (active_index == MAX_DKILLS)
+   if (num > last->max)
      {
-	Kill_List_Type *k;
-	k = (Kill_List_Type *) SLMALLOC (sizeof (Kill_List_Type));
-	if (k == NULL) return root;
-	k->next = root;
-	root = k;
-	active_index = 0;
+	/* slrn_ranges_add only looks at last when asked to append */
+	(void) slrn_ranges_add (last, num, num);
+	k->last = (last->next != NULL) ? last->next : last;
+	return;
+     }
+
+   if (num >= last->min)
+     {
+	k->last = last;
+	return;
      }
 
-   root->active_index = active_index;
-   root->range_min[active_index] = root->range_max[active_index] = num;
-   return root;
+   /* Out of order; this may merge away the last range */
+   k->ranges = slrn_ranges_add (k->ranges, num, num);
+   k->last = NULL;
 }
 
 /*}}}*/
 
 static void add_to_kill_list (NNTP_Artnum_Type num) /*{{{*/
 {
-   Kill_List = add_to_specified_kill_list (num, Kill_List);
+   add_to_specified_kill_list (num, &Kill_List);
    Number_Killed++;
 }
 
@@ -5258,41 +5367,27 @@ static void add_to_kill_list (NNTP_Artnum_Type num) /*{{{*/
 
 static void add_to_missing_article_list (NNTP_Artnum_Type num) /*{{{*/
 {
-   Missing_Article_List = add_to_specified_kill_list (num, Missing_Article_List);
+   add_to_specified_kill_list (num, &Missing_Article_List);
 }
 
 /*}}}*/
 
 static void free_specific_kill_list_and_update (Kill_List_Type *k) /*{{{*/
 {
-   while (k != NULL)
-     {
-	Kill_List_Type *next = k->next;
-	unsigned int i, imax = k->active_index;
-	NNTP_Artnum_Type *mins = k->range_min;
-	NNTP_Artnum_Type *maxs = k->range_max;
+   if (User_Aborted_Group_Read == 0)
+     slrn_mark_ranges_as_read (k->ranges);
 
-	if (User_Aborted_Group_Read == 0)
-	  {
-	     for (i = 0; i <= imax; i++)
-	       {
-		  slrn_mark_articles_as_read (NULL, mins[i], maxs[i]);
-	       }
-	  }
-	SLFREE (k);
-	k = next;
-     }
+   slrn_ranges_free (k->ranges);
+   k->ranges = k->last = NULL;
 }
 
 /*}}}*/
 
 static void free_kill_lists_and_update (void) /*{{{*/
 {
-   free_specific_kill_list_and_update (Kill_List);
-   Kill_List = NULL;
+   free_specific_kill_list_and_update (&Kill_List);
    Number_Killed = 0;
-   free_specific_kill_list_and_update (Missing_Article_List);
-   Missing_Article_List = NULL;
+   free_specific_kill_list_and_update (&Missing_Article_List);
 }
 
 /*}}}*/
@@ -5702,6 +5797,9 @@ static int get_headers (NNTP_Artnum_Type min, NNTP_Artnum_Type max, NNTP_Artnum_
    int num, err;
    Slrn_XOver_Type xov;
 
+   if (min < Lowest_Requested_Number)
+     Lowest_Requested_Number = min;
+
    if (total == 0)
      return 0;
 
@@ -5864,12 +5962,18 @@ static void insert_header (Slrn_Header_Type *ref) /*{{{*/
 
    if (h == NULL)
      {
-	h = Slrn_First_Header;
-	while (h->real_next != NULL) h = h->real_next;
-
 	ref->real_next = NULL;
-	ref->real_prev = h;
-	h->real_next = ref;
+	if (NULL == (h = Slrn_First_Header))
+	  {
+	     ref->real_prev = NULL;
+	     Slrn_First_Header = _art_Headers = ref;
+	  }
+	else
+	  {
+	     while (h->real_next != NULL) h = h->real_next;
+	     ref->real_prev = h;
+	     h->real_next = ref;
+	  }
      }
 
    if ((id = ref->number) <= 0) return;
@@ -5949,28 +6053,26 @@ static int get_header_by_message_id (char *msgid,
 
 /*}}}*/
 
-/* returns -1 if not implemented or the number of children returned from
- * the server.  It does not sync line number.
+/* Reads the article numbers returned by a successful XPAT command.  Since
+ * the server sends them in ascending order, they are merged with the list of
+ * headers we already have in a single pass:  For those, f is called (if it
+ * is non-NULL); the others are returned in a malloced array, their number
+ * in *nump.  Returns -1 if the user aborted the transfer.
  */
-static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
-				  Slrn_Range_Type *no_body,
-				  unsigned int *numidsp)
+static int read_xpat_ids (char *fmt, void (*f)(Slrn_Header_Type *), /*{{{*/
+			  NNTP_Artnum_Type **idsp, unsigned int *nump)
 {
    char buf[NNTP_BUFFER_SIZE];
    NNTP_Artnum_Type *id_array;
    NNTP_Artnum_Type id;
-   unsigned int i, num_ids, id_array_size;
-   char *fmt = _("Retrieving children from server...[%c]");
+   Slrn_Header_Type *h;
+   unsigned int num_ids, id_array_size, num_read;
    char *meter_chars = "|/-\\";
    static unsigned int last_meter_char;
+   int reads_per_update, status;
 
-   if (OK_HEAD != Slrn_Server_Obj->sv_xpat_cmd ("References",
-						Slrn_Server_Min, Slrn_Server_Max,
-						parent->msgid))
-     {
-	slrn_error (_("Your server does not provide support for this feature."));
-	return -1;
-     }
+   if ((reads_per_update = Slrn_Reads_Per_Update) < 5)
+     reads_per_update = 50;
 
    if (meter_chars[last_meter_char] == 0)
      last_meter_char = 0;
@@ -5978,24 +6080,35 @@ static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
    slrn_message_now (fmt, meter_chars[last_meter_char]);
    last_meter_char++;
 
-   num_ids = 0;
+   num_ids = num_read = 0;
    id_array_size = 0;
    id_array = NULL;
+   h = Slrn_First_Header;
 
    while (1)
      {
-	int status;
 	char *p;
 
 	status = Slrn_Server_Obj->sv_read_line (buf, sizeof (buf) - 1);
 	if (status <= 0)
 	  break;
 
-	if (meter_chars[last_meter_char] == 0)
-	  last_meter_char = 0;
+	if (SLang_get_error () == USER_BREAK)
+	  {
+	     if (Slrn_Server_Obj->sv_reset != NULL)
+	       Slrn_Server_Obj->sv_reset ();
+	     slrn_free ((char *) id_array);
+	     return -1;
+	  }
 
-	slrn_message_now (fmt, meter_chars[last_meter_char]);
-	last_meter_char++;
+	if (0 == (++num_read % reads_per_update))
+	  {
+	     if (meter_chars[last_meter_char] == 0)
+	       last_meter_char = 0;
+
+	     slrn_message_now (fmt, meter_chars[last_meter_char]);
+	     last_meter_char++;
+	  }
 
 	id = NNTP_STR_TO_ARTNUM (buf);
 	if (id <= 0) continue;
@@ -6006,8 +6119,19 @@ static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
 	if ((*p == 0) || (*(p+1) == 0))
 	  continue; /* work around a bug in Typhoon servers */
 
-	if (NULL != find_header_from_serverid (id))
-	  continue;
+	/* Fall back to a full lookup if the server is not sorting. */
+	if ((h != NULL) && (h->real_prev != NULL)
+	    && (h->real_prev->number >= id))
+	  h = Slrn_First_Header;
+
+	while ((h != NULL) && (h->number < id))
+	  h = h->real_next;
+
+	if ((h != NULL) && (h->number == id))
+	  {
+	     if (f != NULL) (*f) (h);
+	     continue;
+	  }
 
 	if (num_ids == id_array_size)
 	  {
@@ -6023,20 +6147,46 @@ static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
 	num_ids++;
      }
 
-   for (i = 0; i < num_ids; i++)
+   *idsp = id_array;
+   *nump = num_ids;
+   return 0;
+}
+
+/*}}}*/
+
+/* Retrieves the overview data of the given articles and inserts them into
+ * the header list; f is called for each of them (if it is non-NULL).
+ * Consecutive article numbers are requested with a single XOVER command.
+ * Returns the number of headers that were inserted.
+ */
+static unsigned int fetch_headers_by_id (NNTP_Artnum_Type *ids, /*{{{*/
+					 unsigned int num_ids,
+					 Slrn_Range_Type *no_body,
+					 void (*f)(Slrn_Header_Type *),
+					 int apply_kill)
+{
+   unsigned int i, j, num_inserted = 0;
+
+   for (i = 0; i < num_ids; i = j)
      {
 	Slrn_XOver_Type xov;
-	Slrn_Header_Type *h = NULL;
+	NNTP_Artnum_Type min, max;
+	int got_one = 0;
 
-	id = id_array[i];
+	min = max = ids[i];
+	j = i + 1;
+	while ((j < num_ids) && (ids[j] == max + 1))
+	  {
+	     max++;
+	     j++;
+	  }
 
-	if (OK_XOVER != slrn_open_xover (id, id))
+	if (OK_XOVER != slrn_open_xover (min, max))
 	  break;
 
-	/* This will loop once. */
 	while (slrn_read_xover (&xov) > 0)
 	  {
-	     Slrn_Header_Type *bad_h;
+	     Slrn_Header_Type *h, *bad_h;
 
 	     h = process_xover (&xov);
 
@@ -6048,15 +6198,17 @@ static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
 		    h->flags |= HEADER_REQUEST_BODY;
 	       }
 
-	     h = apply_score (h, 0);
+	     h = apply_score (h, apply_kill);
 	     if (h == NULL) continue;
 
+	     got_one = 1;
+
 	     /* We may already have this header.  How is this possible?
 	      * If the header was retrieved sometime earlier via HEAD
 	      * <msgid>, the server may not have returned the article
 	      * number.  As a result, that header may have a number
 	      * of -1.  Here, we really have the correct article
-	      * number since the previous while loop made sure of that.
+	      * number since the XPAT response made sure of that.
 	      * So, before inserting it, check to see whether or not we
 	      * have it and if so, fixup the id.
 	      */
@@ -6066,26 +6218,50 @@ static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
 	       {
 		  bad_h->number = h->number;
 		  free_killed_header (h);
-		  h = bad_h;
+		  if (f != NULL) (*f) (bad_h);
 		  continue;
 	       }
 	     insert_header (h);
+	     num_inserted++;
+	     if (f != NULL) (*f) (h);
 	  }
 	slrn_close_xover ();
 
-	if (h == NULL) continue;
+	if (got_one == 0) continue;
 
 	slrn_open_all_add_xover ();
-	while (slrn_open_add_xover (id, id) == 1)
-	  {
-	     Slrn_Header_Line_Type *l;
-	     NNTP_Artnum_Type unused;
+	if (-1 == get_add_headers (min, max))
+	  break;
+     }
+   return num_inserted;
+}
 
-	     while (-1 != slrn_read_add_xover (&l, &unused)) /* loops once */
-	       slrn_append_add_xover_to_header (h, l);
-	  }
-	slrn_close_add_xover (0);
+/*}}}*/
+
+/* returns -1 if not implemented or the number of children returned from
+ * the server.  It does not sync line number.
+ */
+static int find_children_headers (Slrn_Header_Type *parent, /*{{{*/
+				  Slrn_Range_Type *no_body,
+				  unsigned int *numidsp)
+{
+   NNTP_Artnum_Type *id_array;
+   unsigned int num_ids;
+
+   if (OK_HEAD != Slrn_Server_Obj->sv_xpat_cmd ("References",
+						Slrn_Server_Min, Slrn_Server_Max,
+						parent->msgid))
+     {
+	slrn_error (_("Your server does not provide support for this feature."));
+	return -1;
      }
+
+   if (-1 == read_xpat_ids (_("Retrieving children from server...[%c]"),
+			    NULL, &id_array, &num_ids))
+     return -1;
+
+   (void) fetch_headers_by_id (id_array, num_ids, no_body, NULL, 0);
+
    if (numidsp != NULL)
      *numidsp = num_ids;
    slrn_free ((char *) id_array);
@@ -6159,6 +6335,188 @@ static void get_children_headers (void) /*{{{*/
 
 /*}}}*/
 
+static unsigned int Num_Server_Matches;
+
+static void tag_server_match (Slrn_Header_Type *h) /*{{{*/
+{
+   Num_Server_Matches++;
+   if (h->flags & HEADER_TAGGED)
+     return;
+   toggle_one_header_tag (h);
+}
+
+/*}}}*/
+
+/* Lets the server search a header of all articles in the group (using
+ * XPAT), so this also works for headers that are not part of the overview
+ * and for articles that have not been retrieved yet.  Matching headers are
+ * tagged; the missing ones are fetched, but nothing else is transferred.
+ */
+static void server_header_search (void) /*{{{*/
+{
+   static char header[SLRL_DISPLAY_BUFFER_SIZE] = "Subject";
+   static char search_str[SLRL_DISPLAY_BUFFER_SIZE];
+   NNTP_Artnum_Type *id_array;
+   unsigned int num_ids, num_fetched;
+   Slrn_Range_Type *no_body = NULL;
+   char *p;
+
+   if (slrn_read_input (_("Search header: "), header, NULL, 1, 0) <= 0)
+     return;
+   p = header + strlen (header);
+   while ((p > header) && (*(p-1) == ':'))
+     *--p = 0;
+   if ((*header == 0) || (NULL != slrn_strbyte (header, ' ')))
+     {
+	slrn_error (_("Invalid header name."));
+	return;
+     }
+
+   if (slrn_read_input (_("Search pattern (server): "), search_str, NULL, 0, 0) <= 0)
+     return;
+
+   if (OK_HEAD != Slrn_Server_Obj->sv_xpat_cmd (header,
+						Slrn_Server_Min, Slrn_Server_Max,
+						search_str))
+     {
+	slrn_error (_("Your server does not provide support for this feature."));
+	return;
+     }
+
+   Num_Server_Matches = 0;
+   if (-1 == read_xpat_ids (_("Searching on server...[%c]"),
+			    tag_server_match, &id_array, &num_ids))
+     return;
+
+#if SLRN_HAS_SPOOL_SUPPORT
+   if (Slrn_Server_Id == SLRN_SERVER_ID_SPOOL)
+     no_body = slrn_spool_get_no_body_ranges (Slrn_Current_Group_Name);
+#endif
+
+   num_fetched = fetch_headers_by_id (id_array, num_ids, no_body, tag_server_match, 0);
+   slrn_ranges_free (no_body);
+   slrn_free ((char *) id_array);
+
+   if (num_fetched)
+     slrn_sort_headers ();
+   else
+     _art_find_header_line_num ();
+
+   Slrn_Full_Screen_Update = 1;
+   if (Num_Server_Matches == 0)
+     slrn_error (_("Not found."));
+   else
+     slrn_message (_("%u matching articles tagged (%u retrieved)."),
+		   Num_Server_Matches, num_fetched);
+}
+
+/*}}}*/
+
+/* Retrieves the next page of articles below the ones requested so far and
+ * returns the number of headers that were added.  Pages that only contain
+ * read, killed or expired articles are skipped.  The caller has to sort
+ * the headers if some were added. */
+static unsigned int get_older_headers_page (void) /*{{{*/
+{
+   NNTP_Artnum_Type *ids, min, max, page;
+   Slrn_Range_Type *no_body = NULL;
+   unsigned int num_ids, num = 0;
+
+   if ((page = Slrn_Header_Page_Size) <= 0)
+     page = 100;
+
+   ids = (NNTP_Artnum_Type *) slrn_malloc ((unsigned int) page * sizeof (NNTP_Artnum_Type), 0, 1);
+   if (ids == NULL)
+     return 0;
+
+#if SLRN_HAS_SPOOL_SUPPORT
+   if (Slrn_Server_Id == SLRN_SERVER_ID_SPOOL)
+     no_body = slrn_spool_get_no_body_ranges (Slrn_Current_Group_Name);
+#endif
+
+   while ((num == 0) && (Lowest_Requested_Number > Slrn_Server_Min)
+	  && (SLang_get_error () != USER_BREAK))
+     {
+	max = Lowest_Requested_Number - 1;
+	if (max - Slrn_Server_Min + 1 > page)
+	  min = max - page + 1;
+	else
+	  min = Slrn_Server_Min;
+	Lowest_Requested_Number = min;
+
+	num_ids = 0;
+	while (min <= max)
+	  {
+	     if ((Page_Unread_Only == 0)
+		 || (0 == slrn_ranges_is_member (Current_Group->range.next, min)))
+	       ids[num_ids++] = min;
+	     min++;
+	  }
+	if (num_ids == 0)
+	  continue;
+
+	slrn_message_now (_("%s: retrieving headers " NNTP_FMT_ARTNUM "-" NNTP_FMT_ARTNUM "..."),
+			  Slrn_Current_Group_Name, ids[0], max);
+	num = fetch_headers_by_id (ids, num_ids, no_body, NULL, 1);
+	Total_Num_Headers += num;
+     }
+
+   slrn_ranges_free (no_body);
+   slrn_free ((char *) ids);
+
+   slrn_clear_message ();
+   return num;
+}
+
+/*}}}*/
+
+/* Called when the cursor hits the top (at_top != 0) or the bottom of the
+ * header window.  If older articles sort towards that end, another page of
+ * them is retrieved.  Returns 1 if headers were added, 0 if not. */
+static int page_in_older_headers (int at_top) /*{{{*/
+{
+   Slrn_Header_Type *first, *last;
+
+   if ((Slrn_Header_Page_Size <= 0)
+       || (Lowest_Requested_Number <= Slrn_Server_Min)
+       || (NULL == (first = last = _art_Headers)))
+     return 0;
+
+   while (last->next != NULL)
+     last = last->next;
+
+   if ((first->number <= last->number) ? (at_top == 0) : (at_top != 0))
+     return 0;
+
+   if (0 == get_older_headers_page ())
+     return 0;
+
+   slrn_sort_headers ();
+   return 1;
+}
+
+/*}}}*/
+
+static void get_older_headers (void) /*{{{*/
+{
+   if (Lowest_Requested_Number <= Slrn_Server_Min)
+     {
+	slrn_message (_("No older articles."));
+	return;
+     }
+
+   if (0 == get_older_headers_page ())
+     {
+	if (SLang_get_error () == 0)
+	  slrn_message (_("No older articles."));
+	return;
+     }
+   slrn_sort_headers ();
+   Slrn_Full_Screen_Update = 1;
+}
+
+/*}}}*/
+
 static void mark_headers_unprocessed (void)
 {
    Slrn_Header_Type *h = Slrn_First_Header;
@@ -6178,8 +6536,7 @@ static void reference_loop_error (void)
 
 static void get_parent_header (void) /*{{{*/
 {
-   char *r1, *r0, *rmin;
-   unsigned int len;
+   unsigned int i;
    char buf[512];
    int no_error_no_thread;
    Slrn_Header_Type *last_header;
@@ -6196,16 +6553,13 @@ static void get_parent_header (void) /*{{{*/
      }
 
    last_header = NULL;
-   r1 = rmin = NULL;
+   i = 0;
 #if SLRN_HAS_SPOOL_SUPPORT
    if (Slrn_Server_Id == SLRN_SERVER_ID_SPOOL)
      no_body = slrn_spool_get_no_body_ranges (Slrn_Current_Group_Name);
 #endif
    do
      {
-	rmin = Slrn_Current_Header->refs;
-	if (rmin == NULL) break;
-
 	if (last_header != Slrn_Current_Header)
 	  {
 	     if (Slrn_Current_Header->flags & HEADER_PROCESSED)
@@ -6216,14 +6570,10 @@ static void get_parent_header (void) /*{{{*/
 	       }
 	     last_header = Slrn_Current_Header;
 	     last_header->flags |= HEADER_PROCESSED;
-	     r1 = rmin + strlen (rmin);
+	     i = last_header->num_refs;
 	  }
 
-	while ((r1 > rmin) && (*r1 != '>')) r1--;
-	r0 = r1 - 1;
-	while ((r0 >= rmin) && (*r0 != '<')) r0--;
-
-	if ((r0 < rmin) || (r1 == rmin))
+	if (i == 0)
 	  {
 	     if (no_error_no_thread) break;
 	     slrn_error (_("Article has no parent reference."));
@@ -6232,11 +6582,8 @@ static void get_parent_header (void) /*{{{*/
 	     return;
 	  }
 
-	len = (unsigned int) ((r1 + 1) - r0);
-	strncpy (buf, r0, len);
-	buf[len] = 0;
-
-	r1 = r0;
+	i--;
+	slrn_strncpy (buf, last_header->refs[i]->name, sizeof (buf));
      }
    while (no_error_no_thread
 	  && (get_header_by_message_id (buf, 1, 1, no_body) >= 0));
@@ -6734,6 +7081,7 @@ static void art_quit (void) /*{{{*/
    free_article ();
 
    free_kill_lists_and_update ();
+   slrn_flush_pending_marks ();
    free_tag_list ();
 
    slrn_close_score ();
@@ -6745,6 +7093,7 @@ static void art_quit (void) /*{{{*/
 	update_requests ();
 	free_all_headers ();
      }
+   slrn_hdr_index_free ();
 
    Slrn_First_Header = _art_Headers = Slrn_Current_Header = NULL;
    SLMEMSET ((char *) &Slrn_Header_Window, 0, sizeof (SLscroll_Window_Type));
@@ -7439,6 +7788,7 @@ static SLKeymap_Function_Type Art_Functions [] = /*{{{*/
    A_KEY("forward", forward_article),
    A_KEY("forward_digest", skip_digest_forward),
    A_KEY("get_children_headers", get_children_headers),
+   A_KEY("get_older_headers", get_older_headers),
    A_KEY("get_parent_header", get_parent_header),
 #if SLRN_HAS_GROUPLENS
    A_KEY("grouplens_rate_article", grouplens_rate_article),
@@ -7469,6 +7819,7 @@ static SLKeymap_Function_Type Art_Functions [] = /*{{{*/
    A_KEY("reply", reply_cmd),
    A_KEY("request", request_header_cmd),
    A_KEY("save", save_article),
+   A_KEY("server_header_search", server_header_search),
 #if SLRN_HAS_SPOILERS
    A_KEY("show_spoilers", show_spoilers),
 #endif
@@ -7539,6 +7890,7 @@ static Slrn_Mode_Type Art_Mode_Cap = /*{{{*/
    slrn_art_hangup,
    NULL,			       /* enter_mode_hook */
    SLRN_ARTICLE_MODE,
+   art_idle_prefetch,		       /* idle_fun */
 };
 
 /*}}}*/
@@ -7614,9 +7966,11 @@ void slrn_init_article_mode (void) /*{{{*/
    SLkm_define_key  ("W", (FVOID_STAR) toggle_wrap_article, Slrn_Article_Keymap);
    SLkm_define_key  ("\033^C", (FVOID_STAR) cancel_article, Slrn_Article_Keymap);
    SLkm_define_key  ("\033^P", (FVOID_STAR) get_children_headers, Slrn_Article_Keymap);
+   SLkm_define_key  ("\033x", (FVOID_STAR) server_header_search, Slrn_Article_Keymap);
    SLkm_define_key  ("\033^S", (FVOID_STAR) supersede, Slrn_Article_Keymap);
    SLkm_define_key  ("\033a", (FVOID_STAR) toggle_header_formats, Slrn_Article_Keymap);
    SLkm_define_key  ("\033d", (FVOID_STAR) thread_delete_cmd, Slrn_Article_Keymap);
+   SLkm_define_key  ("\033o", (FVOID_STAR) get_older_headers, Slrn_Article_Keymap);
    SLkm_define_key  ("\033p", (FVOID_STAR) get_parent_header, Slrn_Article_Keymap);
    SLkm_define_key  ("\033S", (FVOID_STAR) _art_toggle_sort, Slrn_Article_Keymap);
    SLkm_define_key  ("\033t", (FVOID_STAR) toggle_collapse_threads, Slrn_Article_Keymap);
@@ -7801,7 +8155,7 @@ int slrn_select_article_mode (Slrn_Group_Type *g, NNTP_Artnum_Type all, int scor
    NNTP_Artnum_Type min, max;
    NNTP_Artnum_Type smin, smax;
    Slrn_Range_Type *r;
-   int status;
+   int status, paged;
 
    slrn_init_graphic_chars ();
 
@@ -7838,6 +8192,9 @@ int slrn_select_article_mode (Slrn_Group_Type *g, NNTP_Artnum_Type all, int scor
    /* Now r points to ranges already read.  */
 
    status = 0;
+   Lowest_Requested_Number = Slrn_Server_Max + 1;
+   Page_Unread_Only = (all <= 0);
+   paged = 0;
 
    if (all > 0)
      {
@@ -7925,6 +8282,16 @@ int slrn_select_article_mode (Slrn_Group_Type *g, NNTP_Artnum_Type all, int scor
 	     else all = smax - smin + 1;
 	  }
 
+	/* In paged mode, only look at the newest articles for now. */
+	if ((Slrn_Header_Page_Size > 0)
+	    && (smax - smin >= Slrn_Header_Page_Size))
+	  {
+	     smin = smax - Slrn_Header_Page_Size + 1;
+	     while ((r != NULL) && (r->max < smin))
+	       r = r->next;
+	     paged = 1;
+	  }
+
 	while (r != NULL)
 	  {
 	     if (r->min > smin)
@@ -7992,6 +8359,10 @@ int slrn_select_article_mode (Slrn_Group_Type *g, NNTP_Artnum_Type all, int scor
    else if (Perform_Scoring)
      score_headers (1);
 
+   /* If the newest page only had read or killed articles, look further. */
+   if ((_art_Headers == NULL) && paged && (User_Aborted_Group_Read == 0))
+     (void) get_older_headers_page ();
+
    if (_art_Headers == NULL)
      {
 	slrn_close_score ();
@@ -8003,7 +8374,10 @@ int slrn_select_article_mode (Slrn_Group_Type *g, NNTP_Artnum_Type all, int scor
 
 	free_kill_lists_and_update ();
 	Slrn_Current_Group_Name = NULL;
-	if ((SLang_get_error () == USER_BREAK) || (all != 0)) return -1;
+	/* Do not catch up older articles that we never looked at. */
+	if ((SLang_get_error () == USER_BREAK) || (all != 0)
+	    || (paged && (Lowest_Requested_Number > Slrn_Server_Min)))
+	  return -1;
 	else return -2;
      }
 
@@ -8021,6 +8395,7 @@ int slrn_select_article_mode (Slrn_Group_Type *g, NNTP_Artnum_Type all, int scor
 
    At_End_Of_Article = NULL;
    Header_Showing = NULL;
+   Prefetch_Stop_Header = NULL;
    SLMEMSET ((char *) &Slrn_Article_Window, 0, sizeof (SLscroll_Window_Type));
 
    set_article_visibility (0);
@@ -8937,14 +9312,240 @@ static char *display_header_cb (char ch, void *data, int *len, int *color) /*{{{
 }
 /*}}}*/
 
+/*{{{ header row cache */
+
+/* Formatting a header line is fairly expensive (dates, realnames and the
+ * read status of collapsed threads), although most lines look exactly as
+ * they did when they were last drawn.  So the screen cells of recently
+ * displayed headers are kept and copied back to the screen as long as
+ * nothing that affects their appearance has changed.
+ */
+#define HEADER_ROW_CACHE_SIZE 128
+
+typedef struct
+{
+   Slrn_Header_Type *h;
+   NNTP_Artnum_Type number;
+   char *subject;
+   char *from;
+   unsigned int flags;
+   unsigned int tag_number;
+   int score, thread_score;
+   int num_children;
+   int next_hidden;
+   int row_info;
+   /* Only used for collapsed threads: */
+   unsigned int thread_num, thread_read, thread_without, thread_request;
+#if SLRN_HAS_GROUPLENS
+   int gl_pred;
+#endif
+}
+Header_Row_Key_Type;
+
+typedef struct
+{
+   Header_Row_Key_Type key;
+   unsigned int generation;	       /* 0 if not valid */
+   int number_row;		       /* header number drawn, if any */
+   unsigned int ncells;
+   SLsmg_Char_Type *cells;	       /* malloced */
+}
+Header_Row_Type;
+
+static Header_Row_Type Header_Row_Cache [HEADER_ROW_CACHE_SIZE];
+static unsigned int Header_Row_Generation = 1;
+
+/* Settings that affect all header lines; when one of them changes, the
+ * cache is invalidated. */
+#define NUM_HEADER_ROW_SETTINGS 12
+static int Header_Row_Settings [NUM_HEADER_ROW_SETTINGS];
+static char *Header_Row_Format;	       /* malloced */
+static char *Header_Row_Date_Format;     /* malloced */
+static char *Header_Row_Realname;	       /* malloced */
+
+/* Called when the threads are rebuilt. */
+void _art_invalidate_header_rows (void) /*{{{*/
+{
+   Header_Row_Generation++;
+   if (Header_Row_Generation == 0)
+     Header_Row_Generation++;
+}
+
+/*}}}*/
+
+static void forget_header_row (Slrn_Header_Type *h) /*{{{*/
+{
+   Header_Row_Type *r = Header_Row_Cache + (h->hash % HEADER_ROW_CACHE_SIZE);
+
+   if (r->key.h == h)
+     {
+	r->key.h = NULL;
+	r->generation = 0;
+     }
+}
+
+/*}}}*/
+
+static int update_header_row_string (char **copy, char *str) /*{{{*/
+{
+   if (str == NULL) str = "";
+   if ((*copy != NULL) && (0 == strcmp (*copy, str)))
+     return 0;
+
+   slrn_free (*copy);
+   *copy = slrn_strmalloc (str, 0);   /* NULL ok here */
+   return 1;
+}
+
+/*}}}*/
+
+static void check_header_row_settings (char *fmt, int start_col) /*{{{*/
+{
+   int settings [NUM_HEADER_ROW_SETTINGS];
+   int changed = 0;
+
+   memset ((char *) settings, 0, sizeof (settings));
+   settings[0] = SLtt_Screen_Cols;
+   settings[1] = SLtt_Screen_Rows;
+   settings[2] = start_col;
+   settings[3] = Slrn_Use_Header_Numbers;
+   settings[4] = Slrn_Show_Thread_Subject;
+   settings[5] = Slrn_Color_By_Score;
+   settings[6] = Slrn_Highlight_Unread;
+   settings[7] = Slrn_High_Score_Min;
+   settings[8] = Graphic_Chars_Mode;
+   settings[9] = _art_Headers_Threaded;
+   settings[10] = Slrn_Use_Localtime;
+#if SLRN_HAS_GROUPLENS
+   settings[11] = Num_GroupLens_Rated;
+#endif
+
+   if (memcmp ((char *) settings, (char *) Header_Row_Settings, sizeof (settings)))
+     {
+	memcpy ((char *) Header_Row_Settings, (char *) settings, sizeof (settings));
+	changed = 1;
+     }
+
+   changed |= update_header_row_string (&Header_Row_Format, fmt);
+   changed |= update_header_row_string (&Header_Row_Date_Format,
+					Slrn_Overview_Date_Format);
+   changed |= update_header_row_string (&Header_Row_Realname,
+					Slrn_User_Info.realname);
+
+   if (changed)
+     _art_invalidate_header_rows ();
+}
+
+/*}}}*/
+
+static void make_header_row_key (Slrn_Header_Type *h, int row, /*{{{*/
+				 Header_Row_Key_Type *key)
+{
+   memset ((char *) key, 0, sizeof (Header_Row_Key_Type));
+
+   key->h = h;
+   key->number = h->number;
+   key->subject = h->subject;
+   key->from = h->from;
+   key->flags = h->flags;
+   key->tag_number = h->tag_number;
+   key->score = h->score;
+   key->thread_score = h->thread_score;
+   key->num_children = h->num_children;
+   key->next_hidden = ((h->next != NULL) && (h->next->flags & HEADER_HIDDEN));
+#if SLRN_HAS_GROUPLENS
+   key->gl_pred = h->gl_pred;
+#endif
+
+   /* The header number and the subject of followups depend on the row. */
+   if (row + 1 == SLtt_Screen_Rows)
+     key->row_info = -1;
+   else if (Slrn_Use_Header_Numbers)
+     key->row_info = row;
+   else
+     key->row_info = (row == 1);
+
+   if ((h->parent == NULL) && (h->child != NULL)
+       && (h->child->flags & HEADER_HIDDEN))
+     {
+	Slrn_Header_Type *next = h->sister;
+
+	while (h != next)
+	  {
+	     key->thread_num++;
+	     if (h->flags & HEADER_READ)
+	       key->thread_read++;
+	     if (h->flags & HEADER_WITHOUT_BODY)
+	       key->thread_without++;
+	     if (h->flags & HEADER_REQUEST_BODY)
+	       key->thread_request++;
+	     h = h->next;
+	  }
+     }
+}
+
+/*}}}*/
+
+/*}}}*/
+
 static void display_header_line (Slrn_Header_Type *h, int row)
 {
    char *fmt = Header_Display_Formats[Header_Format_Number];
+   Header_Row_Key_Type key;
+   Header_Row_Type *r;
+   unsigned int ncells;
+   int largest, c0 = 0;
 
    if ((fmt == NULL) || (*fmt == 0))
      fmt = Default_Header_Format;
 
+   /* The cells are read and written with the screen start set to 0. */
+   SLsmg_set_screen_start (NULL, &c0);
+   check_header_row_settings (fmt, c0);
+   make_header_row_key (h, row, &key);
+
+   r = Header_Row_Cache + (h->hash % HEADER_ROW_CACHE_SIZE);
+   ncells = (unsigned int) SLtt_Screen_Cols;
+
+   if ((r->generation == Header_Row_Generation)
+       && (r->ncells == ncells)
+       && (0 == memcmp ((char *) &key, (char *) &r->key, sizeof (key))))
+     {
+	SLsmg_gotorc (row, 0);
+	(void) SLsmg_write_raw (r->cells, ncells);
+	SLsmg_set_screen_start (NULL, &c0);
+	if (r->number_row > Largest_Header_Number)
+	  Largest_Header_Number = r->number_row;
+	return;
+     }
+
+   SLsmg_set_screen_start (NULL, &c0);
+   largest = Largest_Header_Number;
+   Largest_Header_Number = 0;
    slrn_custom_printf (fmt, display_header_cb, (void *) h, row, 0);
+   r->number_row = Largest_Header_Number;
+   if (largest > Largest_Header_Number)
+     Largest_Header_Number = largest;
+
+   r->generation = 0;
+   if (r->ncells != ncells)
+     {
+	slrn_free ((char *) r->cells);
+	r->ncells = 0;
+	r->cells = (SLsmg_Char_Type *) slrn_malloc (ncells * sizeof (SLsmg_Char_Type), 0, 0);
+	if (r->cells == NULL)
+	  return;
+	r->ncells = ncells;
+     }
+
+   SLsmg_set_screen_start (NULL, &c0);
+   SLsmg_gotorc (row, 0);
+   if (ncells == SLsmg_read_raw (r->cells, ncells))
+     {
+	r->key = key;
+	r->generation = Header_Row_Generation;
+     }
+   SLsmg_set_screen_start (NULL, &c0);
 }
 
 static void display_article_line (Slrn_Article_Line_Type *l)
@@ -9254,6 +9855,9 @@ static void update_article_window (void)
 	SLsmg_set_screen_start (NULL, &c0);
 	l = a->cline;
 
+	/* Leave a screenful for scrolling; the rest is done when idle. */
+	slrn_art_mark_window_quotes (a, l, 2 * (unsigned int) height);
+
 	row = Slrn_Header_Window.nrows + 2;
 	if (row == 2) row--;	       /* header window not visible */
 
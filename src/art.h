@@ -51,6 +51,7 @@ extern int Slrn_Wrap_Width;
 extern int Slrn_Wrap_Method;
 extern int Slrn_Use_Header_Numbers;
 extern int Slrn_Reads_Per_Update;
+extern int Slrn_Header_Page_Size;
 extern int Slrn_High_Score_Min;
 extern int Slrn_Low_Score_Max;
 extern int Slrn_Kill_Score_Max;
@@ -130,10 +131,12 @@ typedef struct Slrn_Header_Type
    char *from;			       /* malloced */
    char *date;			       /* malloced */
    char *msgid;			       /* malloced */
-   char *refs;			       /* malloced */
+   struct Slrn_Msgid_Type **refs;      /* malloced -- interned ids, see hash.h */
+   unsigned int num_refs;
    char *xref;			       /* malloced */
    char *realname;		       /* malloced */
    unsigned int tag_number;
+   unsigned int search_id;	       /* see hdrindex.c; 0 if not indexed */
    Slrn_Header_Line_Type *add_hdrs;
 #define MAX_TREE_SIZE 256
    char *tree_ptr;		       /* malloced -- could be NULL */
@@ -171,6 +174,9 @@ typedef struct Slrn_Article_Line_Type
 #define HIDDEN_LINE		0x0400
 #define LINE_ATTRIBUTES_MASK	0x0700
 
+#define QUOTES_CHECKED_LINE	0x1000 /* see slrn_art_mark_quotes */
+#define BLANK_QUOTE_LINE	0x2000 /* no text after the quote prefix */
+
 #define LINE_HAS_8BIT_FLAG	0x8000
    union
      {
@@ -208,6 +214,7 @@ typedef struct
    int verbatim_marks_hidden;
    Slrn_Mime_Type mime;
    int needs_sync;		       /* non-zero if line number/current line needs updated */
+   Slrn_Article_Line_Type *unchecked_quotes; /* NULL if all lines were checked */
 }
 Slrn_Article_Type;
 
@@ -296,6 +303,8 @@ extern int _slrn_art_hide_quotes (Slrn_Article_Type *a, int);
 extern void slrn_art_mark_spoilers (Slrn_Article_Type *a);
 #endif
 extern void slrn_art_mark_quotes (Slrn_Article_Type *a);
+extern void slrn_art_mark_window_quotes (Slrn_Article_Type *a, Slrn_Article_Line_Type *, unsigned int);
+extern int slrn_art_mark_more_quotes (Slrn_Article_Type *a, unsigned int);
 extern void slrn_art_mark_signature (Slrn_Article_Type *a);
 extern int _slrn_art_unwrap_article (Slrn_Article_Type *a);
 extern int _slrn_art_wrap_article (Slrn_Article_Type *a);
@@ -122,17 +122,28 @@ int _slrn_art_unhide_quotes (Slrn_Article_Type *a) /*{{{*/
 
 /*}}}*/
 
-static unsigned char *is_matching_line (unsigned char *b, SLRegexp_Type **r) /*{{{*/
+/* Returns the end of the match if one of the regexps in r matches at the
+ * beginning of b (of length len).  Regexps that cannot match the first byte
+ * of b are not tried at all, which is the common case for body lines. */
+static unsigned char *is_matching_line (unsigned char *b, unsigned int len, /*{{{*/
+					SLRegexp_Type **r)
 {
-   unsigned int len;
-   len = strlen ((char *) b);
+   unsigned char *any;
+   int i;
+
+   any = slrn_regexp_first_bytes (r, -1);
+   if ((any != NULL) && (0 == SLRN_BYTE_IN_SET (any, *b)))
+     return NULL;
 
-   while (*r != NULL)
+   for (i = 0; r[i] != NULL; i++)
      {
 	SLRegexp_Type *re;
 	unsigned int match_len;
 
-	re = *r++;
+	re = r[i];
+	if ((any != NULL)
+	    && (0 == SLRN_BYTE_IN_SET (slrn_regexp_first_bytes (r, i), *b)))
+	  continue;
 #if SLANG_VERSION < 20000
 	if ((re->min_length > len)
 	    || (b != SLang_regexp_match (b, len, re)))
@@ -157,6 +168,7 @@ int _slrn_art_hide_quotes (Slrn_Article_Type *a, int reset) /*{{{*/
    if (a == NULL)
      return -1;
 
+   (void) slrn_art_mark_more_quotes (a, 0);
    _slrn_art_unhide_quotes (a);
 
    a->needs_sync = 1;
@@ -185,17 +197,11 @@ int _slrn_art_hide_quotes (Slrn_Article_Type *a, int reset) /*{{{*/
 		  else
 		    {
 		       last = l;
-		       if ((l->next != NULL) && (l->next->flags & QUOTE_LINE))
+		       if ((l->next != NULL) && (l->next->flags & QUOTE_LINE)
+			   && (l->flags & BLANK_QUOTE_LINE))
 			 {
-			    unsigned char *str, *line = (unsigned char*)l->buf;
-			    while (NULL != (str = is_matching_line
-					    (line, Slrn_Ignore_Quote_Regexp)))
-			      line = str;
-			    if (0 == *(slrn_skip_whitespace((char*)line)))
-			      {
-				 l->flags |= HIDDEN_LINE;
-				 last = NULL;
-			      }
+			    l->flags |= HIDDEN_LINE;
+			    last = NULL;
 			 }
 		    }
 	       }
@@ -338,10 +344,55 @@ static int try_supercite (Slrn_Article_Line_Type *l) /*{{{*/
 
 /*}}}*/
 
+/* Matching every line against the quote regexps is the most expensive
+ * part of preparing an article, so it is done lazily:  The display only
+ * asks for the lines it shows (slrn_art_mark_window_quotes), the rest is
+ * done while waiting for a key or as soon as a function needs to know about
+ * all quotes (slrn_art_mark_more_quotes).  The other marks do not depend on
+ * the quotes; lines they claim are never marked as quotes, just like before.
+ * Checked lines get QUOTES_CHECKED_LINE, and BLANK_QUOTE_LINE remembers
+ * whether anything but the quote prefix is on the line, which saves
+ * _slrn_art_hide_quotes from matching the regexps again.
+ */
+static void mark_quote_line (Slrn_Article_Line_Type *l) /*{{{*/
+{
+   unsigned char *b, *str;
+   unsigned int len;
+   int level;
+
+   l->flags |= QUOTES_CHECKED_LINE;
+   if (l->flags & (HEADER_LINE|VERBATIM_LINE|SIGNATURE_LINE|PGP_SIGNATURE_LINE))
+     return;
+
+   /* Each match consumes one quote prefix, so the level is found in one
+    * pass over the line. */
+   b = (unsigned char *) l->buf;
+   len = strlen ((char *) b);
+   level = 0;
+   while (NULL != (str = is_matching_line (b, len, Slrn_Ignore_Quote_Regexp)))
+     {
+	if (str == b)
+	  break;			       /* empty match */
+	len -= (unsigned int) (str - b);
+	b = str;
+	level++;
+     }
+
+   if (0 == *(slrn_skip_whitespace ((char *) b)))
+     l->flags |= BLANK_QUOTE_LINE;
+
+   if (level)
+     {
+	l->flags |= QUOTE_LINE;
+	l->v.quote_level = level;
+     }
+}
+
+/*}}}*/
+
 void slrn_art_mark_quotes (Slrn_Article_Type *a) /*{{{*/
 {
    Slrn_Article_Line_Type *l;
-   unsigned char *b;
 
    if (a == NULL)
      return;
@@ -351,32 +402,61 @@ void slrn_art_mark_quotes (Slrn_Article_Type *a) /*{{{*/
 	/* return; */
      }
 
-   if (Slrn_Ignore_Quote_Regexp[0] == NULL) return;
-
    /* skip header */
    l = a->lines;
    while ((l != NULL) && (l->flags == HEADER_LINE))
      l = l->next;
 
-   while (l != NULL)
+   a->unchecked_quotes = l;
+   if (Slrn_Ignore_Quote_Regexp[0] != NULL)
+     a->is_modified = 1;
+}
+
+/*}}}*/
+
+/* Checks the lines that are needed to display n lines starting at l. */
+void slrn_art_mark_window_quotes (Slrn_Article_Type *a, /*{{{*/
+				  Slrn_Article_Line_Type *l, unsigned int n)
+{
+   if ((a == NULL) || (a->unchecked_quotes == NULL))
+     return;
+
+   while ((l != NULL) && n)
      {
-	int level;
-	b = (unsigned char *) l->buf;
+	if (0 == (l->flags & QUOTES_CHECKED_LINE))
+	  mark_quote_line (l);
+	if (0 == (l->flags & HIDDEN_LINE))
+	  n--;
+	l = l->next;
+     }
+}
+
+/*}}}*/
+
+/* Checks up to max lines that have not been checked yet (all if max is 0).
+ * Returns non-zero if there are more lines to check.
+ */
+int slrn_art_mark_more_quotes (Slrn_Article_Type *a, unsigned int max) /*{{{*/
+{
+   Slrn_Article_Line_Type *l;
+   unsigned int count = 0;
+
+   if (a == NULL)
+     return 0;
 
-	if (NULL == (b = is_matching_line (b, Slrn_Ignore_Quote_Regexp)))
+   l = a->unchecked_quotes;
+   while (l != NULL)
+     {
+	if (0 == (l->flags & QUOTES_CHECKED_LINE))
 	  {
-	     l = l->next;
-	     continue;
+	     if (max && (count++ == max))
+	       break;
+	     mark_quote_line (l);
 	  }
-	l->flags |= QUOTE_LINE;
-	level = 1;
-	while (NULL != (b = is_matching_line (b, Slrn_Ignore_Quote_Regexp)))
-	  level++;
-
-	l->v.quote_level = level;
 	l = l->next;
      }
-   a->is_modified = 1;
+   a->unchecked_quotes = l;
+   return (l != NULL);
 }
 
 /*}}}*/
@@ -398,6 +478,7 @@ void slrn_art_mark_signature (Slrn_Article_Type *a) /*{{{*/
    while ((l != NULL) && (0 == (l->flags & HEADER_LINE))
 	  && ((l->flags & VERBATIM_LINE) ||
 	      (NULL == is_matching_line ((unsigned char *) l->buf,
+					 strlen (l->buf),
 					 Slrn_Strip_Sig_Regexp))))
      l = l->prev;
 
@@ -462,6 +543,9 @@ int _slrn_art_unwrap_article (Slrn_Article_Type *a) /*{{{*/
    if (a == NULL)
      return -1;
 
+   /* Lines are about to be merged, and callers look at the quotes. */
+   (void) slrn_art_mark_more_quotes (a, 0);
+
    a->needs_sync = 1;
    a->is_modified = 1;
    l = a->lines;
@@ -650,6 +734,8 @@ void _slrn_art_skip_quoted_text (Slrn_Article_Type *a) /*{{{*/
    if (a == NULL)
      return;
 
+   (void) slrn_art_mark_more_quotes (a, 0);
+
    l = a->cline;
    a->needs_sync = 1;
 
@@ -321,6 +321,8 @@ void slrn_sort_headers (void) /*{{{*/
 			 unsigned int, int (*)(Slrn_Header_Type **, Slrn_Header_Type **)))
      qsort;
 
+   _art_invalidate_header_rows ();
+
    /* Maybe we must (re-)compile Sort_Functions first */
    sort_order = get_current_sort_order (&do_threading);
    if ((sort_order != NULL) &&
@@ -427,6 +429,8 @@ void _art_sort_by_server_number (void) /*{{{*/
 {
    Slrn_Header_Type *h;
 
+   _art_invalidate_header_rows ();
+
    /* This is easy since the real_next, prev are already ordered. */
    h = Slrn_First_Header;
    while (h != NULL)
@@ -496,9 +500,7 @@ static void link_lost_relatives (void) /*{{{*/
    h = Slrn_First_Header;
    while (h != NULL)
      {
-	if ((h->parent == NULL)
-	    && (h->refs != NULL)
-	    && (*h->refs != 0)) n++;
+	if ((h->parent == NULL) && h->num_refs) n++;
 
 	h = h->real_next;
      }
@@ -514,23 +516,11 @@ static void link_lost_relatives (void) /*{{{*/
    h = Slrn_First_Header;
    while (h != NULL)
      {
-	if ((h->parent == NULL)
-	    && (h->refs != NULL)
-	    && (*h->refs != 0))
+	if ((h->parent == NULL) && h->num_refs)
 	  {
-	     unsigned char *r, *ref_begin;
-
-	     r = (unsigned char *) h->refs;
-	     while (*r && (*r != '<')) r++;
-	     if (*r)
-	       {
-		  ref_begin = r;
-		  while (*r && (*r != '>')) r++;
-		  if (*r) r++;
-		  relatives[n].ref_hash = slrn_compute_hash (ref_begin, r);
-		  relatives[n].h = h;
-		  n++;
-	       }
+	     relatives[n].ref_hash = h->refs[0]->hash;
+	     relatives[n].h = h;
+	     n++;
 	  }
 	h = h->real_next;
      }
@@ -861,7 +851,7 @@ static void fixup_threads (void) /*{{{*/
 static void sort_by_threads (void) /*{{{*/
 {
    Slrn_Header_Type *h, *ref;
-   char *r0, *r1, *rmin;
+   unsigned int i;
 
    /* First, resolve existing threads. */
    h = Slrn_First_Header;
@@ -879,24 +869,13 @@ static void sort_by_threads (void) /*{{{*/
    h = Slrn_First_Header;
    while (h != NULL)
      {
-	if (*h->refs == 0)
+	/* Try to find an article from the References header, starting
+	 * with the closest ancestor */
+	i = h->num_refs;
+	while (i)
 	  {
-	     h = h->real_next;
-	     continue;
-	  }
-
-	rmin = h->refs;
-	r1 = rmin + strlen (rmin);
-
-	/* Try to find an article from the References header */
-	while (1)
-	  {
-	     while ((r1 > rmin) && (*r1 != '>')) r1--;
-	     r0 = r1 - 1;
-	     while ((r0 >= rmin) && (*r0 != '<')) r0--;
-	     if ((r0 < rmin) || (r1 == rmin)) break;
-
-	     ref = _art_find_header_from_msgid (r0, r1 + 1);
+	     i--;
+	     ref = _art_find_header_from_ref (h->refs[i]);
 
 	     if (ref != NULL)
 	       {
@@ -939,7 +918,6 @@ static void sort_by_threads (void) /*{{{*/
 		       break;
 		    }
 	       }
-	     r1 = r0;
 	  }
 	h = h->real_next;
      }
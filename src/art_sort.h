@@ -35,6 +35,8 @@ extern Slrn_Header_Type *_art_Headers;
 extern int _art_Threads_Collapsed;
 
 extern void _art_find_header_line_num (void);
+extern void _art_invalidate_header_rows (void);
 extern Slrn_Header_Type *_art_find_header_from_msgid (char *r0, char *r1);
+extern Slrn_Header_Type *_art_find_header_from_ref (struct Slrn_Msgid_Type *);
 
 #endif				       /* _SLRN_ART_H */
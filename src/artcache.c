@@ -0,0 +1,709 @@
+/* -*- mode: C; mode: fold; -*- */
+/*
+ This file is part of SLRN.
+
+ Copyright (c) 1994, 1999, 2007-2016 John E. Davis <jed@jedsoft.org>
+ Copyright (c) 2001-2006 Thomas Schultz <tststs@gmx.de>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the Free
+ Software Foundation; either version 2 of the License, or (at your option)
+ any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ more details.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/* This file implements a cache of raw articles that sits between article
+ * mode and the server object.  It replaces the sv_select_article and
+ * sv_read_line methods of the server object: when an article is selected
+ * that is already in the cache, the lines are returned from memory without
+ * contacting the server.  Otherwise, the lines read from the server are
+ * copied into the cache as they pass through.
+ *
+ * There are two levels: a small LRU list in memory, and (if the
+ * article_cache_directory variable is set) a directory with one file per
+ * article.  The file name is derived from the Message-ID, and the first
+ * line of the file holds the Message-ID itself to detect hash collisions.
+ * The modification time of a file is updated whenever it is used, so the
+ * oldest files are the least recently used ones.
+ */
+#include "config.h"
+#include "slrnfeat.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef REAL_UNIX_SYSTEM
+# include <utime.h>
+#endif
+
+#include <slang.h>
+#include "jdmacros.h"
+
+#include "slrn.h"
+#include "util.h"
+#include "strutil.h"
+#include "misc.h"
+#include "server.h"
+#include "hash.h"
+#include "slrndir.h"
+#include "snprintf.h"
+#include "artcache.h"
+
+int Slrn_Prefetch_Depth = 0;
+int Slrn_Prefetch_Cache_Size = 1024;   /* kB */
+char *Slrn_Article_Cache_Dir = NULL;
+int Slrn_Article_Cache_Size = 10240;   /* kB */
+
+typedef struct Cache_Entry_Type
+{
+   struct Cache_Entry_Type *next, *prev;   /* next is less recently used */
+   unsigned long hash;
+   char *msgid;			       /* malloced */
+   char *buf;			       /* malloced, lines separated by \n */
+   unsigned int len;
+}
+Cache_Entry_Type;
+
+static Cache_Entry_Type *Cache_Head, *Cache_Tail;
+static unsigned long Cache_Bytes;
+
+/* The server methods we are hooked into. */
+static int (*Server_Select_Article) (NNTP_Artnum_Type, char *);
+static int (*Server_Read_Line) (char *, unsigned int);
+static void (*Server_Reset) (void);
+
+/* When an article is served from the cache, these point into the buffer of
+ * the cache entry (or into Replay_Buf for articles that came from disk but
+ * are too large for the memory cache). */
+static char *Replay_Ptr, *Replay_Max;
+static char *Replay_Buf;
+
+/* Non-zero if the server is remote, i.e. the disk cache makes sense. */
+static int Disk_Cache_Usable;
+static long Disk_Cache_Bytes = -1;     /* -1 if not yet known */
+
+/* Copy of the article that is being read from the server. */
+static int Tee_Active;
+static char *Tee_Msgid;
+static char *Tee_Buf;
+static unsigned int Tee_Len, Tee_Max;
+
+static unsigned long cache_size_limit (void)
+{
+   if (Slrn_Prefetch_Cache_Size <= 0)
+     return 0;
+   return 1024UL * (unsigned long) Slrn_Prefetch_Cache_Size;
+}
+
+static unsigned long disk_cache_size_limit (void)
+{
+   if ((Disk_Cache_Usable == 0)
+       || (Slrn_Article_Cache_Dir == NULL) || (*Slrn_Article_Cache_Dir == 0)
+       || (Slrn_Article_Cache_Size <= 0))
+     return 0;
+   return 1024UL * (unsigned long) Slrn_Article_Cache_Size;
+}
+
+static unsigned long tee_size_limit (void)
+{
+   unsigned long mem = cache_size_limit ();
+   unsigned long disk = disk_cache_size_limit ();
+
+   return (mem > disk) ? mem : disk;
+}
+
+static unsigned long hash_msgid (char *msgid)
+{
+   return slrn_compute_hash ((unsigned char *) msgid,
+			     (unsigned char *) msgid + strlen (msgid));
+}
+
+/*{{{ LRU list functions */
+
+static void unlink_entry (Cache_Entry_Type *e)
+{
+   if (e->prev == NULL) Cache_Head = e->next;
+   else e->prev->next = e->next;
+
+   if (e->next == NULL) Cache_Tail = e->prev;
+   else e->next->prev = e->prev;
+
+   e->next = e->prev = NULL;
+}
+
+static void push_entry (Cache_Entry_Type *e)
+{
+   e->prev = NULL;
+   e->next = Cache_Head;
+   if (Cache_Head != NULL)
+     Cache_Head->prev = e;
+   Cache_Head = e;
+   if (Cache_Tail == NULL)
+     Cache_Tail = e;
+}
+
+static void free_entry (Cache_Entry_Type *e)
+{
+   Cache_Bytes -= e->len + sizeof (Cache_Entry_Type);
+   slrn_free (e->msgid);
+   slrn_free (e->buf);
+   slrn_free ((char *) e);
+}
+
+static void shrink_cache (unsigned long max_bytes)
+{
+   while ((Cache_Tail != NULL) && (Cache_Bytes > max_bytes))
+     {
+	Cache_Entry_Type *e = Cache_Tail;
+	unlink_entry (e);
+	free_entry (e);
+     }
+}
+
+static Cache_Entry_Type *find_entry (char *msgid)
+{
+   Cache_Entry_Type *e;
+   unsigned long hash;
+
+   if ((msgid == NULL) || (*msgid == 0))
+     return NULL;
+
+   hash = hash_msgid (msgid);
+   e = Cache_Head;
+   while (e != NULL)
+     {
+	if ((e->hash == hash) && (0 == strcmp (e->msgid, msgid)))
+	  return e;
+	e = e->next;
+     }
+   return NULL;
+}
+
+/* On success, the cache takes over the buf pointer.  On failure, the
+ * caller still owns it. */
+static Cache_Entry_Type *add_entry (char *msgid, char *buf, unsigned int len)
+{
+   Cache_Entry_Type *e;
+   unsigned long max_bytes = cache_size_limit ();
+
+   if (len + sizeof (Cache_Entry_Type) > max_bytes)
+     return NULL;
+
+   if (NULL != (e = find_entry (msgid)))
+     {
+	unlink_entry (e);
+	free_entry (e);
+     }
+
+   shrink_cache (max_bytes - (len + sizeof (Cache_Entry_Type)));
+
+   e = (Cache_Entry_Type *) slrn_malloc (sizeof (Cache_Entry_Type), 1, 0);
+   if ((e == NULL)
+       || (NULL == (e->msgid = slrn_strmalloc (msgid, 0))))
+     {
+	slrn_free ((char *) e);
+	return NULL;
+     }
+   e->hash = hash_msgid (msgid);
+   e->buf = buf;
+   e->len = len;
+   Cache_Bytes += len + sizeof (Cache_Entry_Type);
+   push_entry (e);
+   return e;
+}
+
+/*}}}*/
+
+/*{{{ Disk cache functions */
+
+static int disk_cache_dir (char *dir, size_t n)
+{
+   if (disk_cache_size_limit () == 0)
+     return -1;
+
+   slrn_make_home_dirname (Slrn_Article_Cache_Dir, dir, n);
+   if ((2 != slrn_file_exists (dir))
+       && (-1 == slrn_mkdir (dir)))
+     return -1;
+
+   return 0;
+}
+
+#define DISK_NAME_LEN 16
+static int disk_cache_file (char *msgid, char *file, size_t n)
+{
+   char dir[SLRN_MAX_PATH_LEN];
+   char name[DISK_NAME_LEN + 1];
+   unsigned long h1, h2;
+   unsigned char *p;
+
+   if ((msgid == NULL) || (*msgid == 0)
+       || (-1 == disk_cache_dir (dir, sizeof (dir))))
+     return -1;
+
+   /* slrn_compute_hash ignores case, so mix in a case-sensitive FNV hash */
+   h1 = hash_msgid (msgid) & 0xFFFFFFFFUL;
+   h2 = 2166136261UL;
+   for (p = (unsigned char *) msgid; *p != 0; p++)
+     h2 = ((h2 ^ *p) * 16777619UL) & 0xFFFFFFFFUL;
+
+   slrn_snprintf (name, sizeof (name), "%08lX%08lX", h1, h2);
+   return slrn_dircat (dir, name, file, n);
+}
+
+static int is_disk_cache_name (char *name, unsigned int len)
+{
+   unsigned int i;
+
+   if (len != DISK_NAME_LEN)
+     return 0;
+
+   for (i = 0; i < len; i++)
+     {
+	char ch = name[i];
+	if (((ch < '0') || (ch > '9')) && ((ch < 'A') || (ch > 'F')))
+	  return 0;
+     }
+   return 1;
+}
+
+typedef struct
+{
+   char name[DISK_NAME_LEN + 1];
+   time_t mtime;
+   unsigned long size;
+}
+Disk_Entry_Type;
+
+static int compare_disk_entries (const void *a, const void *b)
+{
+   time_t ta = ((Disk_Entry_Type *) a)->mtime;
+   time_t tb = ((Disk_Entry_Type *) b)->mtime;
+
+   if (ta < tb) return -1;
+   return (ta > tb);
+}
+
+/* Computes the size of the disk cache and removes the least recently used
+ * files until it is no larger than max_bytes. */
+static void shrink_disk_cache (char *dir, unsigned long max_bytes)
+{
+   Slrn_Dir_Type *dp;
+   Slrn_Dirent_Type *de;
+   Disk_Entry_Type *entries = NULL;
+   unsigned int num = 0, max_num = 0, i;
+   unsigned long total = 0;
+   char file[SLRN_MAX_PATH_LEN];
+   struct stat st;
+
+   if (NULL == (dp = slrn_open_dir (dir)))
+     return;
+
+   while (NULL != (de = slrn_read_dir (dp)))
+     {
+	if ((0 == is_disk_cache_name (de->name, de->name_len))
+	    || (-1 == slrn_dircat (dir, de->name, file, sizeof (file)))
+	    || (-1 == stat (file, &st)))
+	  continue;
+
+	if (num == max_num)
+	  {
+	     Disk_Entry_Type *tmp;
+	     max_num += 256;
+	     tmp = (Disk_Entry_Type *) slrn_realloc ((char *) entries,
+						     max_num * sizeof (Disk_Entry_Type), 0);
+	     if (tmp == NULL)
+	       break;
+	     entries = tmp;
+	  }
+	strcpy (entries[num].name, de->name); /* safe */
+	entries[num].mtime = st.st_mtime;
+	entries[num].size = (unsigned long) st.st_size;
+	total += entries[num].size;
+	num++;
+     }
+   slrn_close_dir (dp);
+
+   if ((total > max_bytes) && (num > 0))
+     {
+	qsort ((char *) entries, num, sizeof (Disk_Entry_Type), compare_disk_entries);
+
+	for (i = 0; (i < num) && (total > max_bytes); i++)
+	  {
+	     if ((-1 == slrn_dircat (dir, entries[i].name, file, sizeof (file)))
+		 || (-1 == slrn_delete_file (file)))
+	       continue;
+	     total -= entries[i].size;
+	  }
+     }
+
+   slrn_free ((char *) entries);
+   Disk_Cache_Bytes = (long) total;
+}
+
+/* Returns a malloced copy of the article without the Message-ID line. */
+static char *read_disk_entry (char *msgid, unsigned int *lenp)
+{
+   char file[SLRN_MAX_PATH_LEN];
+   struct stat st;
+   unsigned int idlen, len;
+   char *buf;
+   FILE *fp;
+
+   if ((-1 == disk_cache_file (msgid, file, sizeof (file)))
+       || (-1 == stat (file, &st)))
+     return NULL;
+
+   idlen = strlen (msgid);
+   len = (unsigned int) st.st_size;
+   if ((len <= idlen + 1) || ((off_t) len != st.st_size))
+     return NULL;
+
+   if (NULL == (fp = fopen (file, "rb")))
+     return NULL;
+
+   if (NULL == (buf = slrn_malloc (len, 0, 0)))
+     {
+	fclose (fp);
+	return NULL;
+     }
+
+   if ((len != fread (buf, 1, len, fp))
+       || (0 != strncmp (buf, msgid, idlen))
+       || (buf[idlen] != '\n'))
+     {
+	fclose (fp);
+	slrn_free (buf);
+	return NULL;
+     }
+   fclose (fp);
+
+   len -= idlen + 1;
+   memmove (buf, buf + idlen + 1, len);
+   *lenp = len;
+
+#ifdef REAL_UNIX_SYSTEM
+   (void) utime (file, NULL);	       /* mark as recently used */
+#endif
+   return buf;
+}
+
+static void write_disk_entry (char *msgid, char *buf, unsigned int len)
+{
+   char dir[SLRN_MAX_PATH_LEN], file[SLRN_MAX_PATH_LEN];
+   char tmp_file[SLRN_MAX_PATH_LEN];
+   unsigned long max_bytes, size, target;
+   struct stat st;
+   FILE *fp;
+
+   max_bytes = disk_cache_size_limit ();
+   size = len + strlen (msgid) + 1;
+   if ((size > max_bytes)
+       || (-1 == disk_cache_dir (dir, sizeof (dir)))
+       || (-1 == disk_cache_file (msgid, file, sizeof (file))))
+     return;
+
+   /* Shrink to 3/4 of the limit, so that we do not need to scan the
+    * directory every time an article is added. */
+   if ((Disk_Cache_Bytes < 0)
+       || ((unsigned long) Disk_Cache_Bytes + size > max_bytes))
+     {
+	target = (max_bytes / 4) * 3;
+	if (size >= max_bytes / 4)
+	  target = (size < target) ? target - size : 0;
+	shrink_disk_cache (dir, target);
+     }
+
+   if (NULL == (fp = slrn_open_tmpfile_in_dir (dir, tmp_file, sizeof (tmp_file))))
+     return;
+
+   if ((EOF == fputs (msgid, fp))
+       || (EOF == putc ('\n', fp))
+       || (len != fwrite (buf, 1, len, fp))
+       || (0 != fclose (fp)))
+     {
+	(void) slrn_delete_file (tmp_file);
+	return;
+     }
+
+   /* If the article is already cached, it is replaced below. */
+   if (-1 == stat (file, &st))
+     st.st_size = 0;
+
+   if (-1 == slrn_move_file (tmp_file, file))
+     {
+	(void) slrn_delete_file (tmp_file);
+	return;
+     }
+
+   if (Disk_Cache_Bytes >= 0)
+     Disk_Cache_Bytes += (long) size - (long) st.st_size;
+}
+
+static int is_on_disk (char *msgid)
+{
+   char file[SLRN_MAX_PATH_LEN];
+
+   if (-1 == disk_cache_file (msgid, file, sizeof (file)))
+     return 0;
+   return (1 == slrn_file_exists (file));
+}
+
+/*}}}*/
+
+/*{{{ Copying articles as they are read from the server */
+
+static void tee_abort (void)
+{
+   slrn_free (Tee_Msgid);
+   slrn_free (Tee_Buf);
+   Tee_Msgid = Tee_Buf = NULL;
+   Tee_Len = Tee_Max = 0;
+   Tee_Active = 0;
+}
+
+static void tee_start (char *msgid)
+{
+   tee_abort ();
+
+   if ((msgid == NULL) || (*msgid == 0)
+       || (tee_size_limit () == 0))
+     return;
+
+   if (NULL == (Tee_Msgid = slrn_strmalloc (msgid, 0)))
+     return;
+
+   Tee_Active = 1;
+}
+
+static void tee_line (char *line)
+{
+   unsigned int len = strlen (line);
+
+   if (Tee_Len + len + 1 > Tee_Max)
+     {
+	unsigned int max = Tee_Max + len + 1 + 16384;
+	char *buf;
+
+	if (max + sizeof (Cache_Entry_Type) > tee_size_limit ())
+	  {
+	     /* This one will not fit anyway */
+	     tee_abort ();
+	     return;
+	  }
+	if (NULL == (buf = slrn_realloc (Tee_Buf, max, 0)))
+	  {
+	     tee_abort ();
+	     return;
+	  }
+	Tee_Buf = buf;
+	Tee_Max = max;
+     }
+
+   memcpy (Tee_Buf + Tee_Len, line, len);
+   Tee_Len += len;
+   Tee_Buf[Tee_Len++] = '\n';
+}
+
+static void tee_finish (void)
+{
+   char *buf;
+
+   if ((Tee_Buf == NULL) || (Tee_Len == 0))
+     {
+	tee_abort ();
+	return;
+     }
+
+   /* Give the excess memory back.  If that fails, keep the larger one. */
+   if (NULL == (buf = slrn_realloc (Tee_Buf, Tee_Len, 0)))
+     buf = Tee_Buf;
+
+   Tee_Buf = buf;
+
+   write_disk_entry (Tee_Msgid, Tee_Buf, Tee_Len);
+
+   if (NULL != add_entry (Tee_Msgid, Tee_Buf, Tee_Len))
+     Tee_Buf = NULL;
+
+   tee_abort ();
+}
+
+/*}}}*/
+
+/*{{{ Server object methods */
+
+static void replay_end (void)
+{
+   Replay_Ptr = Replay_Max = NULL;
+   slrn_free (Replay_Buf);
+   Replay_Buf = NULL;
+}
+
+static int cache_select_article (NNTP_Artnum_Type n, char *msgid)
+{
+   Cache_Entry_Type *e;
+   unsigned int len;
+   char *buf;
+   int status;
+
+   replay_end ();
+   tee_abort ();
+
+   if (NULL != (e = find_entry (msgid)))
+     {
+	unlink_entry (e);
+	push_entry (e);
+	Replay_Ptr = e->buf;
+	Replay_Max = e->buf + e->len;
+	return OK_ARTICLE;
+     }
+
+   if (NULL != (buf = read_disk_entry (msgid, &len)))
+     {
+	if (NULL != (e = add_entry (msgid, buf, len)))
+	  buf = NULL;
+	else
+	  Replay_Buf = buf;
+	Replay_Ptr = (e != NULL) ? e->buf : buf;
+	Replay_Max = Replay_Ptr + len;
+	return OK_ARTICLE;
+     }
+
+   status = (*Server_Select_Article) (n, msgid);
+   if (status == OK_ARTICLE)
+     tee_start (msgid);
+
+   return status;
+}
+
+static int cache_read_line (char *buf, unsigned int len)
+{
+   int status;
+
+   if (Replay_Ptr != NULL)
+     {
+	char *p = Replay_Ptr;
+	unsigned int n;
+
+	if (p >= Replay_Max)
+	  {
+	     replay_end ();
+	     return 0;
+	  }
+
+	while ((p < Replay_Max) && (*p != '\n'))
+	  p++;
+
+	n = (unsigned int) (p - Replay_Ptr);
+	if (n >= len)
+	  n = len - 1;
+	memcpy (buf, Replay_Ptr, n);
+	buf[n] = 0;
+
+	Replay_Ptr = p + 1;
+	return 1;
+     }
+
+   status = (*Server_Read_Line) (buf, len);
+
+   if (Tee_Active)
+     {
+	if (status == 1)
+	  tee_line (buf);
+	else if (status == 0)
+	  tee_finish ();
+	else
+	  tee_abort ();
+     }
+
+   return status;
+}
+
+static void cache_reset (void)
+{
+   replay_end ();
+   tee_abort ();
+
+   if (Server_Reset != NULL)
+     (*Server_Reset) ();
+}
+
+/*}}}*/
+
+void slrn_art_cache_init (void)
+{
+   if ((Slrn_Server_Obj == NULL)
+       || (Slrn_Server_Obj->sv_select_article == cache_select_article))
+     return;
+
+   Server_Select_Article = Slrn_Server_Obj->sv_select_article;
+   Server_Read_Line = Slrn_Server_Obj->sv_read_line;
+   Server_Reset = Slrn_Server_Obj->sv_reset;
+
+   Slrn_Server_Obj->sv_select_article = cache_select_article;
+   Slrn_Server_Obj->sv_read_line = cache_read_line;
+   Slrn_Server_Obj->sv_reset = cache_reset;
+
+   /* A local spool does not need another copy on disk */
+   Disk_Cache_Usable = (Slrn_Server_Id != SLRN_SERVER_ID_SPOOL);
+}
+
+unsigned int slrn_art_cache_article_size (char *msgid)
+{
+   Cache_Entry_Type *e;
+
+   if (NULL == (e = find_entry (msgid)))
+     return 0;
+   return e->len;
+}
+
+int slrn_art_cache_prefetch (NNTP_Artnum_Type n, char *msgid)
+{
+   char buf[NNTP_BUFFER_SIZE];
+   int status;
+
+   if ((Server_Select_Article == NULL)
+       || (msgid == NULL) || (*msgid == 0)
+       || (cache_size_limit () == 0))
+     return -1;
+
+   if ((NULL != find_entry (msgid)) || is_on_disk (msgid))
+     return 0;
+
+   if (OK_ARTICLE != Slrn_Server_Obj->sv_select_article (n, msgid))
+     return -1;
+
+   while (1 == (status = Slrn_Server_Obj->sv_read_line (buf, sizeof (buf))))
+     {
+	if (SLang_get_error () == USER_BREAK)
+	  {
+	     status = -1;
+	     break;
+	  }
+     }
+
+   if (status == -1)
+     {
+	if (Slrn_Server_Obj->sv_reset != NULL)
+	  Slrn_Server_Obj->sv_reset ();
+	return -1;
+     }
+
+   return (NULL != find_entry (msgid)) ? 1 : -1;
+}
@@ -0,0 +1,49 @@
+/*
+ This file is part of SLRN.
+
+ Copyright (c) 1994, 1999, 2007-2016 John E. Davis <jed@jedsoft.org>
+ Copyright (c) 2001-2006 Thomas Schultz <tststs@gmx.de>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the Free
+ Software Foundation; either version 2 of the License, or (at your option)
+ any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ more details.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+#ifndef _SLRN_ARTCACHE_H
+#define _SLRN_ARTCACHE_H
+
+/* Number of unread articles following the current one that are fetched
+ * while slrn is waiting for a keypress.  0 disables prefetching. */
+extern int Slrn_Prefetch_Depth;
+
+/* Size (in kB) of the in-memory cache of raw articles. */
+extern int Slrn_Prefetch_Cache_Size;
+
+/* Directory for the persistent cache of articles (NULL or empty to disable)
+ * and its maximum size in kB. */
+extern char *Slrn_Article_Cache_Dir;
+extern int Slrn_Article_Cache_Size;
+
+/* Hooks the cache into the sv_select_article and sv_read_line methods of
+ * the current server object.  Call this after selecting the server object. */
+extern void slrn_art_cache_init (void);
+
+/* Returns the number of bytes used by the cached copy of an article or 0 if
+ * the article is not in the cache. */
+extern unsigned int slrn_art_cache_article_size (char *);
+
+/* Downloads an article into the cache without displaying it.  Returns 1 if
+ * the article was fetched, 0 if it already was in the memory or disk cache
+ * and -1 on error. */
+extern int slrn_art_cache_prefetch (NNTP_Artnum_Type, char *);
+
+#endif				       /* _SLRN_ARTCACHE_H */
@@ -89,6 +89,108 @@ int slrn_string_nonascii(char *str)
 }
 
 #ifdef HAVE_ICONV
+/* Returns 1 if [str, strmax) contains only us-ascii characters */
+static int is_ascii_range (char *str, char *strmax)
+{
+   while (str < strmax)
+     {
+	if (*str & 0x80)
+	  return 0;
+	str++;
+     }
+   return 1;
+}
+
+/* Returns 1 if the charset is known to represent us-ascii characters as
+ * themselves, so that pure ascii text needs no conversion.  Charsets such
+ * as UTF-7 or ISO-2022-JP use ascii bytes for other characters. */
+static int is_ascii_superset (char *charset)
+{
+   static char *prefixes[] =
+     {
+	"us-ascii", "ascii", "utf-8", "utf8", "iso-8859-", "iso8859-",
+	"iso_8859-", "latin", "windows-125", "cp125", "koi8-", NULL
+     };
+   char **p;
+
+   if (charset == NULL)
+     return 0;
+
+   for (p = prefixes; *p != NULL; p++)
+     {
+	if (0 == slrn_case_strncmp (charset, *p, strlen (*p)))
+	  return 1;
+     }
+   return 0;
+}
+
+/* Opening an iconv descriptor is expensive, so the most recently used ones
+ * are kept open.  A descriptor taken from the cache is reset to its
+ * initial shift state before use. */
+#define ICONV_CACHE_SIZE 8
+typedef struct
+{
+   char *from;			       /* malloced */
+   char *to;			       /* malloced */
+   iconv_t cd;
+}
+Iconv_Cache_Type;
+
+static Iconv_Cache_Type Iconv_Cache[ICONV_CACHE_SIZE];
+static unsigned int Iconv_Cache_Num;
+
+static iconv_t open_iconv (char *to, char *from)
+{
+   Iconv_Cache_Type c;
+   unsigned int i;
+
+   for (i = 0; i < Iconv_Cache_Num; i++)
+     {
+	if ((0 == slrn_case_strcmp (Iconv_Cache[i].from, from))
+	    && (0 == slrn_case_strcmp (Iconv_Cache[i].to, to)))
+	  break;
+     }
+
+   if (i < Iconv_Cache_Num)
+     {
+	c = Iconv_Cache[i];
+	(void) iconv (c.cd, NULL, NULL, NULL, NULL);
+     }
+   else
+     {
+	if ((c.cd = iconv_open (to, from)) == (iconv_t)(-1))
+	  return c.cd;
+
+	if ((NULL == (c.from = slrn_strmalloc (from, 0)))
+	    || (NULL == (c.to = slrn_strmalloc (to, 0))))
+	  {
+	     slrn_free (c.from);
+	     iconv_close (c.cd);
+	     return (iconv_t)(-1);
+	  }
+
+	if (Iconv_Cache_Num == ICONV_CACHE_SIZE)
+	  {
+	     /* drop the least recently used one */
+	     i = --Iconv_Cache_Num;
+	     slrn_free (Iconv_Cache[i].from);
+	     slrn_free (Iconv_Cache[i].to);
+	     iconv_close (Iconv_Cache[i].cd);
+	  }
+	else i = Iconv_Cache_Num;
+	Iconv_Cache_Num++;
+     }
+
+   /* Move it to the front */
+   while (i > 0)
+     {
+	Iconv_Cache[i] = Iconv_Cache[i-1];
+	i--;
+     }
+   Iconv_Cache[0] = c;
+   return c.cd;
+}
+
 /* returns the converted string, or NULL on error or if no convertion is needed*/
 /* Returns 1 if iconv succeeded, 0 if it failed, or -1 upon some other error.
  * This function returns 0 only if test is 1.  Otherwise, if test is 0 and
@@ -125,7 +227,8 @@ static int iconv_convert_string (iconv_t cd, char *str, size_t len, int test, ch
 	if (need_realloc)
 	  {
 	     char *tmpbuf;
-	     unsigned int dsize = 2*len;
+	     /* Start with twice the input length and double from there */
+	     unsigned int dsize = buflen ? buflen : 2*len;
 	     buflen += dsize;
 	     outbytesleft += dsize;
 	     if (NULL == (tmpbuf = slrn_realloc (buf, buflen+1, test==0)))
@@ -173,14 +276,14 @@ static int iconv_convert_string (iconv_t cd, char *str, size_t len, int test, ch
      }
 
    len = (unsigned int) (bufp - buf);
-   bufp = slrn_realloc (buf, len+1, 1);
-   if (bufp == NULL)
-     {
-	slrn_free (buf);
-	return fail_error;
-     }
-   bufp[len] = 0;
-   *outstrp = bufp;
+   /* The result is usually kept for as long as the header or line it
+    * belongs to, so give back what is unused.  If that fails, the larger
+    * buffer is still good. */
+   if ((len < buflen)
+       && (NULL != (bufp = slrn_realloc (buf, len+1, 0))))
+     buf = bufp;
+   buf[len] = 0;
+   *outstrp = buf;
 
    return 1;
 }
@@ -238,7 +341,17 @@ char *slrn_convert_string (char *from, char *str, char *strmax, char *to, int te
 	free_from = 1;
      }
 
-   if ((cd = iconv_open(to, from)) == (iconv_t)(-1))
+   /* Pure ascii text looks the same in most charsets */
+   if ((str < strmax)
+       && is_ascii_superset (from) && is_ascii_superset (to)
+       && is_ascii_range (str, strmax))
+     {
+	if (free_from)
+	  slrn_free (from);
+	return slrn_strnmalloc (str, strmax-str, test==0);
+     }
+
+   if ((cd = open_iconv (to, from)) == (iconv_t)(-1))
      {
 	if (test == 0)
 	  slrn_error (_("Can't convert %s -> %s\n"), from, to);
@@ -250,7 +363,6 @@ char *slrn_convert_string (char *from, char *str, char *strmax, char *to, int te
      }
 
    status = iconv_convert_string (cd, str, strmax-str, test, &substr);
-   iconv_close(cd);
 
    if (free_from)
      slrn_free (from);
@@ -403,8 +515,9 @@ int slrn_convert_article(Slrn_Article_Type *a, char *to_charset, char *from_char
    iconv_t cd;
    char *tmp;
    struct Slrn_Article_Line_Type *line=a->lines;
+   int skip_ascii;
 
-   if ((cd = iconv_open(to_charset, from_charset)) == (iconv_t)(-1))
+   if ((cd = open_iconv (to_charset, from_charset)) == (iconv_t)(-1))
      {
 	slrn_error (_("Can't convert %s -> %s\n"), from_charset, to_charset);
 	return -1;
@@ -416,8 +529,17 @@ int slrn_convert_article(Slrn_Article_Type *a, char *to_charset, char *from_char
 	line=line->next;
      }
 
+   skip_ascii = (is_ascii_superset (from_charset)
+		 && is_ascii_superset (to_charset));
+
    while (line != NULL)
      {
+	if (skip_ascii && (0 == slrn_string_nonascii (line->buf)))
+	  {
+	     line=line->next;
+	     continue;
+	  }
+
 	if (1 == iconv_convert_string(cd, line->buf, strlen (line->buf), 0, &tmp))
 	  {
 	     slrn_free((char *) line->buf);
@@ -427,7 +549,6 @@ int slrn_convert_article(Slrn_Article_Type *a, char *to_charset, char *from_char
 	  }
 	line=line->next;
      }
-   iconv_close(cd);
 #else
    (void) a;
    (void) to_charset;
@@ -447,7 +568,7 @@ int slrn_test_convert_lines (Slrn_Article_Line_Type *rlines, char *to_charset, c
    iconv_t cd;
    int status;
 
-   if ((cd = iconv_open(to_charset, from_charset)) == (iconv_t)(-1))
+   if ((cd = open_iconv (to_charset, from_charset)) == (iconv_t)(-1))
      return 0;
 
    elines = eline = NULL;
@@ -527,7 +648,6 @@ int slrn_test_convert_lines (Slrn_Article_Line_Type *rlines, char *to_charset, c
    /* drop */
 
 free_return:
-   iconv_close (cd);
    while (elines != NULL)
      {
 	eline = elines;
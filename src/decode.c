@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -239,76 +240,138 @@ static void initialize_base64 (void) /*{{{*/
 
 /*}}}*/
 
-/* returns 0 if entire line was decoded, or 1if line appears to be padded, or
- * -1 if line looks bad.
- */
-/* Calling routine guarantees at least 4 characters in line and multiple of 4 */
-static int base64_decode_line (char *line, FILE *fp) /*{{{*/
+/* Decoded data is collected here and written in large chunks. */
+#define DECODE_OUTBUF_SIZE 0x8000
+typedef struct
 {
-   unsigned char ch;
-   unsigned char ch1;
-   unsigned char bytes[3];
-   unsigned char *p;
+   FILE *fp;
+   unsigned int len;
+   unsigned char buf[DECODE_OUTBUF_SIZE];
+}
+Decode_Output_Type;
 
-   p = (unsigned char *) line;
-   /* Perform simple syntax check.  The loop following this one
-    * assumes this.
-    */
-   while ((ch = *p++) != 0)
+static Decode_Output_Type Decode_Output;
+
+static void start_decode_output (FILE *fp) /*{{{*/
+{
+   Decode_Output.fp = fp;
+   Decode_Output.len = 0;
+}
+
+/*}}}*/
+
+static int flush_decode_output (void) /*{{{*/
+{
+   unsigned int len = Decode_Output.len, write_len;
+
+   if ((len == 0) || (Decode_Output.fp == NULL))
+     return 0;
+
+   Decode_Output.len = 0;
+   if (len != (write_len = fwrite ((char *) Decode_Output.buf, 1, len, Decode_Output.fp)))
      {
-	if (Base64_Table[ch] == 0xFF)
-	  return -1;
+	slrn_error (_("write to file failed (%u/%u bytes)\n"), write_len, len);
+	return -1;
+     }
+   return 0;
+}
 
-	ch = *p++;
-	if (Base64_Table[ch] == 0xFF)
-	  return -1;
+/*}}}*/
 
-	ch = *p++;
-	if ((Base64_Table[ch] == 0xFF) && (ch != '='))
-	  {
-	     return -1;
-	  }
+/* Makes sure that there is room for len more bytes in the output buffer and
+ * returns a pointer to it. */
+static unsigned char *reserve_decode_output (unsigned int len) /*{{{*/
+{
+   if ((Decode_Output.len + len > DECODE_OUTBUF_SIZE)
+       && (-1 == flush_decode_output ()))
+     return NULL;
+   return Decode_Output.buf + Decode_Output.len;
+}
 
-	ch = *p++;
-	if ((Base64_Table[ch] == 0xFF) && (ch != '='))
-	  {
-	     return -1;
-	  }
+/*}}}*/
+
+static int close_decode_output (FILE *fp, FILE *pipe_fp) /*{{{*/
+{
+   int ret = 0;
+
+   if (fp == Decode_Output.fp)
+     {
+	ret = flush_decode_output ();
+	Decode_Output.fp = NULL;
      }
+   if (-1 == uudecode_fclose (fp, pipe_fp))
+     ret = -1;
+   return ret;
+}
+
+/*}}}*/
 
-   while ((ch = (unsigned char) *line++) != 0)
+/* Checks the syntax of base64 encoded text that may contain padding. */
+static int is_valid_base64 (unsigned char *p, unsigned char *pmax) /*{{{*/
+{
+   while (p < pmax)
      {
-	ch1 = Base64_Table[ch];
-	bytes[0] = ch1 << 2;
+	if ((Base64_Table[p[0]] == 0xFF)
+	    || (Base64_Table[p[1]] == 0xFF)
+	    || ((Base64_Table[p[2]] == 0xFF) && (p[2] != '='))
+	    || ((Base64_Table[p[3]] == 0xFF) && (p[3] != '=')))
+	  return 0;
+	p += 4;
+     }
+   return 1;
+}
 
-	ch = *line++;
-	ch1 = Base64_Table[ch];
+/*}}}*/
 
-	bytes[0] |= ch1 >> 4;
-	bytes[1] = ch1 << 4;
+/* returns 0 if entire line was decoded, or 1if line appears to be padded, or
+ * -1 if line looks bad.  Nothing is written for bad lines.
+ */
+/* Calling routine guarantees at least 4 characters in line and multiple of 4 */
+static int base64_decode_line (char *line, unsigned int len) /*{{{*/
+{
+   unsigned char *p, *pmax;
+   unsigned char *out, *out0;
 
-	ch = *line++;
-	ch1 = Base64_Table[ch];
-	if (ch1 == 0xFF)
-	  {
-	     fwrite (bytes, 1, 1, fp);
-	     return 1;
-	  }
+   if (NULL == (out0 = reserve_decode_output ((len / 4) * 3)))
+     return -1;
+
+   out = out0;
+   p = (unsigned char *) line;
+   pmax = p + len;
+
+   while (p < pmax)
+     {
+	unsigned int t0, t1, t2, t3;
+	unsigned long w;
 
-	bytes[1] |= ch1 >> 2;
-	bytes[2] = ch1 << 6;
+	t0 = Base64_Table[p[0]];
+	t1 = Base64_Table[p[1]];
+	t2 = Base64_Table[p[2]];
+	t3 = Base64_Table[p[3]];
 
-	ch = *line++;
-	ch1 = Base64_Table[ch];
-	if (ch1 == 0xFF)
+	/* Invalid characters and padding have the high bit set */
+	if (0 == ((t0 | t1 | t2 | t3) & 0x80))
 	  {
-	     fwrite (bytes, 1, 2, fp);
-	     return 1;
+	     w = (t0 << 18) | (t1 << 12) | (t2 << 6) | t3;
+	     out[0] = (unsigned char) (w >> 16);
+	     out[1] = (unsigned char) (w >> 8);
+	     out[2] = (unsigned char) w;
+	     out += 3;
+	     p += 4;
+	     continue;
 	  }
-	bytes[2] |= ch1;
-	fwrite (bytes, 1, 3, fp);
+
+	if (0 == is_valid_base64 (p, pmax))
+	  return -1;
+
+	*out++ = (unsigned char) ((t0 << 2) | (t1 >> 4));
+	if (t2 != 0xFF)
+	  *out++ = (unsigned char) ((t1 << 4) | (t2 >> 2));
+	Decode_Output.len += (unsigned int) (out - out0);
+	return 1;
      }
 
+   Decode_Output.len += (unsigned int) (out - out0);
    return 0;
 }
 
@@ -346,33 +409,32 @@ static int decode_base64 (FILE *fp, FILE *fpout, char *line, unsigned int buflen
 {
    int decoding = 0;
    unsigned int len;
-   int ret;
+   int ret = 0;
+
+   start_decode_output (fpout);
 
    while (NULL != fgets_with_counter (line, buflen, fp, &len))
      {
-	if (Base64_Table[(unsigned char) *line] == 0xFF)
+	if ((Base64_Table[(unsigned char) *line] == 0xFF)
+	    || ((len % 4) != 0))
 	  {
-	     if (decoding) return 0;
-	     else return -1;
+	     ret = decoding ? 0 : -1;
+	     break;
 	  }
 
-	if ((len % 4) != 0)
-	  {
-	     if (decoding) return 0;
-	     else return -1;
-	  }
-
-	ret = base64_decode_line (line, fpout);
+	ret = base64_decode_line (line, len);
 	if (ret)
 	  {
 	     if ((ret == -1) && decoding) ret = 0;
-	     return ret;
+	     break;
 	  }
 
 	decoding = 1;
      }
 
-   return 0;
+   (void) flush_decode_output ();
+   Decode_Output.fp = NULL;
+   return ret;
 }
 
 /*}}}*/
@@ -821,12 +883,14 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 
 	if (NULL == (outfp = open_output_file (file, "uuencoded", mode, pipe_fp)))
 	  return -1;
+	start_decode_output (outfp);
 
 	/* Now read parts of the file in. */
 	while (fgets_with_counter (buf, sizeof(buf) - 1, fp, &buflen) != NULL)
 	  {
-	     unsigned int len, write_len;
-	     unsigned char out[60], *outp, *outmax, *b, *bmax;
+	     unsigned int len;
+	     unsigned char *outp, *outmax, *b;
+	     unsigned long w;
 
 	     if ((is_mbox) && (!strncmp (buf, "From", 4)) &&
 		 ((unsigned char)buf[4] <= ' '))
@@ -837,6 +901,7 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 						       fp, &buflen))
 			 {
 			    slrn_error (_("Unexpected end of file.\n"));
+			    (void) close_decode_output (outfp, pipe_fp);
 			    return -1;
 			 }
 		    }
@@ -851,12 +916,13 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 						  &buflen))
 		    {
 		       slrn_error (_("Unexpected end of file.\n"));
+		       (void) close_decode_output (outfp, pipe_fp);
 		       return -1;
 		    }
 
 		  if (!strcmp (buf, "end"))
 		    {
-		       uudecode_fclose (outfp, pipe_fp);
+		       (void) close_decode_output (outfp, pipe_fp);
 		       outfp = NULL;
 		       break;
 		    }
@@ -880,10 +946,11 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 							   &file, &mode)))
 		    continue;
 
-		  uudecode_fclose (outfp, pipe_fp);
+		  (void) close_decode_output (outfp, pipe_fp);
 
 		  if (NULL == (outfp = open_output_file (file, "uuencoded", mode, pipe_fp)))
 		    return -1;
+		  start_decode_output (outfp);
 
 		  continue;
 	       }
@@ -920,46 +987,32 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 		       continue;
 		    }
 	       }
-	     b = (unsigned char *) buf + 1;
-	     bmax = b + buflen;
-
-	     while (b < bmax)
+	     /* Decode groups of four characters straight into the output
+	      * buffer.  The length checks above guarantee that the last,
+	      * possibly partial group is complete in the input. */
+	     if (NULL == (outp = reserve_decode_output (len)))
 	       {
-		  *b = (*b - 32) & 0x3F;
-		  *(b + 1) = (*(b + 1) - 32) & 0x3F;
-		  *(b + 2) = (*(b + 2) - 32) & 0x3F;
-		  *(b + 3) = (*(b + 3) - 32) & 0x3F;
-		  b += 4;
+		  (void) close_decode_output (outfp, pipe_fp);
+		  return -1;
 	       }
-
+	     outmax = outp + len;
 	     b = (unsigned char *) buf + 1;
 
-	     outp = out;
-	     outmax = outp + len;
+#define UU(c) ((unsigned long) (((c) - ' ') & 0x3F))
 	     while (outp < outmax)
 	       {
-		  register unsigned char b1, b2;
-		  b1 = *(b + 1);
-		  b2 = *(b + 2);
-
-		  *outp++ = (*b << 2) | (b1 >> 4);
-
+		  w = (UU(b[0]) << 18) | (UU(b[1]) << 12) | (UU(b[2]) << 6) | UU(b[3]);
+		  *outp++ = (unsigned char) (w >> 16);
 		  if (outp < outmax)
 		    {
-		       *outp++ = (b1 << 4) | (b2 >> 2);
+		       *outp++ = (unsigned char) (w >> 8);
 		       if (outp < outmax)
-			 *outp++ = (b2 << 6) | *(b + 3);
+			 *outp++ = (unsigned char) w;
 		    }
 		  b += 4;
 	       }
-
-	     if (len != (write_len = fwrite ((char *) out, 1, len, outfp)))
-	       {
-		  slrn_error (_("write to file failed (%u/%u bytes)\n"),
-			      write_len, len);
-		  uudecode_fclose (outfp, pipe_fp);
-		  return -1;
-	       }
+#undef UU
+	     Decode_Output.len += len;
 	  }
 	/* end of part reading */
 
@@ -968,7 +1021,7 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 
    if (outfp != NULL)
      {
-	uudecode_fclose (outfp, pipe_fp);
+	(void) close_decode_output (outfp, pipe_fp);
 	outfp = NULL;
      }
    return 0;
@@ -976,6 +1029,379 @@ static int check_and_uudecode (FILE *fp, FILE *pipe_fp,
 
 /*}}}*/
 
+/* yEnc support.  An encoded file looks like
+ *
+ *   =ybegin part=1 total=3 line=128 size=123456 name=file.bin
+ *   =ypart begin=1 end=50000
+ *   ...data...
+ *   =yend size=50000 part=1 pcrc32=abcdef12
+ *
+ * The =ypart line is only present in multipart files.  Each part is
+ * written to its offset in the output file, so the parts may appear in any
+ * order as long as all parts of one file are kept together.
+ */
+static unsigned long Crc32_Table[256];
+
+static void initialize_crc32 (void) /*{{{*/
+{
+   unsigned long c;
+   int i, k;
+
+   if (Crc32_Table[1] != 0)
+     return;
+
+   for (i = 0; i < 256; i++)
+     {
+	c = (unsigned long) i;
+	for (k = 0; k < 8; k++)
+	  c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+	Crc32_Table[i] = c;
+     }
+}
+
+/*}}}*/
+
+static unsigned long update_crc32 (unsigned long crc, unsigned char *p, unsigned char *pmax) /*{{{*/
+{
+   crc ^= 0xFFFFFFFFUL;
+   while (p < pmax)
+     crc = Crc32_Table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+   return crc ^ 0xFFFFFFFFUL;
+}
+
+/*}}}*/
+
+static int parse_name_eqs_hex (char *p, char *name, unsigned long *val) /*{{{*/
+{
+   unsigned long hval = 0;
+   int ch, n = 0;
+
+   p = skip_beyond_name_eqs (p, name);
+   if (p == NULL) return -1;
+
+   while (((ch = (unsigned char) *p) != 0) && isxdigit (ch))
+     {
+	if (isdigit (ch)) ch -= '0';
+	else ch = (ch | 0x20) - 'a' + 10;
+	hval = ((hval << 4) | (unsigned long) ch) & 0xFFFFFFFFUL;
+	p++;
+	n++;
+     }
+   if (n == 0) return -1;
+
+   *val = hval;
+   return 0;
+}
+
+/*}}}*/
+
+/* Sizes and offsets of yEnc files may be larger than an int. */
+static int parse_name_eqs_long (char *p, char *name, long *val) /*{{{*/
+{
+   long lval = 0;
+   int ch, n = 0;
+
+   p = skip_beyond_name_eqs (p, name);
+   if (p == NULL) return -1;
+
+   while (((ch = (unsigned char) *p) != 0) && isdigit (ch))
+     {
+	ch -= '0';
+	if (lval > (LONG_MAX - ch) / 10)
+	  return -1;
+	lval = lval * 10 + ch;
+	p++;
+	n++;
+     }
+   if (n == 0) return -1;
+
+   *val = lval;
+   return 0;
+}
+
+/*}}}*/
+
+/* The name is the last parameter and extends to the end of the line. */
+static int parse_yenc_name (char *p, char *name, unsigned int len) /*{{{*/
+{
+   char *pmax;
+
+   p = skip_beyond_name_eqs (p, "name");
+   if (p == NULL) return -1;
+
+   pmax = p + strlen (p);
+   while ((pmax > p) && ((unsigned char) pmax[-1] <= ' '))
+     pmax--;
+
+   if ((pmax == p) || ((unsigned int) (pmax - p) >= len))
+     return -1;
+
+   strncpy (name, p, (unsigned int) (pmax - p));
+   name[pmax - p] = 0;
+   return 0;
+}
+
+/*}}}*/
+
+typedef struct
+{
+   char name[256];
+   FILE *fp;
+   int total;			       /* number of parts, 0 if unknown */
+   int parts_seen;
+   char *part_seen;		       /* malloced, total + 1 flags */
+   int had_errors;
+   long size;			       /* of the whole file */
+   long write_offset;		       /* position in the output file */
+   long next_offset;		       /* file_crc covers 0..next_offset */
+   unsigned long file_crc;
+   int can_seek;			       /* zero if writing to a pipe */
+}
+Yenc_File_Type;
+
+static int finish_yenc_file (Yenc_File_Type *yf, FILE *pipe_fp) /*{{{*/
+{
+   int ret;
+
+   if (yf->fp == NULL)
+     return 0;
+
+   ret = close_decode_output (yf->fp, pipe_fp);
+   yf->fp = NULL;
+   slrn_free (yf->part_seen);
+   yf->part_seen = NULL;
+
+   if ((yf->total > 0) && (yf->parts_seen < yf->total))
+     {
+	slrn_error (_("%s: only %d of %d parts found\n"),
+		    yf->name, yf->parts_seen, yf->total);
+	ret = -1;
+     }
+   return ret;
+}
+
+/*}}}*/
+
+/* Decodes the lines following a =ybegin line up to the =yend line.
+ * Returns 0 upon success, -1 upon error, or 1 if buf contains a =ybegin
+ * line that starts another part because this one was truncated.
+ */
+static int decode_yenc_part (FILE *fp, Yenc_File_Type *yf, int part, /*{{{*/
+			     char *buf, unsigned int buflen)
+{
+   long begin = 1, end = 0, offset, len = 0, size;
+   unsigned long part_crc = 0, crc;
+   int escaped = 0, at_bol = 1, has_ypart = 0;
+   int in_order;
+
+   if (NULL == fgets (buf, buflen, fp))
+     goto unexpected_eof;
+
+   if (0 == strncmp (buf, "=ypart ", 7))
+     {
+	has_ypart = 1;
+	(void) parse_name_eqs_long (buf + 7, "begin", &begin);
+	(void) parse_name_eqs_long (buf + 7, "end", &end);
+	if (begin < 1) begin = 1;
+
+	if (NULL == fgets (buf, buflen, fp))
+	  goto unexpected_eof;
+     }
+
+   offset = begin - 1;
+   if (yf->can_seek && (offset != yf->write_offset))
+     {
+	if (-1 == flush_decode_output ())
+	  return -1;
+	if (-1 == fseek (yf->fp, offset, SEEK_SET))
+	  {
+	     slrn_error (_("%s: unable to seek to part %d\n"), yf->name, part);
+	     return -1;
+	  }
+     }
+   /* The CRC of the whole file can only be computed if the parts come in
+    * order. */
+   in_order = (offset == yf->next_offset);
+
+   do
+     {
+	unsigned char *p, *out, *out0;
+	unsigned int n;
+
+	if (at_bol && (buf[0] == '=') && (buf[1] == 'y'))
+	  {
+	     if (0 == strncmp (buf, "=yend", 5))
+	       break;
+	     if (0 == strncmp (buf, "=ybegin ", 8))
+	       {
+		  slrn_error (_("%s: part %d is truncated\n"), yf->name, part);
+		  (void) flush_decode_output ();
+		  return 1;
+	       }
+	  }
+
+	p = (unsigned char *) buf;
+	n = strlen (buf);
+	at_bol = (n && (buf[n-1] == '\n'));
+
+	if (NULL == (out0 = reserve_decode_output (n)))
+	  return -1;
+
+	out = out0;
+	while (n--)
+	  {
+	     unsigned char ch = *p++;
+
+	     if (escaped)
+	       {
+		  *out++ = (unsigned char) (ch - 106);   /* 64 + 42 */
+		  escaped = 0;
+	       }
+	     else if (ch == '=')
+	       escaped = 1;
+	     else if ((ch != '\n') && (ch != '\r'))
+	       *out++ = (unsigned char) (ch - 42);
+	  }
+
+	part_crc = update_crc32 (part_crc, out0, out);
+	if (in_order)
+	  yf->file_crc = update_crc32 (yf->file_crc, out0, out);
+	len += (long) (out - out0);
+	Decode_Output.len += (unsigned int) (out - out0);
+     }
+   while (NULL != fgets (buf, buflen, fp));
+
+   if (0 != strncmp (buf, "=yend", 5))
+     goto unexpected_eof;
+
+   if ((yf->part_seen == NULL) || (part < 1) || (part > yf->total))
+     yf->parts_seen++;
+   else if (yf->part_seen[part] == 0)
+     {
+	yf->part_seen[part] = 1;
+	yf->parts_seen++;
+     }
+   yf->write_offset = offset + len;
+   if (in_order)
+     yf->next_offset = offset + len;
+
+   if (((end >= begin) && (len != end - begin + 1))
+       || ((0 == parse_name_eqs_long (buf + 5, "size", &size)) && (len != size)))
+     {
+	slrn_error (_("%s: part %d has the wrong size\n"), yf->name, part);
+	yf->had_errors = 1;
+	return -1;
+     }
+
+   if (0 == parse_name_eqs_hex (buf + 5, has_ypart ? "pcrc32" : "crc32", &crc))
+     {
+	if (crc != part_crc)
+	  {
+	     slrn_error (_("%s: CRC32 mismatch in part %d\n"), yf->name, part);
+	     yf->had_errors = 1;
+	     return -1;
+	  }
+     }
+
+   if (has_ypart && in_order && (yf->had_errors == 0)
+       && (yf->next_offset == yf->size)
+       && (0 == parse_name_eqs_hex (buf + 5, "crc32", &crc))
+       && (crc != yf->file_crc))
+     {
+	slrn_error (_("%s: CRC32 mismatch\n"), yf->name);
+	return -1;
+     }
+
+   return 0;
+
+   unexpected_eof:
+   slrn_error (_("%s: unexpected end of file in part %d\n"), yf->name, part);
+   return -1;
+}
+
+/*}}}*/
+
+/* If have_ybegin is non-zero, the "=ybegin " of the first line has already
+ * been read.  */
+static int check_and_decode_yenc (FILE *fp, FILE *pipe_fp, int have_ybegin) /*{{{*/
+{
+   Yenc_File_Type yf;
+   char buf[MAX_ARTICLE_LINE_LEN];
+   char name[sizeof (yf.name)];
+   int ret = 0, status = 0;
+
+   initialize_crc32 ();
+   memset ((char *) &yf, 0, sizeof (Yenc_File_Type));
+
+   while (1)
+     {
+	int part = 0, total = 0;
+	long size = 0;
+
+	if (have_ybegin)
+	  {
+	     strcpy (buf, "=ybegin ");     /* safe */
+	     if (NULL == fgets (buf + 8, sizeof (buf) - 8, fp))
+	       break;
+	     have_ybegin = 0;
+	  }
+	else if (status != 1)
+	  {
+	     /* Look for the next =ybegin line */
+	     if (NULL == fgets (buf, sizeof (buf), fp))
+	       break;
+	     if (strncmp (buf, "=ybegin ", 8))
+	       continue;
+	  }
+
+	if (-1 == parse_yenc_name (buf + 8, name, sizeof (name)))
+	  {
+	     status = 0;
+	     continue;
+	  }
+	(void) parse_name_eqs_int (buf + 8, "part", &part);
+	(void) parse_name_eqs_int (buf + 8, "total", &total);
+	(void) parse_name_eqs_long (buf + 8, "size", &size);
+
+	/* A part that was already seen starts a new file of the same name */
+	if ((yf.fp != NULL)
+	    && ((part < 1) || strcmp (name, yf.name)
+		|| ((yf.part_seen != NULL) && (part <= yf.total)
+		    && yf.part_seen[part])))
+	  {
+	     if (-1 == finish_yenc_file (&yf, pipe_fp))
+	       ret = -1;
+	  }
+
+	if (yf.fp == NULL)
+	  {
+	     char file[sizeof (yf.name)];
+
+	     memset ((char *) &yf, 0, sizeof (Yenc_File_Type));
+	     strcpy (yf.name, name);     /* safe */
+	     strcpy (file, name);	       /* safe */
+	     if (NULL == (yf.fp = open_output_file (file, "yEnc", -1, pipe_fp)))
+	       return -1;
+	     yf.total = total;
+	     yf.size = size;
+	     yf.can_seek = (yf.fp != pipe_fp);
+	     if ((total > 0) && (total < 0x10000))
+	       yf.part_seen = slrn_malloc (total + 1, 1, 0);
+	     start_decode_output (yf.fp);
+	  }
+
+	status = decode_yenc_part (fp, &yf, part, buf, sizeof (buf));
+	if (status == -1)
+	  ret = -1;
+     }
+
+   if (-1 == finish_yenc_file (&yf, pipe_fp))
+     ret = -1;
+   return ret;
+}
+
+/*}}}*/
+
 static int decode_best_guess (FILE *fp, FILE *pipe_fp, int no_slop) /*{{{*/
 {
    int ch;
@@ -999,6 +1425,21 @@ static int decode_best_guess (FILE *fp, FILE *pipe_fp, int no_slop) /*{{{*/
 	     return check_and_uudecode (fp, pipe_fp, no_slop);
 	  }
 
+	if (ch == '=')
+	  {
+	     char *ybegin = "ybegin ";
+
+	     while ((*ybegin != 0) && (*ybegin == (ch = getc (fp))))
+	       ybegin++;
+
+	     if (*ybegin == 0)
+	       return check_and_decode_yenc (fp, pipe_fp, 1);
+
+	     if (ch == EOF) break;
+	     nl_seen = (ch == '\n');
+	     continue;
+	  }
+
 	nl_seen = 0;
 
 	mime_ptr = "mime-version:";
@@ -1078,12 +1519,19 @@ int slrn_uudecode_file (char *file, char *newdir, /*{{{*/
    else if (base64_only == 0)
      {
 	ret = check_and_uudecode (fp, pipe_fp, no_slop);
+	if ((ret == 0) && (fp != stdin))
+	  {
+	     rewind (fp);
+	     ret = check_and_decode_yenc (fp, pipe_fp, 0);
+	  }
 	if ((ret == 0) && (fp != stdin))
 	  {
 	     rewind (fp);
 	     ret = check_and_decode_base64 (fp, pipe_fp);
 	  }
      }
+   else if (base64_only == 2)
+     ret = check_and_decode_yenc (fp, pipe_fp, 0);
    else ret = check_and_decode_base64 (fp, pipe_fp);
 
    if (fp != stdin)
@@ -1109,7 +1557,7 @@ int slrn_uudecode_file (char *file, char *newdir, /*{{{*/
 #ifdef STANDALONE
 static void usage (void) /*{{{*/
 {
-   fprintf (stderr, _("Usage: uudecode [-64] [--stdout] [--guess] [filename ...]\n"));
+   fprintf (stderr, _("Usage: uudecode [-64] [-y] [--stdout] [--guess] [filename ...]\n"));
 }
 
 /*}}}*/
@@ -1172,6 +1620,12 @@ int main (int argc, char **argv) /*{{{*/
 	     argc--;
 	     argv++;
 	  }
+	else if (!strcmp ("-y", argv[1]))
+	  {
+	     base64_only = 2;
+	     argc--;
+	     argv++;
+	  }
 	else if (!strcmp ("--stdout", argv[1]))
 	  {
 	     pipe_fp = stdout;
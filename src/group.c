@@ -125,6 +125,7 @@ static void save_newsrc_cmd (void);
 static void read_and_parse_active (int);
 static int  parse_active_line (unsigned char *, unsigned int *, int *, int *);
 static void remove_group_entry (Slrn_Group_Type *);
+static Slrn_Group_Type *find_group_entry (char *, unsigned int);
 
 /*}}}*/
 
@@ -154,10 +155,11 @@ void slrn_group_recount_unread (Slrn_Group_Type *g)
    g->unread = count_unread (&g->range);
 }
 
-static int is_article_requested (Slrn_Group_Type *g, NNTP_Artnum_Type num) /*{{{*/
+/* Returns the articles whose body has been requested in true offline mode */
+static Slrn_Range_Type *get_requested_ranges (Slrn_Group_Type *g) /*{{{*/
 {
 #if SLRN_HAS_SPOOL_SUPPORT
-   if (Slrn_Server_Id != SLRN_SERVER_ID_SPOOL) return 0;
+   if (Slrn_Server_Id != SLRN_SERVER_ID_SPOOL) return NULL;
 
    if (g->requests_loaded == 0)
      {
@@ -165,14 +167,23 @@ static int is_article_requested (Slrn_Group_Type *g, NNTP_Artnum_Type num) /*{{{
 	g->requests_loaded = 1;
      }
 
-   return slrn_ranges_is_member (g->requests, num);
+   return g->requests;
 #else
-   (void) g; (void) num;
-   return 0;
+   (void) g;
+   return NULL;
 #endif
 }
 /*}}}*/
 
+static int is_article_requested (Slrn_Group_Type *g, NNTP_Artnum_Type num) /*{{{*/
+{
+   Slrn_Range_Type *requests = get_requested_ranges (g);
+
+   if (requests == NULL) return 0;
+   return slrn_ranges_is_member (requests, num);
+}
+/*}}}*/
+
 static void group_mark_article_as_read (Slrn_Group_Type *g, NNTP_Artnum_Type num) /*{{{*/
 {
    Slrn_Range_Type *r;
@@ -245,6 +256,187 @@ void slrn_mark_articles_as_read (char *group,
 
 /*}}}*/
 
+/* Counts the articles in [min, max] that are in both a and b */
+static NNTP_Artnum_Type count_common_articles (Slrn_Range_Type *a, /*{{{*/
+					       Slrn_Range_Type *b,
+					       NNTP_Artnum_Type min,
+					       NNTP_Artnum_Type max)
+{
+   NNTP_Artnum_Type count = 0;
+
+   while ((a != NULL) && (b != NULL))
+     {
+	NNTP_Artnum_Type lo, hi;
+
+	lo = (a->min > b->min) ? a->min : b->min;
+	hi = (a->max < b->max) ? a->max : b->max;
+	if (lo < min) lo = min;
+	if (hi > max) hi = max;
+	if (lo <= hi)
+	  count += hi - lo + 1;
+
+	if (a->max < b->max)
+	  a = a->next;
+	else
+	  b = b->next;
+     }
+   return count;
+}
+
+/*}}}*/
+
+/* Marks all articles in the (sorted) range list r as read in the current
+ * group.  The result is the same as calling slrn_mark_articles_as_read
+ * on every range in ascending order, but r is merged into the group's
+ * ranges in one go and the unread count is adjusted once.  r itself is
+ * not changed. */
+static void group_mark_ranges_as_read (Slrn_Group_Type *g, Slrn_Range_Type *r) /*{{{*/
+{
+   Slrn_Range_Type *marks, *k;
+   NNTP_Artnum_Type oldmax, newmax, nlow, nhigh, read_low, read_high;
+
+   if ((g == NULL) || (r == NULL))
+     return;
+
+   /* Never mark articles as read if their body has been requested. */
+   marks = r;
+   if (NULL != (k = get_requested_ranges (g)))
+     {
+	marks = slrn_ranges_clone (r);
+	while (k != NULL)
+	  {
+	     marks = slrn_ranges_remove (marks, k->min, k->max);
+	     k = k->next;
+	  }
+	if (marks == NULL)
+	  return;
+     }
+
+   /* Articles beyond the group's maximum are not at the server yet, so
+    * they raise the maximum instead of lowering the unread count. */
+   oldmax = g->range.max;
+   newmax = oldmax;
+   nlow = nhigh = 0;
+   for (k = marks; k != NULL; k = k->next)
+     {
+	if (k->max <= oldmax)
+	  nlow += k->max - k->min + 1;
+	else if (k->min > oldmax)
+	  nhigh += k->max - k->min + 1;
+	else
+	  {
+	     nlow += oldmax - k->min + 1;
+	     nhigh += k->max - oldmax;
+	  }
+	newmax = k->max;
+     }
+
+   read_low = count_common_articles (g->range.next, marks, marks->min, oldmax);
+   read_high = 0;
+   if (newmax > oldmax)
+     read_high = count_common_articles (g->range.next, marks, oldmax + 1, newmax);
+
+   nlow -= read_low;
+   if (nlow >= g->unread)
+     g->unread = 0;
+   else
+     g->unread -= nlow;
+   g->unread += read_high;
+   if (newmax > oldmax)
+     g->range.max = newmax;
+
+   if (nlow + (nhigh - read_high))
+     {
+	Slrn_Groups_Dirty = 1;
+	g->range.next = slrn_ranges_merge (g->range.next, marks);
+     }
+
+   if (marks != r)
+     slrn_ranges_free (marks);
+}
+
+/*}}}*/
+
+void slrn_mark_ranges_as_read (Slrn_Range_Type *r) /*{{{*/
+{
+   group_mark_ranges_as_read (Slrn_Group_Current_Group, r);
+}
+
+/*}}}*/
+
+/* Groups with articles that were marked read through cross-references
+ * while reading another group.  Their marks are collected in pending_marks
+ * and merged in one go, see slrn_flush_pending_marks. */
+static Slrn_Group_Type *Pending_Marks_Groups;
+
+void slrn_mark_article_as_read_later (char *group, unsigned int len, /*{{{*/
+				      NNTP_Artnum_Type num)
+{
+   Slrn_Group_Type *g;
+
+   if (NULL == (g = find_group_entry (group, len)))
+     return;
+
+   /* If it looks like we have read this group, mark it read. */
+   if ((g->flags & GROUP_UNSUBSCRIBED) && (g->range.next == NULL))
+     return;
+
+   /* The current group's ranges are updated from its headers later */
+   if (g == Slrn_Group_Current_Group)
+     {
+	group_mark_article_as_read (g, num);
+	return;
+     }
+
+   if (g->pending_marks == NULL)
+     {
+	g->pending_next = Pending_Marks_Groups;
+	Pending_Marks_Groups = g;
+     }
+   g->pending_marks = slrn_ranges_add (g->pending_marks, num, num);
+}
+
+/*}}}*/
+
+void slrn_flush_pending_marks (void) /*{{{*/
+{
+   while (Pending_Marks_Groups != NULL)
+     {
+	Slrn_Group_Type *g = Pending_Marks_Groups;
+
+	Pending_Marks_Groups = g->pending_next;
+	group_mark_ranges_as_read (g, g->pending_marks);
+	slrn_ranges_free (g->pending_marks);
+	g->pending_marks = NULL;
+	g->pending_next = NULL;
+     }
+}
+
+/*}}}*/
+
+static void forget_pending_marks (Slrn_Group_Type *g) /*{{{*/
+{
+   Slrn_Group_Type **p;
+
+   if (g->pending_marks == NULL)
+     return;
+
+   p = &Pending_Marks_Groups;
+   while (*p != NULL)
+     {
+	if (*p == g)
+	  {
+	     *p = g->pending_next;
+	     break;
+	  }
+	p = &(*p)->pending_next;
+     }
+   slrn_ranges_free (g->pending_marks);
+   g->pending_marks = NULL;
+}
+
+/*}}}*/
+
 static int group_update_range (Slrn_Group_Type *g, NNTP_Artnum_Type min, NNTP_Artnum_Type max) /*{{{*/
 {
    NNTP_Artnum_Type n, max_available;
@@ -366,6 +558,7 @@ static void free_newsgroup_type (Slrn_Group_Type *g)
 {
    if (g == NULL)
      return;
+   forget_pending_marks (g);
    slrn_free (g->descript);
    slrn_ranges_free (g->range.next);
    slrn_ranges_free (g->requests);
@@ -463,6 +656,8 @@ static Slrn_Group_Type *create_group_entry (char *name, unsigned int len, /*{{{*
    g = (Slrn_Group_Type *) slrn_safe_malloc (sizeof (Slrn_Group_Type));
    g->requests = NULL;
    g->requests_loaded = 0;
+   g->pending_marks = NULL;
+   g->pending_next = NULL;
 
    g->group_name = slrn_safe_malloc (len + 1);
    strncpy (g->group_name, name, len);
@@ -907,11 +1102,13 @@ int slrn_group_select_group (void) /*{{{*/
    if ((prefix != 0) || (n == 0))
      n = max_available;
 
+   /* In paged mode, the number of headers is limited below instead. */
    if ((prefix & 1)
-       || ((Slrn_Query_Group_Cutoff > 0)
-	   && (n > (NNTP_Artnum_Type)Slrn_Query_Group_Cutoff))
-       || ((Slrn_Query_Group_Cutoff < 0)
-	   && (n > (NNTP_Artnum_Type)(-Slrn_Query_Group_Cutoff))))
+       || ((Slrn_Header_Page_Size <= 0)
+	   && (((Slrn_Query_Group_Cutoff > 0)
+		&& (n > (NNTP_Artnum_Type)Slrn_Query_Group_Cutoff))
+	       || ((Slrn_Query_Group_Cutoff < 0)
+		   && (n > (NNTP_Artnum_Type)(-Slrn_Query_Group_Cutoff))))))
      {
 	char int_prompt_buf[512];
 	if ((prefix & 1) || (Slrn_Query_Group_Cutoff > 0))
@@ -953,6 +1150,11 @@ int slrn_group_select_group (void) /*{{{*/
    else if ((0 == prefix) && (Slrn_Group_Current_Group->unread != 0))
      n = 0;
 
+   /* In paged mode, only an explicit answer to the prompt is not capped. */
+   if ((Slrn_Header_Page_Size > 0) && (0 == (prefix & 1))
+       && (n > (NNTP_Artnum_Type) Slrn_Header_Page_Size))
+     n = Slrn_Header_Page_Size;
+
    ret = slrn_select_article_mode (Slrn_Group_Current_Group, n,
 				   ((prefix & 2) == 0));
 
@@ -2741,6 +2943,8 @@ int slrn_write_newsrc (int auto_save) /*{{{*/
 
    slrn_init_hangup_signals (0);
 
+   slrn_flush_pending_marks ();
+
    if (Slrn_Groups_Dirty == 0)
      {
 	slrn_init_hangup_signals (1);
@@ -32,6 +32,9 @@ extern void slrn_hide_groups (int);
 extern int slrn_read_newsrc (int);
 extern int slrn_write_newsrc (int);
 extern void slrn_mark_articles_as_read (char *, NNTP_Artnum_Type, NNTP_Artnum_Type);
+extern void slrn_mark_ranges_as_read (Slrn_Range_Type *);
+extern void slrn_mark_article_as_read_later (char *, unsigned int, NNTP_Artnum_Type);
+extern void slrn_flush_pending_marks (void);
 extern int slrn_get_new_groups (int);
 extern void slrn_init_group_mode (void);
 extern void slrn_get_group_descriptions (void);
@@ -76,6 +79,10 @@ typedef struct Slrn_Group_Type
 
    NNTP_Artnum_Type unread;
    char *descript;		       /* description of the group -- malloced, could be NULL */
+
+   Slrn_Range_Type *pending_marks;     /* articles to be marked read by
+					* slrn_flush_pending_marks */
+   struct Slrn_Group_Type *pending_next;
 }
 Slrn_Group_Type;
 
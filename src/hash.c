@@ -51,6 +51,174 @@ unsigned long slrn_compute_hash (unsigned char *s, unsigned char *smax)
    return h;
 }
 
+/*{{{ Interned Message-Ids */
+
+#define MAX_REFS_HASH	16381
+
+static Slrn_Msgid_Type *Refs_Hash_Table [MAX_REFS_HASH];
+
+static Slrn_Msgid_Type *intern_msgid (char *name, unsigned int len) /*{{{*/
+{
+   Slrn_Msgid_Type *m;
+   unsigned long hash;
+   unsigned int hash_index;
+
+   hash = slrn_compute_hash ((unsigned char *) name,
+			     (unsigned char *) name + len);
+   hash_index = hash % MAX_REFS_HASH;
+
+   m = Refs_Hash_Table [hash_index];
+   while (m != NULL)
+     {
+	if ((m->hash == hash) && (m->len == len)
+	    && (0 == strncmp (m->name, name, len)))
+	  {
+	     m->refcount++;
+	     return m;
+	  }
+	m = m->hash_next;
+     }
+
+   m = (Slrn_Msgid_Type *) slrn_safe_malloc (sizeof (Slrn_Msgid_Type) + len);
+   m->hash = hash;
+   m->len = len;
+   m->refcount = 1;
+   memcpy (m->name, name, len);
+   m->name[len] = 0;
+
+   m->hash_next = Refs_Hash_Table [hash_index];
+   Refs_Hash_Table [hash_index] = m;
+   return m;
+}
+
+/*}}}*/
+
+/* Moves *r1p back to the last '>' before it and sets *r0p to the '<' that
+ * starts this Message-Id.  Returns -1 if there is none. */
+static int find_prev_msgid (char *rmin, char **r0p, char **r1p) /*{{{*/
+{
+   char *r0, *r1 = *r1p;
+
+   while ((r1 > rmin) && (*r1 != '>')) r1--;
+   if (r1 == rmin)
+     return -1;
+
+   r0 = r1;
+   while (r0 > rmin)
+     {
+	r0--;
+	if (*r0 == '<')
+	  {
+	     *r0p = r0;
+	     *r1p = r1;
+	     return 0;
+	  }
+     }
+   return -1;
+}
+
+/*}}}*/
+
+/* Splits a References header into its Message-Ids and interns them.  Like
+ * the threading code always did, it looks for the ids from the end of the
+ * line.  Returns a malloced array in the order of the header (NULL if
+ * there are no ids) and sets *nump to its length. */
+Slrn_Msgid_Type **slrn_intern_references (char *refs, unsigned int *nump) /*{{{*/
+{
+   Slrn_Msgid_Type **ids;
+   char *r0, *r1, *end;
+   unsigned int n;
+
+   *nump = 0;
+   if (refs == NULL)
+     return NULL;
+
+   end = refs + strlen (refs);
+   n = 0;
+   r1 = end;
+   while (0 == find_prev_msgid (refs, &r0, &r1))
+     {
+	n++;
+	r1 = r0;
+     }
+   if (n == 0)
+     return NULL;
+
+   ids = (Slrn_Msgid_Type **) slrn_safe_malloc (n * sizeof (Slrn_Msgid_Type *));
+   *nump = n;
+
+   r1 = end;
+   while (n && (0 == find_prev_msgid (refs, &r0, &r1)))
+     {
+	ids[--n] = intern_msgid (r0, (unsigned int) ((r1 + 1) - r0));
+	r1 = r0;
+     }
+   return ids;
+}
+
+/*}}}*/
+
+void slrn_free_references (Slrn_Msgid_Type **ids, unsigned int n) /*{{{*/
+{
+   unsigned int i;
+
+   if (ids == NULL)
+     return;
+
+   for (i = 0; i < n; i++)
+     {
+	Slrn_Msgid_Type *m = ids[i], **mp;
+
+	if (--m->refcount)
+	  continue;
+
+	mp = &Refs_Hash_Table [m->hash % MAX_REFS_HASH];
+	while (*mp != m)
+	  mp = &(*mp)->hash_next;
+	*mp = m->hash_next;
+	slrn_free ((char *) m);
+     }
+   slrn_free ((char *) ids);
+}
+
+/*}}}*/
+
+/* Returns the ids separated by spaces, in a buffer that is reused by the
+ * next call. */
+char *slrn_references_string (Slrn_Msgid_Type **ids, unsigned int n) /*{{{*/
+{
+   static char *buf;
+   static unsigned int buf_len;
+   unsigned int i, len;
+   char *b;
+
+   len = 1;
+   for (i = 0; i < n; i++)
+     len += ids[i]->len + 1;
+
+   if (len > buf_len)
+     {
+	if (NULL == (b = slrn_realloc (buf, len, 1)))
+	  return "";
+	buf = b;
+	buf_len = len;
+     }
+
+   b = buf;
+   for (i = 0; i < n; i++)
+     {
+	if (i) *b++ = ' ';
+	memcpy (b, ids[i]->name, ids[i]->len);
+	b += ids[i]->len;
+     }
+   *b = 0;
+   return buf;
+}
+
+/*}}}*/
+
+/*}}}*/
+
 #if SLRN_HAS_MSGID_CACHE
 typedef struct Msg_Id_Cache_Type
 {
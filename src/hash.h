@@ -17,8 +17,29 @@
  with this program; if not, write to the Free Software Foundation, Inc.,
  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
+#ifndef _SLRN_HASH_H
+#define _SLRN_HASH_H
+
 extern unsigned long slrn_compute_hash (unsigned char *, unsigned char *);
 
 #if SLRN_HAS_MSGID_CACHE
 extern char *slrn_is_msgid_cached (char *, char *, int);
 #endif
+
+/* The Message-Ids of References headers are interned, so that all headers
+ * of a thread share the ids of their common ancestors. */
+typedef struct Slrn_Msgid_Type
+{
+   struct Slrn_Msgid_Type *hash_next;
+   unsigned long hash;		       /* slrn_compute_hash of name */
+   unsigned int refcount;
+   unsigned int len;
+   char name[1];		       /* len bytes, plus the terminating 0 */
+}
+Slrn_Msgid_Type;
+
+extern Slrn_Msgid_Type **slrn_intern_references (char *, unsigned int *);
+extern void slrn_free_references (Slrn_Msgid_Type **, unsigned int);
+extern char *slrn_references_string (Slrn_Msgid_Type **, unsigned int);
+
+#endif				       /* _SLRN_HASH_H */
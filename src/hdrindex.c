@@ -0,0 +1,551 @@
+/* -*- mode: C; mode: fold; -*- */
+/*
+ This file is part of SLRN.
+
+ Copyright (c) 1994, 1999, 2007-2016 John E. Davis <jed@jedsoft.org>
+ Copyright (c) 2001-2006 Thomas Schultz <tststs@gmx.de>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the Free
+ Software Foundation; either version 2 of the License, or (at your option)
+ any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ more details.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/* This file implements an index of the Subject and From headers of the
+ * current group that makes subject and author searches fast in large
+ * groups.  For every trigram (three consecutive characters), it lists the
+ * headers that contain it.  A search first intersects the lists of the
+ * trigrams of the pattern; only the headers that contain all of them are
+ * checked with SLsearch or the regular expression.
+ *
+ * The searches are caseless, so the characters are case-folded before they
+ * are indexed.  Only characters that fold to ASCII are indexed; trigrams
+ * with other characters are left out of both the index and the query, which
+ * makes the narrowing less effective but never wrong.
+ *
+ * The index is built by the first search in a group and extended by later
+ * ones when headers have been added.  Headers are identified by a number
+ * (h->search_id) instead of a pointer, so a header that gets freed only
+ * leaves a stale number behind.  The lists are delta-encoded with seven
+ * bits per byte to keep the index small.
+ */
+#include "config.h"
+#include "slrnfeat.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#include <slang.h>
+#include "jdmacros.h"
+
+#include "slrn.h"
+#include "util.h"
+#include "strutil.h"
+#include "group.h"
+#include "art.h"
+#include "hdrindex.h"
+#include "common.h"
+
+#define NUM_FIELDS		2
+#define TRIGRAM_TABLE_SIZE	16381
+/* More keys hardly narrow the search further */
+#define MAX_QUERY_KEYS		32
+
+typedef struct Posting_Type
+{
+   struct Posting_Type *next;	       /* in the hash chain */
+   unsigned long key;
+   unsigned char *buf;		       /* malloced, delta-encoded ids */
+   unsigned int len, max;
+   unsigned int last_id;
+}
+Posting_Type;
+
+static Posting_Type *Trigram_Table [NUM_FIELDS][TRIGRAM_TABLE_SIZE];
+static unsigned int Next_Search_Id = 1;
+static int Index_Failed;
+
+/* The current query.  Candidate_Counts[id] is the number of its keys that
+ * the header with that id contains.  It is valid for the ids below
+ * Counts_Id_Limit. */
+static int Query_Field;
+static unsigned long Query_Keys [MAX_QUERY_KEYS];
+static unsigned int Num_Query_Keys;
+static unsigned char *Candidate_Counts;
+static unsigned int Max_Candidate_Counts;
+static unsigned int Counts_Id_Limit;
+
+/* Returns the case-folded character at *sp (as an ASCII uppercase letter)
+ * or 0 if it does not fold to ASCII, and advances *sp.  A character is
+ * folded to ASCII if either its upper or its lower case is ASCII; this way,
+ * two characters that are equal in a caseless search fold to the same
+ * character no matter which case the search compares. */
+static int fold_next (unsigned char **sp, unsigned char *smax) /*{{{*/
+{
+   unsigned char *s = *sp;
+   unsigned int ch;
+
+#if SLANG_VERSION >= 20000
+   if (Slrn_UTF8_Mode && (*s & 0x80))
+     {
+	SLwchar_Type wch, up, low;
+	unsigned int nconsumed;
+
+	if (NULL == (*sp = SLutf8_decode (s, smax, &wch, &nconsumed)))
+	  {
+	     *sp = s + 1;
+	     return 0;
+	  }
+	up = SLwchar_toupper (wch);
+	if (up < 0x80)
+	  return (int) up;
+	low = SLwchar_tolower (wch);
+	if (low < 0x80)
+	  return (int) UPPER_CASE (low);
+	return 0;
+     }
+#else
+   (void) smax;
+#endif
+
+   *sp = s + 1;
+   ch = (unsigned char) UPPER_CASE (*s);
+   if (ch < 0x80)
+     return (int) ch;
+   ch = (unsigned char) LOWER_CASE (*s);
+   if (ch < 0x80)
+     return (int) UPPER_CASE (ch);
+   return 0;
+}
+
+/*}}}*/
+
+static unsigned long make_key (int c0, int c1, int c2) /*{{{*/
+{
+   return ((unsigned long) c0 << 14) | ((unsigned long) c1 << 7) | (unsigned long) c2;
+}
+
+/*}}}*/
+
+static Posting_Type *find_posting (int field, unsigned long key) /*{{{*/
+{
+   Posting_Type *p = Trigram_Table [field][key % TRIGRAM_TABLE_SIZE];
+
+   while ((p != NULL) && (p->key != key))
+     p = p->next;
+   return p;
+}
+
+/*}}}*/
+
+static void free_postings (void) /*{{{*/
+{
+   unsigned int field, i;
+
+   for (field = 0; field < NUM_FIELDS; field++)
+     {
+	for (i = 0; i < TRIGRAM_TABLE_SIZE; i++)
+	  {
+	     Posting_Type *p = Trigram_Table [field][i];
+
+	     while (p != NULL)
+	       {
+		  Posting_Type *next = p->next;
+		  slrn_free ((char *) p->buf);
+		  slrn_free ((char *) p);
+		  p = next;
+	       }
+	     Trigram_Table [field][i] = NULL;
+	  }
+     }
+
+   slrn_free ((char *) Candidate_Counts);
+   Candidate_Counts = NULL;
+   Max_Candidate_Counts = Counts_Id_Limit = 0;
+   Num_Query_Keys = 0;
+}
+
+/*}}}*/
+
+static int add_posting (int field, unsigned long key, unsigned int id) /*{{{*/
+{
+   Posting_Type *p;
+   unsigned int delta;
+
+   if (NULL == (p = find_posting (field, key)))
+     {
+	unsigned int i = key % TRIGRAM_TABLE_SIZE;
+
+	if (NULL == (p = (Posting_Type *) slrn_malloc (sizeof (Posting_Type), 1, 0)))
+	  return -1;
+	p->key = key;
+	p->next = Trigram_Table [field][i];
+	Trigram_Table [field][i] = p;
+     }
+
+   /* A trigram may occur more than once in a header */
+   if (p->last_id == id)
+     return 0;
+
+   /* An id takes at most five bytes */
+   if (p->len + 5 > p->max)
+     {
+	unsigned int max = (p->max == 0) ? 8 : 2 * p->max;
+	unsigned char *buf;
+
+	if (NULL == (buf = (unsigned char *) slrn_realloc ((char *) p->buf, max, 0)))
+	  return -1;
+	p->buf = buf;
+	p->max = max;
+     }
+
+   delta = id - p->last_id;
+   while (delta >= 0x80)
+     {
+	p->buf[p->len++] = (unsigned char) (0x80 | (delta & 0x7F));
+	delta >>= 7;
+     }
+   p->buf[p->len++] = (unsigned char) delta;
+   p->last_id = id;
+   return 0;
+}
+
+/*}}}*/
+
+static int add_string (int field, char *str, unsigned int id) /*{{{*/
+{
+   unsigned char *s, *smax;
+   int c0 = 0, c1 = 0;
+
+   if (str == NULL)
+     return 0;
+
+   s = (unsigned char *) str;
+   smax = s + strlen (str);
+   while (s < smax)
+     {
+	int c = fold_next (&s, smax);
+
+	if (c && c0 && c1
+	    && (-1 == add_posting (field, make_key (c0, c1, c), id)))
+	  return -1;
+	c0 = c1;
+	c1 = c;
+     }
+   return 0;
+}
+
+/*}}}*/
+
+/* Indexes the headers that are not indexed yet. */
+static void update_index (void) /*{{{*/
+{
+   Slrn_Header_Type *h;
+
+   for (h = Slrn_First_Header; h != NULL; h = h->next)
+     {
+	if (h->search_id != 0)
+	  continue;
+
+	h->search_id = Next_Search_Id++;
+	if ((-1 == add_string (SLRN_HDR_INDEX_SUBJECT, h->subject, h->search_id))
+	    || (-1 == add_string (SLRN_HDR_INDEX_FROM, h->from, h->search_id)))
+	  {
+	     /* Searching still works, only slower. */
+	     free_postings ();
+	     Index_Failed = 1;
+	     return;
+	  }
+     }
+}
+
+/*}}}*/
+
+/*{{{ Queries */
+
+static void add_query_key (unsigned long key) /*{{{*/
+{
+   unsigned int i;
+
+   for (i = 0; i < Num_Query_Keys; i++)
+     {
+	if (Query_Keys[i] == key)
+	  return;
+     }
+   if (Num_Query_Keys < MAX_QUERY_KEYS)
+     Query_Keys[Num_Query_Keys++] = key;
+}
+
+/*}}}*/
+
+static void add_query_string (unsigned char *s, unsigned int len) /*{{{*/
+{
+   unsigned char *smax = s + len;
+   int c0 = 0, c1 = 0;
+
+   while (s < smax)
+     {
+	int c = fold_next (&s, smax);
+
+	if (c && c0 && c1)
+	  add_query_key (make_key (c0, c1, c));
+	c0 = c1;
+	c1 = c;
+     }
+}
+
+/*}}}*/
+
+/* Removes the last (possibly multibyte) character from run. */
+static unsigned int drop_last_char (unsigned char *run, unsigned int len) /*{{{*/
+{
+   while ((len > 0) && ((run[len - 1] & 0xC0) == 0x80))
+     len--;
+   if (len > 0)
+     len--;
+   return len;
+}
+
+/*}}}*/
+
+/* Adds the keys of the text that every match of a regular expression must
+ * contain.  To be on the safe side, only plain characters outside of
+ * brackets and groups are used, except those that are followed by a
+ * quantifier.  Patterns with alternatives are not narrowed at all. */
+static void add_query_regexp (char *pat) /*{{{*/
+{
+   unsigned char run [256];
+   unsigned char *p;
+   unsigned int len = 0;
+   int depth = 0;
+
+   if (NULL != slrn_strbyte (pat, '|'))
+     return;
+
+   p = (unsigned char *) pat;
+   while (*p != 0)
+     {
+	unsigned char ch = *p++;
+	int literal = 0;
+
+	switch (ch)
+	  {
+	   case '*':
+	   case '?':
+	     len = drop_last_char (run, len);
+	     break;
+
+	   case '{':
+	     len = drop_last_char (run, len);
+	     while ((*p != 0) && (*p != '}'))
+	       p++;
+	     if (*p != 0) p++;
+	     break;
+
+	   case '[':
+	     if (*p == '^') p++;
+	     if (*p == ']') p++;
+	     while ((*p != 0) && (*p != ']'))
+	       p++;
+	     if (*p != 0) p++;
+	     break;
+
+	   case '(':
+	     depth++;
+	     break;
+
+	   case ')':
+	     if (depth) depth--;
+	     break;
+
+	   case '+': case '.': case '^': case '$': case '}':
+	     break;
+
+	   case '\\':
+	     ch = *p;
+	     if (ch == 0)
+	       break;
+	     p++;
+	     if (ch == '(')
+	       depth++;
+	     else if (ch == ')')
+	       {
+		  if (depth) depth--;
+	       }
+	     else if (ch == '{')
+	       {
+		  len = drop_last_char (run, len);
+		  while ((*p != 0) && ((*p != '\\') || (p[1] != '}')))
+		    p++;
+		  if (*p != 0) p += 2;
+	       }
+	     else if ((ch < 0x80) && (isalnum (ch) || (ch == '<') || (ch == '>')))
+	       ;
+	     else
+	       literal = 1;
+	     break;
+
+	   default:
+	     literal = 1;
+	     break;
+	  }
+
+	if (literal && (depth == 0) && (len < sizeof (run)))
+	  {
+	     run[len++] = ch;
+	     continue;
+	  }
+
+	add_query_string (run, len);
+	len = 0;
+	if (literal && (depth == 0))
+	  run[len++] = ch;
+     }
+   add_query_string (run, len);
+}
+
+/*}}}*/
+
+static void compute_candidates (void) /*{{{*/
+{
+   unsigned int i;
+
+   if (Next_Search_Id > Max_Candidate_Counts)
+     {
+	unsigned int max = Next_Search_Id + Next_Search_Id / 4;
+	unsigned char *counts;
+
+	counts = (unsigned char *) slrn_realloc ((char *) Candidate_Counts, max, 0);
+	if (counts == NULL)
+	  {
+	     Num_Query_Keys = 0;
+	     return;
+	  }
+	Candidate_Counts = counts;
+	Max_Candidate_Counts = max;
+     }
+
+   memset ((char *) Candidate_Counts, 0, Next_Search_Id);
+   Counts_Id_Limit = Next_Search_Id;
+
+   for (i = 0; i < Num_Query_Keys; i++)
+     {
+	Posting_Type *p = find_posting (Query_Field, Query_Keys[i]);
+	unsigned char *b, *bmax;
+	unsigned int id = 0;
+
+	if (p == NULL)
+	  continue;
+
+	b = p->buf;
+	bmax = b + p->len;
+	while (b < bmax)
+	  {
+	     unsigned int delta = 0, shift = 0;
+
+	     while (*b & 0x80)
+	       {
+		  delta |= (unsigned int) (*b++ & 0x7F) << shift;
+		  shift += 7;
+	       }
+	     delta |= (unsigned int) *b++ << shift;
+	     id += delta;
+	     Candidate_Counts[id]++;
+	  }
+     }
+}
+
+/*}}}*/
+
+void slrn_hdr_index_search (int field, char *str, int is_regexp) /*{{{*/
+{
+   unsigned long old_keys [MAX_QUERY_KEYS];
+   unsigned int i, num_old_keys = Num_Query_Keys;
+   int same_query;
+
+   memcpy ((char *) old_keys, (char *) Query_Keys, num_old_keys * sizeof (unsigned long));
+
+   Num_Query_Keys = 0;
+   if (Index_Failed || (str == NULL))
+     return;
+
+   if (is_regexp)
+     add_query_regexp (str);
+   else
+     add_query_string ((unsigned char *) str, strlen (str));
+
+   /* Too short to narrow the search */
+   if (Num_Query_Keys == 0)
+     return;
+
+   update_index ();
+   if (Index_Failed)
+     {
+	Num_Query_Keys = 0;
+	return;
+     }
+
+   /* Searching for the same thing again (e.g. the next match) does not
+    * have to intersect the lists again. */
+   same_query = ((field == Query_Field) && (Num_Query_Keys == num_old_keys)
+		 && (Counts_Id_Limit == Next_Search_Id));
+   for (i = 0; same_query && (i < Num_Query_Keys); i++)
+     {
+	unsigned int j = 0;
+	while ((j < num_old_keys) && (old_keys[j] != Query_Keys[i]))
+	  j++;
+	same_query = (j < num_old_keys);
+     }
+
+   Query_Field = field;
+   if (0 == same_query)
+     compute_candidates ();
+}
+
+/*}}}*/
+
+int slrn_hdr_index_match (Slrn_Header_Type *h) /*{{{*/
+{
+   unsigned int id = h->search_id;
+
+   if ((Num_Query_Keys == 0) || (id == 0) || (id >= Counts_Id_Limit))
+     return 1;
+
+   return (Candidate_Counts[id] == Num_Query_Keys);
+}
+
+/*}}}*/
+
+/*}}}*/
+
+void slrn_hdr_index_forget (Slrn_Header_Type *h) /*{{{*/
+{
+   /* The header gets a new id when it is indexed again; the old one is
+    * not used by any header any longer. */
+   h->search_id = 0;
+}
+
+/*}}}*/
+
+void slrn_hdr_index_free (void) /*{{{*/
+{
+   free_postings ();
+   Next_Search_Id = 1;
+   Index_Failed = 0;
+}
+
+/*}}}*/
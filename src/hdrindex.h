@@ -0,0 +1,43 @@
+/*
+ This file is part of SLRN.
+
+ Copyright (c) 1994, 1999, 2007-2016 John E. Davis <jed@jedsoft.org>
+ Copyright (c) 2001-2006 Thomas Schultz <tststs@gmx.de>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the Free
+ Software Foundation; either version 2 of the License, or (at your option)
+ any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ more details.
+
+ You should have received a copy of the GNU General Public License along
+ with this program; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+#ifndef _SLRN_HDRINDEX_H
+#define _SLRN_HDRINDEX_H
+
+/* The headers that can be searched with the index */
+#define SLRN_HDR_INDEX_SUBJECT	0
+#define SLRN_HDR_INDEX_FROM	1
+
+/* Prepares a caseless search for a string (is_regexp == 0) or a regular
+ * expression (is_regexp != 0) in the given header of the current group.
+ * The index is built or updated as needed. */
+extern void slrn_hdr_index_search (int, char *, int);
+
+/* Returns 0 if the header cannot match the search prepared by
+ * slrn_hdr_index_search.  Otherwise, it still has to be checked. */
+extern int slrn_hdr_index_match (Slrn_Header_Type *);
+
+/* Must be called when the subject or author of a header changes. */
+extern void slrn_hdr_index_forget (Slrn_Header_Type *);
+
+/* Frees the index; called when the headers of the group are freed. */
+extern void slrn_hdr_index_free (void);
+
+#endif				       /* _SLRN_HDRINDEX_H */
@@ -147,12 +147,14 @@ static char *Art_Help[] =
    N_("  m                  (Un-)mark article body for download by slrnpull."),
 #endif
    N_("  v                  Show which scorefile rules matched the current article."),
-   N_("  * The following five commands query the server if necessary:"),
+   N_("  * The following seven commands query the server if necessary:"),
    N_("  ESC l              Locate article by its Message-ID."),
    N_("  ESC Ctrl-P         Find all children of current article."),
    N_("  ESC p              Find parent article."),
    N_("      ESC 1 ESC p    Reconstruct thread (slow when run on large threads)."),
    N_("      ESC 2 ESC p    Reconstruct thread (faster, may not find all articles)."),
+   N_("  ESC x              Search any header line on the server and tag matches."),
+   N_("  ESC o              Retrieve older headers (see header_page_size)."),
    N_("  ;                  Set a mark at the current article."),
    N_("  ,                  Return to previously marked article."),
    N_("  #                  Numerically tag article (for saving / decoding)."),
@@ -40,6 +40,7 @@
 #include "slrn.h"
 #include "group.h"
 #include "art.h"
+#include "hdrindex.h"
 #include "misc.h"
 #include "startup.h"
 #include "util.h"
@@ -1182,7 +1183,7 @@ static int get_grouplens_score (void)
 
 /*{{{ Header Searching */
 
-static int re_header_search (char *pat, unsigned int offset, int dir) /*{{{*/
+static int re_header_search (char *pat, int field, int dir) /*{{{*/
 {
    SLRegexp_Type *re;
    Slrn_Header_Type *h = Slrn_Current_Header;
@@ -1193,10 +1194,14 @@ static int re_header_search (char *pat, unsigned int offset, int dir) /*{{{*/
        || (NULL == (re = slrn_compile_regexp_pattern (pat))))
      return 0;
 
+   slrn_hdr_index_search (field, pat, 1);
+
    status = 0;
    while (h != NULL)
      {
-	if (NULL != slrn_regexp_match (re, *(char **) ((char *)h + offset)))
+	if (slrn_hdr_index_match (h)
+	    && (NULL != slrn_regexp_match (re, (field == SLRN_HDR_INDEX_SUBJECT)
+					   ? h->subject : h->from)))
 	  {
 	     slrn_goto_header (h, 0);
 	     status = 1;
@@ -1216,26 +1221,22 @@ static int re_header_search (char *pat, unsigned int offset, int dir) /*{{{*/
 
 static int re_subject_search_forward (char *pat)
 {
-   Slrn_Header_Type h;
-   return re_header_search (pat, (char *) &h.subject - (char *)&h, 1);
+   return re_header_search (pat, SLRN_HDR_INDEX_SUBJECT, 1);
 }
 
 static int re_subject_search_backward (char *pat)
 {
-   Slrn_Header_Type h;
-   return re_header_search (pat, (char *) &h.subject - (char *)&h, -1);
+   return re_header_search (pat, SLRN_HDR_INDEX_SUBJECT, -1);
 }
 
 static int re_author_search_forward (char *pat)
 {
-   Slrn_Header_Type h;
-   return re_header_search (pat, (char *) &h.from - (char *)&h, 1);
+   return re_header_search (pat, SLRN_HDR_INDEX_FROM, 1);
 }
 
 static int re_author_search_backward (char *pat)
 {
-   Slrn_Header_Type h;
-   return re_header_search (pat, (char *) &h.from - (char *)&h, -1);
+   return re_header_search (pat, SLRN_HDR_INDEX_FROM, -1);
 }
 /*}}}*/
 
@@ -757,248 +757,301 @@ static void rfc1522_decode_headers (Slrn_Article_Type *a)/*{{{*/
 
 /*}}}*/
 
-static void decode_mime_base64 (Slrn_Article_Type *a)/*{{{*/
+/* The body decoders below work line by line.  Decoded text is collected in
+ * a Decode_Buffer_Type and cut into new article lines whenever a newline
+ * shows up, so the body never needs to be copied into one big string.
+ */
+typedef struct
 {
-   Slrn_Article_Line_Type *l;
-   Slrn_Article_Line_Type *body_start, *next;
-   char *buf_src, *buf_dest, *buf_pos, *buf_end;
-   char *base;
-   int keep_nl = 1;
-   int len;
+   char *buf;
+   unsigned int len;
+   unsigned int max;
+}
+Decode_Buffer_Type;
 
-   if (a == NULL) return;
+static int reserve_decode_buffer (Decode_Buffer_Type *d, unsigned int n)/*{{{*/
+{
+   char *b;
+   unsigned int max;
 
-   l = a->lines;
+   if (d->len + n < d->max)
+     return 0;
 
-   /* skip header and separator */
-   while ((l != NULL) && ((l->flags & HEADER_LINE) || l->buf[0] == '\0'))
-     l = l->next;
+   max = d->max;
+   if (max == 0) max = 256;
+   while (max <= d->len + n)
+     max *= 2;
 
-   if (l == NULL) return;
+   if (NULL == (b = slrn_realloc (d->buf, max, 1)))
+     return -1;
 
-   body_start = l;
+   d->buf = b;
+   d->max = max;
+   return 0;
+}
 
-   /* let's calculate how much space we need... */
-   len = 0;
-   while (l != NULL)
-     {
-	len += strlen(l->buf);
-	l = l->next;
-     }
+/*}}}*/
 
-   /* get some memory */
-   buf_src = slrn_safe_malloc (len + 1);
-   buf_dest = slrn_safe_malloc (len + 1);
+static Slrn_Article_Line_Type *new_article_line (Slrn_Article_Line_Type *prev,/*{{{*/
+						 char *s, unsigned int len)
+{
+   Slrn_Article_Line_Type *l;
 
-   /* collect all base64 encoded lines into buf_src */
-   l = body_start;
-   buf_pos = buf_src;
-   while (l != NULL)
+   /* strip '\r' if necessary */
+   if (len && (s[len-1] == '\r'))
+     len--;
+
+   l = (Slrn_Article_Line_Type *) slrn_malloc (sizeof(Slrn_Article_Line_Type), 1, 1);
+   if ((l == NULL)
+       || (NULL == (l->buf = slrn_malloc (len + 1, 0, 1))))
      {
-	strcpy (buf_pos, l->buf); /* safe */
-	buf_pos += strlen(l->buf);
-	l = l->next;
+	slrn_free ((char *) l);      /* NULL ok */
+	return NULL;
      }
+   memcpy (l->buf, s, len);
+   l->buf[len] = 0;
+
+   l->prev = prev;
+   l->next = prev->next;
+   if (l->next != NULL)
+     l->next->prev = l;
+   prev->next = l;
+   return l;
+}
+
+/*}}}*/
 
-   /* put decoded article into buf_dest */
-   buf_pos = decode_base64 (buf_dest, buf_src, buf_src+len, keep_nl, 1);
-   *buf_pos = '\0';
+/* Turns all complete lines in the buffer into article lines following *lp
+ * and moves the incomplete rest to the front.  If flush is non-zero, the
+ * rest is added as well.
+ */
+static int emit_decoded_lines (Decode_Buffer_Type *d, Slrn_Article_Line_Type **lp,/*{{{*/
+			       int flush)
+{
+   char *p, *pmax, *nl;
+
+   p = d->buf;
+   pmax = p + d->len;
 
-   if (a->mime.charset == NULL)
+   while ((p < pmax)
+	  && (NULL != (nl = (char *) memchr (p, '\n', (size_t) (pmax - p)))))
      {
-	buf_pos = buf_dest;
-	while (*buf_pos)
-	  {
-	     if (*buf_pos & 0x80) *buf_pos = '?';
-	     buf_pos++;
-	  }
+	if (NULL == (*lp = new_article_line (*lp, p, (unsigned int) (nl - p))))
+	  return -1;
+	p = nl + 1;
      }
 
-   l = body_start;
-   body_start = body_start->prev;
-
-   /* free old body */
-   while (l != NULL)
+   if (flush && (p < pmax))
      {
-	slrn_free(l->buf);
-	next = l->next;
-	slrn_free((char *)l);
-	l = next;
+	if (NULL == (*lp = new_article_line (*lp, p, (unsigned int) (pmax - p))))
+	  return -1;
+	p = pmax;
      }
-   body_start->next = NULL;
 
-   a->is_modified = 1;
-   a->mime.was_modified = 1;
+   d->len = (unsigned int) (pmax - p);
+   if (d->len && (p != d->buf))
+     memmove (d->buf, p, d->len);
+   return 0;
+}
 
-   l = body_start;
-   base = buf_dest;
-   buf_pos = buf_dest;
-   buf_end = buf_dest + strlen (buf_dest);
-   /* put decoded article back into article structure */
+/*}}}*/
 
-   while (buf_dest < buf_end)
-     {
-	if (NULL == (buf_pos = slrn_strbyte(buf_dest, '\n')))
-	  buf_pos = buf_end;
+typedef struct
+{
+   unsigned long bits;		       /* pending sextets */
+   unsigned int num_bits;	       /* in units of sextets: 0-3 */
+   int done;			       /* seen padding */
+   int strip_8bit;
+}
+Base64_State_Type;
 
-	len = buf_pos - buf_dest;
+#define PUT_B64_CHAR(d,c,strip) \
+   { unsigned char _ch = (unsigned char) (c); \
+     if ((_ch == 0) || ((_ch & 0x80) && (strip))) _ch = '?'; \
+     *(d)++ = (char) _ch; }
 
-	next = (Slrn_Article_Line_Type *) slrn_malloc(sizeof(Slrn_Article_Line_Type), 1, 1);
-	if ((next == NULL)
-	    || (NULL == (next->buf = slrn_malloc(sizeof(char) * len + 1, 0, 1))))
+/* Decodes src..srcmax into dest and returns the end of the decoded text.
+ * Characters outside of the base64 alphabet are ignored and quadruples may
+ * span several calls.  dest needs room for 3 + 3*(srcmax-src)/4 bytes.
+ */
+static char *decode_base64_chunk (Base64_State_Type *st, char *dest,/*{{{*/
+				  unsigned char *src, unsigned char *srcmax)
+{
+   unsigned long bits = st->bits;
+   unsigned int n = st->num_bits;
+   int strip = st->strip_8bit;
+
+   if (st->done)
+     return dest;
+
+   while (src < srcmax)
+     {
+	int v0, v1, v2, v3;
+	unsigned char ch;
+
+	/* Fast path: four valid characters at a quadruple boundary */
+	while ((n == 0) && (src + 4 <= srcmax)
+	       && (0 == ((src[0] | src[1] | src[2] | src[3]) & 0x80))
+	       && (0 <= (v0 = Index_64[src[0]]))
+	       && (0 <= (v1 = Index_64[src[1]]))
+	       && (0 <= (v2 = Index_64[src[2]]))
+	       && (0 <= (v3 = Index_64[src[3]])))
 	  {
-	     slrn_free ((char *) next);/* NULL ok */
-	     goto return_error;
+	     bits = ((unsigned long) v0 << 18) | ((unsigned long) v1 << 12)
+	       | ((unsigned long) v2 << 6) | (unsigned long) v3;
+	     PUT_B64_CHAR(dest, bits >> 16, strip);
+	     PUT_B64_CHAR(dest, bits >> 8, strip);
+	     PUT_B64_CHAR(dest, bits, strip);
+	     src += 4;
 	  }
-	next->next = NULL; /* Unnecessary since slrn_malloc as used
-			    * above will guarantee that next->next is NULL.
-			    */
-	next->prev = l;
-	l->next = next;
-	l = next;
-
-	strncpy(l->buf, buf_dest, len);
-	/* terminate string and strip '\r' if necessary */
-	if (len && (l->buf[len-1] == '\r'))
-	  len--;
 
-	l->buf[len] = 0;
+	if (src >= srcmax)
+	  break;
 
-	buf_dest = buf_pos + 1;
-     }
+	ch = *src++;
+	if ((ch & 0x80) || (-1 == (v0 = Index_64[ch])))
+	  {
+	     if (ch != '=')
+	       continue;
 
-   /* drop */
+	     if (n == 2)
+	       PUT_B64_CHAR(dest, bits >> 4, strip)
+	     else if (n == 3)
+	       {
+		  PUT_B64_CHAR(dest, bits >> 10, strip);
+		  PUT_B64_CHAR(dest, bits >> 2, strip);
+	       }
+	     st->done = 1;
+	     n = 0;
+	     break;
+	  }
 
-return_error:
+	bits = (bits << 6) | (unsigned long) v0;
+	if (++n == 4)
+	  {
+	     PUT_B64_CHAR(dest, bits >> 16, strip);
+	     PUT_B64_CHAR(dest, bits >> 8, strip);
+	     PUT_B64_CHAR(dest, bits, strip);
+	     n = 0;
+	     bits = 0;
+	  }
+     }
 
-   slrn_free(buf_src);
-   slrn_free(base);
+   st->bits = bits;
+   st->num_bits = n;
+   return dest;
 }
 
 /*}}}*/
 
-/* This function checks if the last character on curr_line is an = and
- * if it is, then it merges curr_line and curr_line->next. See RFC1341,
- * section 5.1 (Quoted-Printable Content-Transfer-Encoding) rule #5.
- * [csp@ohm.york.ac.uk]
- */
-static int merge_if_soft_linebreak (Slrn_Article_Line_Type *curr_line)/*{{{*/
+static void decode_mime_base64 (Slrn_Article_Type *a)/*{{{*/
 {
-   Slrn_Article_Line_Type *next_line;
-   char *b;
+   Slrn_Article_Line_Type *l, *next, *last;
+   Decode_Buffer_Type d;
+   Base64_State_Type st;
 
-   while ((next_line = curr_line->next) != NULL)
-     {
-	unsigned int len;
+   if (a == NULL) return;
 
-	b = curr_line->buf;
-	len = (unsigned int) (slrn_bskip_whitespace (b) - b);
-	if (len == 0) return 0;
+   l = a->lines;
 
-	len--;
-	if (b[len] != '=') return 0;
+   /* skip header and separator */
+   while ((l != NULL) && ((l->flags & HEADER_LINE) || l->buf[0] == '\0'))
+     l = l->next;
 
-	/* Remove the excess = character... */
-	b[len] = '\0';
+   if ((l == NULL) || (l->prev == NULL)) return;
 
-	if (NULL == (b = (char *) SLrealloc (b, 1 + len + strlen (next_line->buf))))
-	  return -1;
+   /* detach the encoded body; decoded lines get appended to last */
+   last = l->prev;
+   last->next = NULL;
 
-	curr_line->buf = b;
+   a->is_modified = 1;
+   a->mime.was_modified = 1;
 
-	strcpy (b + len, next_line->buf); /* safe */
+   memset ((char *) &d, 0, sizeof (Decode_Buffer_Type));
+   memset ((char *) &st, 0, sizeof (Base64_State_Type));
+   st.strip_8bit = (a->mime.charset == NULL);
 
-	/* Unlink next_line from the linked list of lines in the article... */
-	curr_line->next = next_line->next;
-	if (next_line->next != NULL)
-	  next_line->next->prev = curr_line;
+   while (l != NULL)
+     {
+	/* After an error, the rest of the body is dropped */
+	if (last != NULL)
+	  {
+	     unsigned int len = strlen (l->buf);
 
-	SLFREE (next_line->buf);
-	SLFREE (next_line);
-     }
+	     if (-1 == reserve_decode_buffer (&d, 3 + (3 * len) / 4))
+	       last = NULL;
+	     else
+	       {
+		  char *end = decode_base64_chunk (&st, d.buf + d.len,
+						   (unsigned char *) l->buf,
+						   (unsigned char *) l->buf + len);
+		  d.len = (unsigned int) (end - d.buf);
+		  (void) emit_decoded_lines (&d, &last, 0);
+	       }
+	  }
 
-   /* In case the last line ends with a soft linebreak: */
-   b = slrn_bskip_whitespace (curr_line->buf);
-   if (b != curr_line->buf)
-     {
-	b--;
-	if (*b == '=')
-	  *b = 0;
+	next = l->next;
+	slrn_free (l->buf);
+	slrn_free ((char *) l);
+	l = next;
      }
 
-   return 0;
+   if (last != NULL)
+     (void) emit_decoded_lines (&d, &last, 1);
+
+   slrn_free (d.buf);
 }
 
 /*}}}*/
 
-static int split_qp_lines (Slrn_Article_Type *a)
+/* Returns a pointer to the = of a soft line break at the end of the line
+ * (followed by optional whitespace), or NULL if there is none.  See RFC1341,
+ * section 5.1 (Quoted-Printable Content-Transfer-Encoding) rule #5.
+ */
+static char *find_soft_linebreak (char *b)/*{{{*/
 {
-   Slrn_Article_Line_Type *line;
-
-   line = a->lines;
+   char *e = slrn_bskip_whitespace (b);
 
-   /* skip header lines */
-   while ((line != NULL)
-	  && (line->flags & HEADER_LINE))
-     line=line->next;
+   if ((e != b) && (e[-1] == '='))
+     return e - 1;
+   return NULL;
+}
 
-   while (line != NULL)
-     {
-	Slrn_Article_Line_Type *new_line, *next;
-	char *p = line->buf;
-	char *buf0, *buf1;
-	char ch;
+/*}}}*/
 
-	next = line->next;
+/* If the decoded line contains newlines, split it into several lines.
+ * Returns the last of them or NULL upon failure.
+ */
+static Slrn_Article_Line_Type *split_qp_line (Slrn_Article_Line_Type *line)/*{{{*/
+{
+   char *p, *b;
 
-	while ((0 != (ch = *p)) && (ch != '\n'))
-	  p++;
+   while (NULL != (p = slrn_strbyte (line->buf, '\n')))
+     {
+	Slrn_Article_Line_Type *new_line;
 
-	if (ch == 0)
-	  {
-	     line = next;
-	     continue;
-	  }
 	*p++ = 0;
+	if (NULL == (new_line = new_article_line (line, p, strlen (p))))
+	  return NULL;
 
-	new_line = (Slrn_Article_Line_Type *) slrn_malloc (sizeof(Slrn_Article_Line_Type), 1, 1);
-	if (new_line == NULL)
-	  return -1;
-
-	if (NULL == (buf1 = slrn_strmalloc (p, 1)))
-	  {
-	     slrn_free ((char *) new_line);
-	     return -1;
-	  }
-
-	if (NULL == (buf0 = slrn_realloc (line->buf, p - line->buf, 1)))
-	  {
-	     slrn_free ((char *) new_line);
-	     slrn_free (buf1);
-	     return -1;
-	  }
-	line->buf = buf0;
-
-	new_line->buf = buf1;
 	new_line->flags = line->flags;
 	if (line->flags & QUOTE_LINE)
 	  new_line->v.quote_level = line->v.quote_level;
 
-	new_line->next = next;
-	new_line->prev = line;
-	if (next != NULL)
-	  next->prev = new_line;
-	line->next = new_line;
+	if (NULL != (b = slrn_realloc (line->buf, p - line->buf, 1)))
+	  line->buf = b;
 
 	line = new_line;
      }
-
-   return 0;
+   return line;
 }
 
+/*}}}*/
+
 static int decode_mime_quoted_printable (Slrn_Article_Type *a)/*{{{*/
 {
-   Slrn_Article_Line_Type *line;
+   Slrn_Article_Line_Type *line, *cont;
+   Decode_Buffer_Type d;
    int keep_nl = 1;
 
    if (a == NULL)
@@ -1010,36 +1063,84 @@ static int decode_mime_quoted_printable (Slrn_Article_Type *a)/*{{{*/
    while ((line != NULL) && (line->flags & HEADER_LINE))
      line = line->next;
 
-   if (line == NULL)
-     return 0;
-
    while (line != NULL)
      {
-	char *b;
+	char *b, *e;
 	unsigned int len;
 
 	b = line->buf;
-	len = (unsigned int) (slrn_bskip_whitespace (b) - b);
-	if (len && (b[len - 1] == '=')
-	    && (line->next != NULL))
+	len = strlen (b);
+	e = find_soft_linebreak (b);
+
+	if ((e == NULL) || (line->next == NULL))
 	  {
-	     (void) merge_if_soft_linebreak (line);
-	     b = line->buf;
-	     len = strlen (b);
+	     /* The usual case: decode the line in place */
+	     char *end = (e != NULL) ? e : b + len;
+
+	     e = decode_quoted_printable (b, b, end, 0, keep_nl, 1);
+	     if (e < b + len)
+	       {
+		  *e = 0;
+		  a->is_modified = 1;
+		  a->mime.was_modified = 1;
+		  if ((NULL != memchr (b, '\n', (size_t) (e - b)))
+		      && (NULL == (line = split_qp_line (line))))
+		    return -1;
+	       }
+	     line = line->next;
+	     continue;
 	  }
 
-	b = decode_quoted_printable (b, b, b + len, 0, keep_nl, 1);
-	if (b < line->buf + len)
+	/* Decode the line and its soft-broken continuations one after the
+	 * other into a buffer that replaces them when done. */
+	memset ((char *) &d, 0, sizeof (Decode_Buffer_Type));
+	cont = line;
+	while (1)
 	  {
-	     *b = 0;
-	     a->is_modified = 1;
-	     a->mime.was_modified = 1;
+	     Slrn_Article_Line_Type *next = cont->next;
+	     char *end = (e != NULL) ? e : b + len;
+	     int is_last = (e == NULL);
+
+	     if (-1 == reserve_decode_buffer (&d, (unsigned int) (end - b) + 1))
+	       {
+		  slrn_free (d.buf);
+		  return -1;
+	       }
+	     e = decode_quoted_printable (d.buf + d.len, b, end, 0, keep_nl, 1);
+	     d.len = (unsigned int) (e - d.buf);
+
+	     if (cont != line)
+	       {
+		  line->next = next;
+		  if (next != NULL)
+		    next->prev = line;
+		  slrn_free (cont->buf);
+		  slrn_free ((char *) cont);
+	       }
+
+	     if (is_last || (next == NULL))
+	       break;
+
+	     cont = next;
+	     b = cont->buf;
+	     len = strlen (b);
+	     e = find_soft_linebreak (b);
 	  }
 
+	d.buf[d.len] = 0;
+	slrn_free (line->buf);
+	if (NULL == (line->buf = slrn_realloc (d.buf, d.len + 1, 0)))
+	  line->buf = d.buf;
+
+	a->is_modified = 1;
+	a->mime.was_modified = 1;
+
+	if (NULL == (line = split_qp_line (line)))
+	  return -1;
 	line = line->next;
      }
 
-   return split_qp_lines (a);
+   return 0;
 }
 
 /*}}}*/
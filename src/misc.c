@@ -510,48 +510,87 @@ void slrn_write_nbytes (char *s, unsigned int n) /*{{{*/
 }
 /*}}}*/
 
-/* generic function to display format strings;
- * cb is called when a descriptor other than '%', '?' or 'g' is encountered */
-void slrn_custom_printf (char *fmt, PRINTF_CB cb, void *param, /*{{{*/
-			 int row, int def_color)
+/*{{{ compiled format strings */
+
+/* Format strings are compiled into a list of operations the first time they
+ * are used, so that drawing a line does not have to parse them again.
+ * The most recently used ones are kept in a small cache; since the format
+ * is looked up by its contents, changing it needs no special care.
+ */
+typedef struct
 {
-   char ch, *cond_end = NULL, *elsepart = NULL;
+#define FORMAT_OP_END		0
+#define FORMAT_OP_LITERAL	1
+#define FORMAT_OP_FIELD		2      /* %x with optional justification */
+#define FORMAT_OP_COLUMN	3      /* %g */
+#define FORMAT_OP_COND		4      /* %?x? -- jump to target if false */
+#define FORMAT_OP_JUMP		5
+   int type;
+   char dscr;
+   int justify;
+   int field_len;
+   char *str;			       /* FORMAT_OP_LITERAL */
+   unsigned int len;
+   unsigned int target;
+}
+Format_Op_Type;
 
-   SLsmg_gotorc (row, 0);
-   slrn_set_color (def_color);
+typedef struct
+{
+   char *fmt;			       /* malloced */
+   Format_Op_Type *ops;		       /* malloced */
+   unsigned int num_ops;
+}
+Compiled_Format_Type;
+
+#define FORMAT_CACHE_SIZE 8
+static Compiled_Format_Type Format_Cache [FORMAT_CACHE_SIZE];
+static unsigned int Format_Cache_Next;
+
+static Format_Op_Type *add_format_op (Compiled_Format_Type *cf, int type) /*{{{*/
+{
+   Format_Op_Type *op = cf->ops + cf->num_ops;
+
+   memset ((char *) op, 0, sizeof (Format_Op_Type));
+   op->type = type;
+   cf->num_ops++;
+   return op;
+}
+
+/*}}}*/
+
+/* Compiles fmt up to the terminating 0 or, inside of a conditional, up to
+ * stop.  Inside of a conditional, literal text always extends up to stop.
+ * Returns NULL if the rest of the format should be ignored.
+ */
+static char *compile_format_span (Compiled_Format_Type *cf, /*{{{*/
+				  char *fmt, char *stop)
+{
+   char ch;
 
    while ((ch = *fmt) != 0)
      {
-	char *s, *smax, *p;
-	int color = def_color;
-	int len = -1, field_len = -1;
-	int justify, spaces = 0;
+	Format_Op_Type *op;
+	int justify, field_len = -1;
 
-	if (fmt == elsepart)
-	  {
-	     fmt = cond_end + 1; /* skip the '?' */
-	     elsepart = cond_end = NULL;
-	     continue;
-	  }
+	if ((stop != NULL) && (fmt >= stop))
+	  return stop;
 
 	if (ch != '%')
 	  {
-	     s = slrn_strbyte (fmt, '%');
-	     if (elsepart == NULL)
+	     char *s = stop;
+
+	     if (s == NULL)
 	       {
-		  if (s == NULL)
-		    {
-		       SLsmg_write_string (fmt);
-		       break;
-		    }
-		  SLsmg_write_nchars (fmt, s - fmt);
-		  fmt = s;
-		  continue;
+		  s = slrn_strbyte (fmt, '%');
+		  if (s == NULL) s = fmt + strlen (fmt);
 	       }
-
-	     SLsmg_write_nchars (fmt, elsepart - fmt);
-	     fmt = cond_end+1;	       /* cond_end is "?...", skip '?' */
-	     elsepart = cond_end = NULL;
+	     op = add_format_op (cf, FORMAT_OP_LITERAL);
+	     op->str = fmt;
+	     op->len = (unsigned int) (s - fmt);
+	     fmt = s;
+	     if (stop != NULL)
+	       return stop;
 	     continue;
 	  }
 
@@ -564,39 +603,39 @@ void slrn_custom_printf (char *fmt, PRINTF_CB cb, void *param, /*{{{*/
 	      *  %?<descriptor>?<opt-str>?
 	      *  %?<descriptor>?<str-if-true>&<str-if-false>?
 	      */
-	     int column;
-	     char *res;
+	     Format_Op_Type *jump;
+	     char *cond_end, *elsepart;
 	     char dscr;
 
 	     dscr = *fmt++;	       /* skip descriptor */
-	     if ((dscr == 0)
+	     if ((stop != NULL) || (dscr == 0)
 		 || (*fmt++ != '?')
 		 || (NULL == (cond_end = slrn_strbyte (fmt, '?'))))
-	       break;  /* Syntax-error */
+	       return NULL;  /* Syntax-error */
 
 	     elsepart = slrn_strbyte (fmt, '&');
 	     if ((elsepart == NULL) || (elsepart > cond_end))
 	       elsepart = cond_end;
 
-	     column = SLsmg_get_column (); /* callback could print something */
-	     res = (cb)(dscr, param, &len, &color);
-	     SLsmg_gotorc (row, column);
+	     op = add_format_op (cf, FORMAT_OP_COND);
+	     op->dscr = dscr;
+	     if (NULL == compile_format_span (cf, fmt, elsepart))
+	       return NULL;
 
-	     if ((res == NULL) || (*res == '\0')
-		 || (((*res == '0') || isspace(*res)) && *(res+1) == '\0'))
+	     if (elsepart != cond_end)
 	       {
-		  /* Condition is false, so skip the <opt-str>,
-		   * or skip to <str-if-false> (elsepart)
-		   */
-		  fmt = elsepart + 1;  /* skip beyond '?' */
-		  if (elsepart == cond_end) cond_end = NULL;   /* skip-opt-str */
-		  elsepart = cond_end;
+		  jump = add_format_op (cf, FORMAT_OP_JUMP);
+		  op->target = cf->num_ops;
+		  if (NULL == compile_format_span (cf, elsepart + 1, cond_end))
+		    return NULL;
+		  jump->target = cf->num_ops;
 	       }
+	     else op->target = cf->num_ops;
+
+	     fmt = cond_end + 1;
 	     continue;
 	  }
 
-	s = NULL;
-
 	if (ch == '-')
 	  {
 	     justify = 1;
@@ -621,26 +660,138 @@ void slrn_custom_printf (char *fmt, PRINTF_CB cb, void *param, /*{{{*/
 	     while (isdigit (ch));
 	  }
 
-	switch (ch)
+	if (ch == 0)
+	  return NULL;
+
+	op = add_format_op (cf, (ch == 'g') ? FORMAT_OP_COLUMN : FORMAT_OP_FIELD);
+	op->dscr = ch;
+	op->justify = justify;
+	op->field_len = field_len;
+     }
+   return fmt;
+}
+
+/*}}}*/
+
+static Compiled_Format_Type *compile_format (char *fmt) /*{{{*/
+{
+   Compiled_Format_Type *cf;
+   unsigned int i, len;
+
+   for (i = 0; i < FORMAT_CACHE_SIZE; i++)
+     {
+	cf = Format_Cache + i;
+	if ((cf->fmt != NULL) && (0 == strcmp (cf->fmt, fmt)))
+	  return cf;
+     }
+
+   cf = Format_Cache + Format_Cache_Next;
+   Format_Cache_Next = (Format_Cache_Next + 1) % FORMAT_CACHE_SIZE;
+
+   slrn_free (cf->fmt);
+   slrn_free ((char *) cf->ops);
+   cf->ops = NULL;
+   cf->num_ops = 0;
+
+   /* Every operation but jumps and the final one consumes at least one
+    * character, and jumps need four of them.
+    */
+   len = strlen (fmt);
+   if ((NULL == (cf->fmt = slrn_strmalloc (fmt, 0)))
+       || (NULL == (cf->ops = (Format_Op_Type *) slrn_malloc ((len + 2) * sizeof (Format_Op_Type), 0, 0))))
+     {
+	slrn_free (cf->fmt);
+	cf->fmt = NULL;
+	return NULL;
+     }
+
+   (void) compile_format_span (cf, cf->fmt, NULL);
+   (void) add_format_op (cf, FORMAT_OP_END);
+
+   /* After a syntax error, pending jumps go to the end. */
+   for (i = 0; i < cf->num_ops; i++)
+     {
+	Format_Op_Type *op = cf->ops + i;
+	if (((op->type == FORMAT_OP_COND) || (op->type == FORMAT_OP_JUMP))
+	    && (op->target == 0))
+	  op->target = cf->num_ops - 1;
+     }
+   return cf;
+}
+
+/*}}}*/
+
+/* generic function to display format strings;
+ * cb is called when a descriptor other than '%', '?' or 'g' is encountered */
+void slrn_custom_printf (char *fmt, PRINTF_CB cb, void *param, /*{{{*/
+			 int row, int def_color)
+{
+   Compiled_Format_Type *cf;
+   Format_Op_Type *op;
+   unsigned int i;
+
+   SLsmg_gotorc (row, 0);
+   slrn_set_color (def_color);
+
+   if (NULL == (cf = compile_format (fmt)))
+     {
+	SLsmg_erase_eol ();
+	return;
+     }
+
+   i = 0;
+   while (1)
+     {
+	char *s, *smax, *p;
+	int color = def_color;
+	int len = -1, field_len;
+	int spaces = 0;
+
+	op = cf->ops + i++;
+	field_len = op->field_len;
+
+	switch (op->type)
 	  {
-	   case 0:
-	     break;
+	   case FORMAT_OP_LITERAL:
+	     SLsmg_write_nchars (op->str, op->len);
+	     continue;
 
-	   case '%':
-	     s = "%";
-	     len = 1;
-	     break;
+	   case FORMAT_OP_JUMP:
+	     i = op->target;
+	     continue;
+
+	   case FORMAT_OP_COND:
+	       {
+		  int column = SLsmg_get_column (); /* callback could print something */
+		  char *res = (cb)(op->dscr, param, &len, &color);
+		  SLsmg_gotorc (row, column);
 
-	   case 'g':
+		  /* Condition is false, so skip the <opt-str>,
+		   * or skip to <str-if-false>
+		   */
+		  if ((res == NULL) || (*res == '\0')
+		      || (((*res == '0') || isspace(*res)) && *(res+1) == '\0'))
+		    i = op->target;
+	       }
+	     continue;
+
+	   case FORMAT_OP_COLUMN:
 	     SLsmg_erase_eol ();
-	     if (justify)
+	     if (op->justify)
 	       field_len = SLtt_Screen_Cols - field_len;
 	     SLsmg_gotorc (row, field_len);
-	     break;
+	     continue;
 
-	   default:
-	     s = (cb)(ch, param, &len, &color);
+	   case FORMAT_OP_FIELD:
+	     if (op->dscr == '%')
+	       s = "%";
+	     else
+	       s = (cb)(op->dscr, param, &len, &color);
 	     break;
+
+	   default:		       /* FORMAT_OP_END */
+	     SLsmg_erase_eol ();
+	     return;
 	  }
 
 	if (s == NULL)
@@ -663,10 +814,10 @@ void slrn_custom_printf (char *fmt, PRINTF_CB cb, void *param, /*{{{*/
 	     else
 	       len = field_len;
 	  }
-	if (justify)
+	if (op->justify)
 	  {
 	     int n;
-	     if (justify == 1) n = 0; /* right justify */
+	     if (op->justify == 1) n = 0; /* right justify */
 	     else n = spaces - (spaces / 2); /* center */
 	     while (spaces > n)
 	       {
@@ -683,11 +834,11 @@ void slrn_custom_printf (char *fmt, PRINTF_CB cb, void *param, /*{{{*/
 	if (color != def_color)
 	  slrn_set_color (def_color);
      }
-
-   SLsmg_erase_eol ();
 }
 /*}}}*/
 
+/*}}}*/
+
 int slrn_set_display_format (char **formats, unsigned int num, char *entry) /*{{{*/
 {
    if (num >= SLRN_MAX_DISPLAY_FORMATS)
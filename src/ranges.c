@@ -255,16 +255,65 @@ Slrn_Range_Type *slrn_ranges_remove (Slrn_Range_Type *r, NNTP_Artnum_Type min,
 /*}}}*/
 
 /* Merges two range lists a and b and returns the result
- * Note: does not allocate a new list, but changes a
+ * Note: does not allocate a new list, but changes a; as both lists are
+ * sorted, this is done in a single pass over them.
  */
 Slrn_Range_Type *slrn_ranges_merge (Slrn_Range_Type *a, Slrn_Range_Type *b) /*{{{*/
 {
-   Slrn_Range_Type *retval = a;
+   Slrn_Range_Type *retval = a, *r = a, *prev = NULL;
 
    while (b != NULL)
      {
-	retval = slrn_ranges_add (retval, b->min, b->max);
+	NNTP_Artnum_Type min = b->min, max = b->max;
+
 	b = b->next;
+	if (min > max) continue;
+
+	/* Skip ranges below min */
+	while ((r != NULL) && (r->max+1 < min))
+	  {
+	     prev = r;
+	     r = r->next;
+	  }
+
+	/* Do we need to insert a new range before r? */
+	if ((r == NULL) || (max+1 < r->min))
+	  {
+	     Slrn_Range_Type *n;
+	     n = (Slrn_Range_Type *) slrn_safe_malloc (sizeof(Slrn_Range_Type));
+	     n->min = min;
+	     n->max = max;
+	     n->next = r;
+	     n->prev = prev;
+	     if (prev != NULL)
+	       prev->next = n;
+	     else
+	       retval = n;
+	     if (r != NULL)
+	       r->prev = n;
+	     prev = n;
+	     continue;
+	  }
+
+	/* Update min / max values */
+	if (min < r->min)
+	  r->min = min;
+	if (max > r->max)
+	  r->max = max;
+
+	/* Clean up successive ranges */
+	while ((r->next != NULL) &&
+	       (r->next->min <= r->max+1))
+	  {
+	     Slrn_Range_Type *next = r->next;
+	     if (next->max > r->max)
+	       r->max = next->max;
+
+	     r->next = next->next;
+	     if (r->next != NULL)
+	       r->next->prev = r;
+	     SLFREE (next);
+	  }
      }
 
    return retval;
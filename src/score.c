@@ -41,9 +41,10 @@
 # include "misc.h"
 # include "util.h"
 # include "server.h"
-# include "hash.h"
 #endif
 
+#include "hash.h"
+
 #include "strutil.h"
 #include "art.h"
 #include "xover.h"
@@ -272,7 +273,7 @@ static int match_srt (Slrn_Header_Type *h, Score_Regexp_Type *srt,
              break;
 
            case SCORE_REFERENCES:
-             s = h->refs;
+             s = slrn_references_string (h->refs, h->num_refs);
              break;
 
            case SCORE_NEWSGROUP:
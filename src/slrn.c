@@ -80,6 +80,7 @@
 #include "misc.h"
 #include "startup.h"
 #include "art.h"
+#include "artcache.h"
 #include "score.h"
 #include "snprintf.h"
 #include "charset.h"
@@ -1226,6 +1227,7 @@ Could not read specified config file %s\n"), init_file);
      {
 	slrn_exit_error (_("Unable to select server/post object."));
      }
+   slrn_art_cache_init ();
 
 #if !defined(IBMPC_SYSTEM)
    /* Allow blink characters if in mono */
@@ -1711,6 +1713,30 @@ void slrn_repeat_last_key (void) /*{{{*/
 
 /*}}}*/
 
+/* Give the current mode a chance to do some work while the user is not
+ * typing.  The first call is delayed a bit to avoid interfering with
+ * multi-key sequences.
+ */
+static void run_idle_function (void) /*{{{*/
+{
+   Slrn_Mode_Type *mode = Slrn_Current_Mode;
+   int delay = 5;
+
+   if ((mode == NULL) || (mode->idle_fun == NULL))
+     return;
+
+   while ((mode == Slrn_Current_Mode)
+	  && (0 == SLang_get_error ())
+	  && (0 == SLang_input_pending (delay)))
+     {
+	if (0 == (*mode->idle_fun) ())
+	  break;
+	delay = 0;
+     }
+}
+
+/*}}}*/
+
 int main (int argc, char **argv) /*{{{*/
 {
    if (-1 == main_init_and_parse_args (argc, argv))
@@ -1744,6 +1770,7 @@ int main (int argc, char **argv) /*{{{*/
 	if (SLang_get_error() || !SLang_input_pending(0))
 	  {
 	     slrn_update_screen ();
+	     run_idle_function ();
 	  }
 
 	slrn_do_keymap_key (Slrn_Current_Mode->keymap);
@@ -63,6 +63,9 @@ typedef struct
 #define SLRN_GROUP_MODE		2
 #define SLRN_MENU_MODE		3
    int mode;
+   /* Called repeatedly while no key is pending.  It should do a small
+    * piece of work and return non-zero if there is more to do. */
+   int (*idle_fun)(void);
 }
 Slrn_Mode_Type;
 
@@ -32,6 +32,9 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <time.h>
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
 
 #include <sys/stat.h>
 
@@ -56,7 +59,12 @@
 # include <sys/fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+
 #include <ctype.h>
+#include <limits.h>
 
 #ifndef S_ISREG
 # define S_ISREG(mode)  (((mode) & (_S_IFMT)) == (_S_IFREG))
@@ -111,6 +119,7 @@ int Slrn_UTF8_Mode = 0;
 #endif
 
 static int Exit_Code;
+static int Worker_Exit_Code;	       /* first failure of a worker process */
 #define SLRN_EXIT_UNKNOWN		1
 #define SLRN_EXIT_BAD_USAGE		2
 #define SLRN_EXIT_CONNECTION_FAILED	3
@@ -126,7 +135,9 @@ char *SlrnPull_Dir = SLRNPULL_ROOT_DIR;
 char *SlrnPull_Spool_News_Dir;
 char *Group_Min_Max_File;	       /* relative to group dir */
 char *Server_Min_File;		/* relative to group dir */
+char *Pending_File;		/* relative to group dir */
 char *Overview_File;	       /* relative to group dir */
+char *Article_Index_File;	       /* relative to group dir */
 char *Headers_File = SLRN_SPOOL_HEADERS; /* relative to group dir */
 char *Requests_Dir;
 char *Outgoing_Dir;
@@ -145,11 +156,21 @@ static time_t Start_Time;
 
 #define CREATE_OVERVIEW 1
 
+/* Groups may be pulled by several worker processes, each with its own
+ * connection to the server. */
+#if defined(REAL_UNIX_SYSTEM) && defined(HAVE_SYS_WAIT_H)
+# define SLRNPULL_HAS_WORKERS 1
+# define SLRNPULL_MAX_WORKERS 16
+#else
+# define SLRNPULL_HAS_WORKERS 0
+#endif
+
 static int handle_interrupts (void);
 
 typedef struct _Active_Group_Type /*{{{*/
 {
    unsigned int flags;
+#define GROUP_DONE		0x0001 /* by this worker process */
 
    /* Unfortunately, three different sets of article ranges are required.
     * Ideally, only one would be required but this does not seem to be
@@ -184,11 +205,13 @@ typedef struct _Active_Group_Type /*{{{*/
    unsigned int max_to_get;	       /* if non-zero, get only this many */
    unsigned int expire_days;	       /* if zero, no expiration */
    int headers_only;	/* If non-zero, fetch headers only (offline reading) */
+   int priority;		       /* groups with a higher one are pulled first */
 #define MAX_GROUP_NAME_LEN 80
    char name [MAX_GROUP_NAME_LEN + 1];
    char dirname [MAX_GROUP_NAME_LEN + 1];
    Slrn_Range_Type *headers;	/* list of articles that don't have bodies */
    Slrn_Range_Type *requests;	/* list of requested article bodies */
+   Slrn_Range_Type *pending;	/* articles left over when the budget ran out */
    struct _Active_Group_Type *next;
 }
 
@@ -415,6 +438,79 @@ static void write_server_min_file (Active_Group_Type *g, NNTP_Artnum_Type val) /
 
 /*}}}*/
 
+/* The pending file lists the articles that were not fetched because the
+ * budget ran out.  They are fetched by the next run, even though they are
+ * below g->max. */
+static int make_pending_filename (Active_Group_Type *g, char *file, size_t n) /*{{{*/
+{
+   if (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, file, n))
+     return -1;
+   return slrn_dircat (file, Pending_File, file, n);
+}
+
+/*}}}*/
+
+static void read_pending_file (Active_Group_Type *g) /*{{{*/
+{
+   char file[SLRN_MAX_PATH_LEN + 1];
+   VFILE *vp;
+   char *vline;
+   unsigned int vlen;
+
+   slrn_ranges_free (g->pending);
+   g->pending = NULL;
+
+   if ((-1 == make_pending_filename (g, file, sizeof (file)))
+       || (1 != slrn_file_exists (file)))
+     return;
+
+   if (NULL == (vp = vopen (file, 4096, 0)))
+     {
+	log_error (_("File %s exists, but could not be read."), file);
+	return;
+     }
+
+   if (NULL != (vline = vgets (vp, &vlen)))
+     {
+	if (vline[vlen-1] == '\n')
+	  vline[vlen-1] = 0;
+	else
+	  vline[vlen] = 0;
+	g->pending = slrn_ranges_from_newsrc_line (vline);
+     }
+
+   vclose (vp);
+}
+
+/*}}}*/
+
+static void write_pending_file (Active_Group_Type *g) /*{{{*/
+{
+   char file[SLRN_MAX_PATH_LEN + 1];
+   FILE *fp;
+
+   if (-1 == make_pending_filename (g, file, sizeof (file)))
+     return;
+
+   if (g->pending == NULL)
+     {
+	if (1 == slrn_file_exists (file))
+	  (void) slrn_delete_file (file);
+	return;
+     }
+
+   if (NULL == (fp = fopen (file, "w")))
+     {
+	log_error (_("Unable to open %s for writing."), file);
+	return;
+     }
+   if ((-1 == slrn_ranges_to_newsrc_file (g->pending, 0, fp)) | /* avoid short-circuit */
+       (-1 == slrn_fclose (fp)))
+     log_error (_("Write to %s failed."), file);
+}
+
+/*}}}*/
+
 static FILE *open_group_min_max_file (Active_Group_Type *g, char *mode, /*{{{*/
 				      char *file, size_t n)
 {
@@ -501,683 +597,2001 @@ static int write_group_min_max_file (Active_Group_Type *g) /*{{{*/
 
 /*}}}*/
 
-static int create_group_directory (Active_Group_Type *g) /*{{{*/
+/*{{{ Article index */
+
+/* The article index of a group has a line "number mtime size body" for
+ * every article in the spool directory of the group, where mtime and size
+ * are those of the article file and body is 1 if the article has a body.
+ * A line is appended whenever an article is written, so that expire_group
+ * does not have to scan the directory and stat the files.  If an article
+ * is written again (e.g. when its body has been fetched), the last line
+ * for it is the valid one.  On --rebuild, the index serves as a checkpoint:
+ * only articles whose mtime or size has changed are parsed again.
+ *
+ * Articles in a packed spool (see below) have two more fields, the number
+ * of the segment and the offset of the article in it.  For them, mtime is
+ * the time the article was stored.  slrn reads these lines as well.
+ */
+typedef struct
 {
-   char dirbuf [SLRN_MAX_PATH_LEN + 1];
-   char *dir, *d, ch;
-   unsigned int len;
-   int status;
-
-   strcpy (g->dirname, g->name); /* safe */
-
-   d = g->dirname;
-   while (*d != 0)
-     {
-	if (*d == '.') *d = SLRN_PATH_SLASH_CHAR;
-	d++;
-     }
+   NNTP_Artnum_Type num;
+   time_t time;
+   unsigned long size;
+   int has_body;		       /* -1 if not known */
+   unsigned int seg;		       /* 0 if the article has its own file */
+   unsigned long offset;	       /* in the segment */
+   unsigned int seq;		       /* line number in the index */
+}
+Article_Index_Type;
+
+/* With --packed-spool, new articles do not get a file of their own but are
+ * appended to the segment files SLRN_SPOOL_SEGMENT "N" of the group.  Each
+ * article in a segment is preceded by a line
+ *
+ *    #! slrnpull S NUMBER LENGTH TIME
+ *
+ * where S is 'a' for a valid article and 'x' for one that could not be
+ * written completely, and LENGTH (always 10 digits) the number of bytes
+ * that follow.  This line is only needed to rebuild the article index; slrn
+ * and slrnpull find the articles through the index.  A new segment is
+ * started when the current one exceeds SLRNPULL_SEGMENT_SIZE bytes.
+ */
+#define SLRNPULL_SEGMENT_SIZE	0x400000
+#define SEGMENT_HEADER_FMT	"#! slrnpull %c " NNTP_FMT_ARTNUM " %010lu %lu\n"
 
-   /* If the min-max file is available, we know the directory exists.
-    * Check it now.  Also, this provides a convenient check on the length
-    * of the filename.
-    */
-   status = read_group_min_max_file (g);
+static FILE *Article_Index_Fp;
+static Active_Group_Type *Article_Index_Group;
 
-   if (status == -1)
+static int make_article_index_filename (Active_Group_Type *g, char *file, size_t n) /*{{{*/
+{
+   if ((-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, file, n))
+       || (-1 == slrn_dircat (file, Article_Index_File, file, n)))
      return -1;
+   return 0;
+}
 
-   if (status != 0)
-     return 0;
+/*}}}*/
 
-   /* Does not exist so we will have to create the directory. */
+static int make_segment_filename (char *dir, unsigned int seg, char *file, size_t n) /*{{{*/
+{
+   char buf [64];
 
-   len = strlen (SlrnPull_Spool_News_Dir);
+   (void) SLsnprintf (buf, sizeof (buf), "%s%u", SLRN_SPOOL_SEGMENT, seg);
+   return slrn_dircat (dir, buf, file, n);
+}
 
-   if (sizeof (dirbuf) < len + strlen (g->dirname) + 2)
-     return -1;
+/*}}}*/
 
-   strcpy (dirbuf, SlrnPull_Spool_News_Dir); /* safe */
+/* Entries found by scan_article_index all have the same seq; of these,
+ * the most recently written one is the last. */
+static int article_index_cmp (Article_Index_Type *a, Article_Index_Type *b) /*{{{*/
+{
+   if (a->num > b->num) return 1;
+   if (a->num < b->num) return -1;
+   if (a->seq > b->seq) return 1;
+   if (a->seq < b->seq) return -1;
+   if (a->time > b->time) return 1;
+   if (a->time < b->time) return -1;
+   if (a->seg > b->seg) return 1;
+   if (a->seg < b->seg) return -1;
+   if (a->offset > b->offset) return 1;
+   if (a->offset < b->offset) return -1;
+   return 0;
+}
 
-   dirbuf [len] = SLRN_PATH_SLASH_CHAR;
-   len++;
+/*}}}*/
 
-   dir = dirbuf + len;
-   strcpy (dir, g->dirname); /* safe */
+/* Sorts the entries by article number and drops all but the last entry
+ * for each article.  Returns the new number of entries. */
+static unsigned int sort_article_index (Article_Index_Type *entries, unsigned int num) /*{{{*/
+{
+   void (*qsort_fun) (char *, unsigned int, int, int (*)(Article_Index_Type *, Article_Index_Type *));
+   unsigned int i, j;
 
-   d = dir + strlen (dir);
+   if (num < 2)
+     return num;
 
-   if (0 == do_mkdir (dirbuf, 0))
-     return 0;
+   qsort_fun = (void (*)(char *, unsigned int, int,
+			 int (*)(Article_Index_Type *, Article_Index_Type *))) qsort;
+   (*qsort_fun) ((char *) entries, num, sizeof (Article_Index_Type), article_index_cmp);
 
-   /* Go back and create it piece by piece. */
-   d = dir;
-   do
+   j = 0;
+   for (i = 1; i < num; i++)
      {
-	ch = *d;
-	if ((ch == SLRN_PATH_SLASH_CHAR) || (ch == 0))
-	  {
-	     *d = 0;
-	     if (-1 == do_mkdir (dirbuf, 1))
-	       return -1;
-
-	     *d = ch;
-	  }
-	d++;
+	if (entries[i].num != entries[j].num)
+	  j++;
+	entries[j] = entries[i];
      }
-   while (ch != 0);
-
-   return 0;
+   return j + 1;
 }
 
 /*}}}*/
 
-/* The argv list is NOT NULL terminated.
- */
-static int chop_string (char *str, char **argv, int *argc_p, int max_args) /*{{{*/
+static int add_article_index_entry (Article_Index_Type **entriesp, /*{{{*/
+				    unsigned int *nump, unsigned int *maxp,
+				    Article_Index_Type *entry)
 {
-   char *s;
-   int argc;
+   Article_Index_Type *e;
 
-   argc = 0;
-   while (argc < max_args)
+   if (*nump == *maxp)
      {
-	str = slrn_skip_whitespace (str);
-	if (*str == 0)
-	  break;
-
-	s = slrn_strbrk (str, " \t\n");
-	if (s != NULL)
-	  *s = 0;
-
-	argv[argc] = str;
-	argc++;
-
-	if (s == NULL) break;
-
-	str = s + 1;
+	*maxp += 500;
+	e = (Article_Index_Type *) slrn_realloc ((char *) *entriesp, *maxp * sizeof (Article_Index_Type), 1);
+	if (e == NULL)
+	  return -1;
+	*entriesp = e;
      }
 
-   *argc_p = argc;
-   return argc;
+   e = *entriesp + *nump;
+   *e = *entry;
+   e->seq = *nump;
+   *nump += 1;
+   return 0;
 }
 
 /*}}}*/
 
-static int read_active_groups (void) /*{{{*/
+/* Returns -1 if there is no index for g, 0 otherwise.  The entries are
+ * sorted by article number. */
+static int read_article_index (Active_Group_Type *g, Article_Index_Type **entriesp, /*{{{*/
+			       unsigned int *nump)
 {
+   char file [SLRN_MAX_PATH_LEN + 1];
+   char line [256];
+   unsigned int max = 0;
    FILE *fp;
-   char buf[256];
-   unsigned int num;
-   int default_max_to_get, default_expire_days, default_headers_only;
 
-   fp = fopen (Active_Groups_File, "r");
-   if (fp == NULL)
+   *entriesp = NULL;
+   *nump = 0;
+
+   if ((-1 == make_article_index_filename (g, file, sizeof (file)))
+       || (NULL == (fp = fopen (file, "r"))))
+     return -1;
+
+   while (NULL != fgets (line, sizeof (line), fp))
      {
-	if (NULL == (fp = fopen (SLRN_CONF_DIR "/" SLRNPULL_CONF, "r")))
+	Article_Index_Type e;
+	unsigned long t;
+
+	e.seg = 0;
+	e.offset = 0;
+	switch (sscanf (line, NNTP_FMT_ARTNUM " %lu %lu %d %u %lu", &e.num, &t,
+			&e.size, &e.has_body, &e.seg, &e.offset))
 	  {
-	     log_error (_("Unable to open active groups file %s"), Active_Groups_File);
+	   case 3:
+	     e.has_body = -1;
+	     break;
+	   case 4:
+	   case 6:
+	     break;
+	   default:
+	     continue;
+	  }
+	e.time = (time_t) t;
+
+	if (-1 == add_article_index_entry (entriesp, nump, &max, &e))
+	  {
+	     log_error (_("malloc error. Unable to read %s."), file);
+	     fclose (fp);
+	     slrn_free ((char *) *entriesp);
+	     *entriesp = NULL;
+	     *nump = 0;
 	     return -1;
 	  }
-	else
-	  Active_Groups_File = SLRN_CONF_DIR "/" SLRNPULL_CONF;
      }
+   fclose (fp);
 
-   log_message (_("Reading %s"), Active_Groups_File);
+   *nump = sort_article_index (*entriesp, *nump);
+   return 0;
+}
 
-   default_max_to_get = 50;
-   default_expire_days = 10;
-   default_headers_only = 0;
+/*}}}*/
 
-   num = 0;
-   while (NULL != fgets (buf, sizeof(buf), fp))
+static Article_Index_Type *find_article_index_entry (Article_Index_Type *entries, /*{{{*/
+						     unsigned int num, NNTP_Artnum_Type id)
+{
+   unsigned int left = 0, right = num;
+
+   while (left < right)
      {
-#define MAX_ARGS 10
-	char *argv[MAX_ARGS];
-	int argc;
-	char *name, *arg;
-	Active_Group_Type *g;
-	int max_to_get;
-	int expire_days;
-	int headers_only;
+	unsigned int mid = (left + right) / 2;
 
-	num++;
+	if (entries[mid].num == id)
+	  return entries + mid;
+	if (entries[mid].num < id)
+	  left = mid + 1;
+	else
+	  right = mid;
+     }
+   return NULL;
+}
 
-	name = slrn_skip_whitespace (buf);
-	if ((*name == '#') || (*name == 0))
-	  continue;
+/*}}}*/
 
-	slrn_trim_string (name);
+/* Adds the valid articles in segment seg (file) to the entries.  Returns
+ * -1 if memory runs out. */
+static int scan_segment (char *file, unsigned int seg, Article_Index_Type **entriesp, /*{{{*/
+			 unsigned int *nump, unsigned int *maxp)
+{
+   char line [256];
+   FILE *fp;
+   int ret = 0;
 
-	chop_string (name, argv, &argc, MAX_ARGS);
+   if (NULL == (fp = fopen (file, "rb")))
+     {
+	log_error (_("Unable to open %s."), file);
+	return 0;
+     }
 
-	name = argv[0]; argc--;
-	if (strlen (name) > MAX_GROUP_NAME_LEN)
+   while (NULL != fgets (line, sizeof (line), fp))
+     {
+	Article_Index_Type e;
+	unsigned long t;
+	long pos;
+	char status;
+
+	if ((5 != sscanf (line, "#! slrnpull %c " NNTP_FMT_ARTNUM " %lu %lu",
+			  &status, &e.num, &e.size, &t))
+	    || (-1 == (pos = ftell (fp))))
 	  {
-	     log_error (_("%s: line %u: group name too long."),
-			 Active_Groups_File, num);
-	     fclose (fp);
-	     return -1;
+	     log_error (_("%s is corrupt."), file);
+	     break;
 	  }
-	/* Make sure name is a valid name.  Here I just check for whitespace
-	 * in name which means it is invalid.
-	 */
-	arg = name;
-	while (*arg != 0)
-	  {
-	     unsigned char uch;
-
-	     uch = (unsigned char) *arg;
 
-	     if (uch <= 32)
+	if (status == 'a')
+	  {
+	     e.time = (time_t) t;
+	     e.has_body = -1;
+	     e.seg = seg;
+	     e.offset = (unsigned long) pos;
+	     if (-1 == add_article_index_entry (entriesp, nump, maxp, &e))
 	       {
-		  log_error (_("%s: line %u: Group name contains whitespace."),
-			      Active_Groups_File, num);
-		  fclose (fp);
-		  return -1;
+		  ret = -1;
+		  break;
 	       }
-	     arg++;
 	  }
 
-	max_to_get = default_max_to_get;
-	expire_days = default_expire_days;
-	headers_only = default_headers_only;
+	if (-1 == fseek (fp, pos + (long) e.size, SEEK_SET))
+	  break;
+     }
 
-	arg = argv[1];
+   fclose (fp);
+   return ret;
+}
 
-	if (argc)
-	  {
-	     if ((*arg != '*') &&
-		 ((1 != sscanf (arg, "%d", &max_to_get))
-		  || (max_to_get < 0)))
-	       {
-		  log_error (_("%s: line %u: expecting positive integer in second field."),
-			      Active_Groups_File, num);
-		  fclose (fp);
-		  return -1;
-	       }
-	     argc--;
-	  }
+/*}}}*/
 
-	arg = argv[2];
-	if (argc)
-	  {
-	     if ((*arg != '*') &&
-		 ((1 != sscanf (arg, "%d", &expire_days))
-		  || (expire_days < 0)))
-	       {
-		  log_error (_("%s: line %u: expecting positive integer in third field."),
-			      Active_Groups_File, num);
-		  fclose (fp);
-		  return -1;
-	       }
-	     argc--;
-	  }
+/* Builds the entries from the files in the spool directory of g.  This is
+ * only needed for groups that do not have an index yet and when the
+ * overview is rebuilt.
+ */
+static int scan_article_index (Active_Group_Type *g, Article_Index_Type **entriesp, /*{{{*/
+			       unsigned int *nump)
+{
+   char dir [SLRN_MAX_PATH_LEN + 1];
+   char file [SLRN_MAX_PATH_LEN + 1];
+   Slrn_Dir_Type *dp;
+   Slrn_Dirent_Type *df;
+   unsigned int i, max = 0;
 
-	arg = argv[3];
-	if (argc)
-	  {
-	     if ((*arg != '*') &&
-		 ((1 != sscanf (arg, "%d", &headers_only))
-		  || ((headers_only != 0) && (headers_only != 1))))
-	       {
-		  log_error (_("%s: line %u: expecting 0 or 1 in fourth field."),
-			     Active_Groups_File, num);
-		  fclose (fp);
-		  return -1;
-	       }
-	     argc--;
-	  }
+   *entriesp = NULL;
+   *nump = 0;
 
-	if (0 == strcmp (name, "default"))
-	  {
-	     default_expire_days = expire_days;
-	     default_max_to_get = max_to_get;
-	     default_headers_only = headers_only;
-	     continue;
-	  }
+   if (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname,
+			  dir, sizeof (dir)))
+     return -1;
 
-	if (NULL != find_group_type (name))
-	  {
-	     log_error (_("%s: line %u: group duplicated."),
-			 Active_Groups_File, num);
-	     fclose (fp);
-	     return -1;
-	  }
+   dp = slrn_open_dir (dir);
+   if (dp == NULL)
+     {
+	log_error (_("opendir %s failed."), dir);
+	return -1;
+     }
 
-	if (NULL == (g = add_group_type (name)))
-	  {
-	     log_error (_("%s: line %u: failed to add %s."),
-			 Active_Groups_File, num, name);
-	     fclose (fp);
-	     return -1;
-	  }
+   while (NULL != (df = slrn_read_dir (dp)))
+     {
+	char *name, *p;
+	Article_Index_Type e;
+	struct stat st;
+	unsigned int len = strlen (SLRN_SPOOL_SEGMENT);
+	int status;
 
-	g->max_to_get = (unsigned int) max_to_get;
-	g->expire_days = (unsigned int) expire_days;
-	g->headers_only = headers_only;
+	name = df->name;
 
-	if (-1 == create_group_directory (g))
+	if (0 == strncmp (name, SLRN_SPOOL_SEGMENT, len))
 	  {
-	     fclose (fp);
-	     return -1;
+	     unsigned int seg;
+	     char ch;
+
+	     /* Skip the temporary files of compact_segments */
+	     if ((1 != sscanf (name + len, "%u%c", &seg, &ch)) || (seg == 0)
+		 || (-1 == slrn_dircat (dir, name, file, sizeof (file))))
+	       continue;
+
+	     status = scan_segment (file, seg, entriesp, nump, &max);
 	  }
-     }
+	else
+	  {
+	     /* Look for names composed of digits.  Skip others. */
+	     p = name;
+	     while (*p && isdigit (*p)) p++;
+	     if (*p != 0) continue;
 
-   fclose (fp);
-   return 0;
-}
+	     if ((1 != sscanf (name, NNTP_FMT_ARTNUM, &e.num))
+		 || (e.num < 0))
+	       continue;		       /* hmm... I'm paranoid. */
 
-/*}}}*/
+	     if ((-1 == slrn_dircat (dir, name, file, sizeof (file)))
+		 || (-1 == stat (file, &st)))
+	       {
+		  log_error (_("Unable to stat %s."), file);
+		  continue;
+	       }
 
-static char *do_dircat (char *dir, char *name)
-{
-   char *f;
+	     if (0 == S_ISREG(st.st_mode))
+	       continue;
 
-   if (slrn_is_absolute_path (name))
-     f = slrn_strmalloc (name, 0);
-   else
-     f = slrn_spool_dircat (dir, name, 0);
+	     e.time = st.st_mtime;
+	     e.size = (unsigned long) st.st_size;
+	     e.has_body = -1;
+	     e.seg = 0;
+	     e.offset = 0;
+	     status = add_article_index_entry (entriesp, nump, &max, &e);
+	  }
 
-   if (f == NULL)
-     {
-	Exit_Code = SLRN_EXIT_MALLOC_FAILED;
-	slrn_exit_error (_("Out of memory."));
+	if (status == -1)
+	  {
+	     log_error (_("malloc error. Unable to expire group %s."), g->name);
+	     slrn_close_dir (dp);
+	     slrn_free ((char *) *entriesp);
+	     *entriesp = NULL;
+	     *nump = 0;
+	     return -1;
+	  }
      }
 
-#if defined(__os2__) || defined(__NT__)
-   slrn_os2_convert_path (f);
-#endif
+   slrn_close_dir (dp);
 
-   return f;
-}
+   /* The order in which the files were read does not mean anything. */
+   for (i = 0; i < *nump; i++)
+     (*entriesp)[i].seq = 0;
 
-static char *root_dircat (char *name) /*{{{*/
-{
-   return do_dircat (SlrnPull_Dir, name);
+   *nump = sort_article_index (*entriesp, *nump);
+   return 0;
 }
 
 /*}}}*/
 
-static char *data_dircat (char *name) /*{{{*/
+static int write_article_index_line (FILE *fp, Article_Index_Type *e) /*{{{*/
 {
-   return do_dircat (Data_Dir, name);
+   if (e->seg == 0)
+     return fprintf (fp, NNTP_FMT_ARTNUM " %lu %lu %d\n", e->num,
+		     (unsigned long) e->time, e->size, e->has_body);
+
+   return fprintf (fp, NNTP_FMT_ARTNUM " %lu %lu %d %u %lu\n", e->num,
+		   (unsigned long) e->time, e->size, e->has_body,
+		   e->seg, e->offset);
 }
 
 /*}}}*/
 
-static int make_filenames (void) /*{{{*/
+static int write_article_index (Active_Group_Type *g, Article_Index_Type *entries, /*{{{*/
+				unsigned int num)
 {
-   Data_Dir = root_dircat (Data_Dir);
-   Outgoing_Dir = root_dircat (SLRNPULL_OUTGOING_DIR);
-   Requests_Dir = root_dircat (SLRNPULL_REQUESTS_DIR);
+   char file [SLRN_MAX_PATH_LEN + 1];
+   char tmp_file [SLRN_MAX_PATH_LEN + 5];
+   unsigned int i;
+   FILE *fp;
 
-   Active_Groups_File = root_dircat (SLRNPULL_CONF);
-   SlrnPull_Spool_News_Dir = root_dircat (SLRNPULL_NEWS_DIR);
+   if (-1 == make_article_index_filename (g, file, sizeof (file)))
+     return -1;
+   (void) SLsnprintf (tmp_file, sizeof (tmp_file), "%s.tmp", file);
 
-   New_Groups_Time_File = data_dircat (New_Groups_Time_File);
-   Active_File = data_dircat (Active_File);
-   New_Groups_File = data_dircat (New_Groups_File);
+   if (NULL == (fp = fopen (tmp_file, "w")))
+     {
+	log_error (_("Unable to open %s for writing."), tmp_file);
+	return -1;
+     }
 
-   Outgoing_Bad_Dir = slrn_spool_dircat (Outgoing_Dir, SLRNPULL_OUTGOING_BAD_DIR, 0);
-   if (Outgoing_Bad_Dir == NULL)
+   for (i = 0; i < num; i++)
      {
-	Exit_Code = SLRN_EXIT_MALLOC_FAILED;
-	slrn_exit_error (_("Out of memory."));
+	if (EOF == write_article_index_line (fp, entries + i))
+	  {
+	     log_error (_("Write to %s failed."), tmp_file);
+	     (void) fclose (fp);
+	     (void) slrn_delete_file (tmp_file);
+	     return -1;
+	  }
      }
 
-   if (-1 == do_mkdir (SlrnPull_Spool_News_Dir, 1))
-     return -1;
+   if ((-1 == slrn_fclose (fp))
+       || (-1 == slrn_move_file (tmp_file, file)))
+     {
+	log_error (_("Error writing to %s."), file);
+	(void) slrn_delete_file (tmp_file);
+	return -1;
+     }
+   return 0;
+}
 
-   if (-1 == do_mkdir (Data_Dir, 1))
-     return -1;
+/*}}}*/
 
-   Overview_File = SLRN_SPOOL_NOV_FILE;
-   Group_Min_Max_File = ".minmax";
-   Server_Min_File = ".servermin";
+static void close_article_index (void) /*{{{*/
+{
+   if ((Article_Index_Fp != NULL)
+       && (-1 == slrn_fclose (Article_Index_Fp)))
+     log_error (_("Error closing the article index of %s."), Article_Index_Group->name);
 
-   return 0;
+   Article_Index_Fp = NULL;
+   Article_Index_Group = NULL;
 }
 
 /*}}}*/
 
-static NNTP_Artnum_Type *listgroup_numbers (NNTP_Type *s, Active_Group_Type *g, unsigned int *nump) /*{{{*/
+static void add_to_article_index (Active_Group_Type *g, Article_Index_Type *e) /*{{{*/
 {
-   NNTP_Artnum_Type *numbers;
-   NNTP_Artnum_Type maxnum, curnum;
-   unsigned int max, num;
-   char buf[256];
-   int status;
-
-   status = nntp_listgroup (s, g->name);
-   if (status != OK_GROUP)
+   if (g != Article_Index_Group)
      {
-	if (status == -1) log_error (_("Read failed."));
-	log_error (_("listgroup %s failed: %s"), g->name, nntp_map_code_to_string (status));
-	return NULL;
-     }
+	char file [SLRN_MAX_PATH_LEN + 1];
 
-   max = 0;
-   num = 0;
-   maxnum = 0;
-   numbers = NULL;
+	close_article_index ();
+	Article_Index_Group = g;
 
-   while (1 == (status = nntp_read_line (s, buf, sizeof (buf))))
-     {
-	if (num == max)
-	  {
-	     NNTP_Artnum_Type *newnums;
+	if (-1 == make_article_index_filename (g, file, sizeof (file)))
+	  return;
 
-	     max += 1000;
-	     newnums = (NNTP_Artnum_Type *) slrn_realloc ((char *) numbers, max * sizeof (NNTP_Artnum_Type), 1);
-	     if (newnums == NULL)
-	       {
-		  slrn_free ((char *)numbers);
-		  nntp_discard_output (s);
-		  return NULL;
-	       }
-	     numbers = newnums;
+	/* Create the index of groups that were pulled by older versions
+	 * from the files that are there. */
+	if (0 == slrn_file_exists (file))
+	  {
+	     Article_Index_Type *entries;
+	     unsigned int num;
+	     int status;
+
+	     if (-1 == scan_article_index (g, &entries, &num))
+	       return;
+	     status = write_article_index (g, entries, num);
+	     slrn_free ((char *) entries);
+	     if (status == -1)
+	       return;
 	  }
-	curnum = NNTP_STR_TO_ARTNUM (buf);
-	if (curnum > maxnum) maxnum = curnum;
-	numbers[num] = curnum;
-	num++;
+
+	if (NULL == (Article_Index_Fp = fopen (file, "a")))
+	  log_error (_("Unable to open %s for writing."), file);
      }
 
-   if (status == -1)
+   if (Article_Index_Fp == NULL)
+     return;
+
+   if (EOF == write_article_index_line (Article_Index_Fp, e))
      {
-	slrn_free ((char *) numbers);
-	return NULL;
+	log_error (_("Error writing the article index of %s."), g->name);
+	close_article_index ();
+	Article_Index_Group = g;
      }
-
-   *nump = num;
-   if (g->server_max < maxnum)
-     g->server_max = maxnum;
-   return numbers;
 }
 
 /*}}}*/
 
-static unsigned int Num_Duplicates;
+/*}}}*/
 
-/* This function returns a malloc'ed array that contains all article numbers
- * in group g on server s. *nump is set to the length of the array.
- * If article numbers larger than g->server_max are found, that variable
- * gets updated. */
-static NNTP_Artnum_Type *
-  list_server_numbers (NNTP_Type *s, Active_Group_Type *g,
-		       NNTP_Artnum_Type server_min, NNTP_Artnum_Type server_max,
-		       unsigned int *nump) /*{{{*/
+static int create_group_directory (Active_Group_Type *g) /*{{{*/
 {
-   char *name;
-   NNTP_Artnum_Type min, max;
+   char dirbuf [SLRN_MAX_PATH_LEN + 1];
+   char *dir, *d, ch;
+   unsigned int len;
    int status;
-   char buf [512];
-   NNTP_Artnum_Type *numbers;
-   unsigned int num_numbers, max_num_numbers;
-
-   *nump = 0;
 
-   name = g->name;
-   if (1 != nntp_has_cmd (s, "XHDR"))
-     return listgroup_numbers (s, g, nump);
-
-   /* Server seems to have XHDR.  Good. */
-   min = g->min;
-   max = g->max + 1;
-   if (max < min) max = min;
+   strcpy (g->dirname, g->name); /* safe */
 
-   /* If this is the first time this group has been visited, then do not grab
-    * all the message-ids when the user specifies a limit to grab.
-    */
-   if ((max <= 1) && (g->max_to_get != 0)
-       && (server_max + 1 > server_min + g->max_to_get))
+   d = g->dirname;
+   while (*d != 0)
      {
-	max = server_max - g->max_to_get + 1;
-	if (server_max >= server_min)
-	  log_message (_("The server may contain as many as " NNTP_FMT_ARTNUM  " articles in this group"),
-		       server_max - server_min + 1);
-	log_message (_("Only examining last %u articles since this is a new group"), g->max_to_get);
+	if (*d == '.') *d = SLRN_PATH_SLASH_CHAR;
+	d++;
      }
 
-   status = nntp_server_vcmd (s, ("XHDR Message-ID " NNTP_FMT_ARTNUM "-"), max);
+   /* If the min-max file is available, we know the directory exists.
+    * Check it now.  Also, this provides a convenient check on the length
+    * of the filename.
+    */
+   status = read_group_min_max_file (g);
+
    if (status == -1)
-     {
-	log_error (_("Server failed to return proper code for XHDR.  The connection may be lost"));
+     return -1;
+
+   if (status != 0)
+     return 0;
+
+   /* Does not exist so we will have to create the directory. */
+
+   len = strlen (SlrnPull_Spool_News_Dir);
+
+   if (sizeof (dirbuf) < len + strlen (g->dirname) + 2)
+     return -1;
+
+   strcpy (dirbuf, SlrnPull_Spool_News_Dir); /* safe */
+
+   dirbuf [len] = SLRN_PATH_SLASH_CHAR;
+   len++;
+
+   dir = dirbuf + len;
+   strcpy (dir, g->dirname); /* safe */
+
+   d = dir + strlen (dir);
+
+   if (0 == do_mkdir (dirbuf, 0))
+     return 0;
+
+   /* Go back and create it piece by piece. */
+   d = dir;
+   do
+     {
+	ch = *d;
+	if ((ch == SLRN_PATH_SLASH_CHAR) || (ch == 0))
+	  {
+	     *d = 0;
+	     if (-1 == do_mkdir (dirbuf, 1))
+	       return -1;
+
+	     *d = ch;
+	  }
+	d++;
+     }
+   while (ch != 0);
+
+   return 0;
+}
+
+/*}}}*/
+
+/* The argv list is NOT NULL terminated.
+ */
+static int chop_string (char *str, char **argv, int *argc_p, int max_args) /*{{{*/
+{
+   char *s;
+   int argc;
+
+   argc = 0;
+   while (argc < max_args)
+     {
+	str = slrn_skip_whitespace (str);
+	if (*str == 0)
+	  break;
+
+	s = slrn_strbrk (str, " \t\n");
+	if (s != NULL)
+	  *s = 0;
+
+	argv[argc] = str;
+	argc++;
+
+	if (s == NULL) break;
+
+	str = s + 1;
+     }
+
+   *argc_p = argc;
+   return argc;
+}
+
+/*}}}*/
+
+/* Sorts the groups by descending priority, so that the most important
+ * ones are pulled before a budget runs out.  Groups with the same priority
+ * stay in the order of the configuration file.
+ */
+static void sort_active_groups (void) /*{{{*/
+{
+   Active_Group_Type *sorted, *g, *next;
+
+   sorted = NULL;
+   for (g = Active_Groups; g != NULL; g = next)
+     {
+	Active_Group_Type **p = &sorted;
+
+	next = g->next;
+	while ((*p != NULL) && ((*p)->priority >= g->priority))
+	  p = &(*p)->next;
+	g->next = *p;
+	*p = g;
+     }
+
+   Active_Groups = sorted;
+   Active_Groups_Tail = NULL;
+   for (g = sorted; g != NULL; g = g->next)
+     Active_Groups_Tail = g;
+}
+
+/*}}}*/
+
+static int read_active_groups (void) /*{{{*/
+{
+   FILE *fp;
+   char buf[256];
+   unsigned int num;
+   int default_max_to_get, default_expire_days, default_headers_only;
+   int default_priority;
+
+   fp = fopen (Active_Groups_File, "r");
+   if (fp == NULL)
+     {
+	if (NULL == (fp = fopen (SLRN_CONF_DIR "/" SLRNPULL_CONF, "r")))
+	  {
+	     log_error (_("Unable to open active groups file %s"), Active_Groups_File);
+	     return -1;
+	  }
+	else
+	  Active_Groups_File = SLRN_CONF_DIR "/" SLRNPULL_CONF;
+     }
+
+   log_message (_("Reading %s"), Active_Groups_File);
+
+   default_max_to_get = 50;
+   default_expire_days = 10;
+   default_headers_only = 0;
+   default_priority = 0;
+
+   num = 0;
+   while (NULL != fgets (buf, sizeof(buf), fp))
+     {
+#define MAX_ARGS 10
+	char *argv[MAX_ARGS];
+	int argc;
+	char *name, *arg;
+	Active_Group_Type *g;
+	int max_to_get;
+	int expire_days;
+	int headers_only;
+	int priority;
+
+	num++;
+
+	name = slrn_skip_whitespace (buf);
+	if ((*name == '#') || (*name == 0))
+	  continue;
+
+	slrn_trim_string (name);
+
+	chop_string (name, argv, &argc, MAX_ARGS);
+
+	name = argv[0]; argc--;
+	if (strlen (name) > MAX_GROUP_NAME_LEN)
+	  {
+	     log_error (_("%s: line %u: group name too long."),
+			 Active_Groups_File, num);
+	     fclose (fp);
+	     return -1;
+	  }
+	/* Make sure name is a valid name.  Here I just check for whitespace
+	 * in name which means it is invalid.
+	 */
+	arg = name;
+	while (*arg != 0)
+	  {
+	     unsigned char uch;
+
+	     uch = (unsigned char) *arg;
+
+	     if (uch <= 32)
+	       {
+		  log_error (_("%s: line %u: Group name contains whitespace."),
+			      Active_Groups_File, num);
+		  fclose (fp);
+		  return -1;
+	       }
+	     arg++;
+	  }
+
+	max_to_get = default_max_to_get;
+	expire_days = default_expire_days;
+	headers_only = default_headers_only;
+	priority = default_priority;
+
+	arg = argv[1];
+
+	if (argc)
+	  {
+	     if ((*arg != '*') &&
+		 ((1 != sscanf (arg, "%d", &max_to_get))
+		  || (max_to_get < 0)))
+	       {
+		  log_error (_("%s: line %u: expecting positive integer in second field."),
+			      Active_Groups_File, num);
+		  fclose (fp);
+		  return -1;
+	       }
+	     argc--;
+	  }
+
+	arg = argv[2];
+	if (argc)
+	  {
+	     if ((*arg != '*') &&
+		 ((1 != sscanf (arg, "%d", &expire_days))
+		  || (expire_days < 0)))
+	       {
+		  log_error (_("%s: line %u: expecting positive integer in third field."),
+			      Active_Groups_File, num);
+		  fclose (fp);
+		  return -1;
+	       }
+	     argc--;
+	  }
+
+	arg = argv[3];
+	if (argc)
+	  {
+	     if ((*arg != '*') &&
+		 ((1 != sscanf (arg, "%d", &headers_only))
+		  || ((headers_only != 0) && (headers_only != 1))))
+	       {
+		  log_error (_("%s: line %u: expecting 0 or 1 in fourth field."),
+			     Active_Groups_File, num);
+		  fclose (fp);
+		  return -1;
+	       }
+	     argc--;
+	  }
+
+	arg = argv[4];
+	if (argc)
+	  {
+	     if ((*arg != '*') &&
+		 (1 != sscanf (arg, "%d", &priority)))
+	       {
+		  log_error (_("%s: line %u: expecting integer in fifth field."),
+			     Active_Groups_File, num);
+		  fclose (fp);
+		  return -1;
+	       }
+	     argc--;
+	  }
+
+	if (0 == strcmp (name, "default"))
+	  {
+	     default_expire_days = expire_days;
+	     default_max_to_get = max_to_get;
+	     default_headers_only = headers_only;
+	     default_priority = priority;
+	     continue;
+	  }
+
+	if (NULL != find_group_type (name))
+	  {
+	     log_error (_("%s: line %u: group duplicated."),
+			 Active_Groups_File, num);
+	     fclose (fp);
+	     return -1;
+	  }
+
+	if (NULL == (g = add_group_type (name)))
+	  {
+	     log_error (_("%s: line %u: failed to add %s."),
+			 Active_Groups_File, num, name);
+	     fclose (fp);
+	     return -1;
+	  }
+
+	g->max_to_get = (unsigned int) max_to_get;
+	g->expire_days = (unsigned int) expire_days;
+	g->headers_only = headers_only;
+	g->priority = priority;
+
+	if (-1 == create_group_directory (g))
+	  {
+	     fclose (fp);
+	     return -1;
+	  }
+     }
+
+   fclose (fp);
+   sort_active_groups ();
+   return 0;
+}
+
+/*}}}*/
+
+static char *do_dircat (char *dir, char *name)
+{
+   char *f;
+
+   if (slrn_is_absolute_path (name))
+     f = slrn_strmalloc (name, 0);
+   else
+     f = slrn_spool_dircat (dir, name, 0);
+
+   if (f == NULL)
+     {
+	Exit_Code = SLRN_EXIT_MALLOC_FAILED;
+	slrn_exit_error (_("Out of memory."));
+     }
+
+#if defined(__os2__) || defined(__NT__)
+   slrn_os2_convert_path (f);
+#endif
+
+   return f;
+}
+
+static char *root_dircat (char *name) /*{{{*/
+{
+   return do_dircat (SlrnPull_Dir, name);
+}
+
+/*}}}*/
+
+static char *data_dircat (char *name) /*{{{*/
+{
+   return do_dircat (Data_Dir, name);
+}
+
+/*}}}*/
+
+static int make_filenames (void) /*{{{*/
+{
+   Data_Dir = root_dircat (Data_Dir);
+   Outgoing_Dir = root_dircat (SLRNPULL_OUTGOING_DIR);
+   Requests_Dir = root_dircat (SLRNPULL_REQUESTS_DIR);
+
+   Active_Groups_File = root_dircat (SLRNPULL_CONF);
+   SlrnPull_Spool_News_Dir = root_dircat (SLRNPULL_NEWS_DIR);
+
+   New_Groups_Time_File = data_dircat (New_Groups_Time_File);
+   Active_File = data_dircat (Active_File);
+   New_Groups_File = data_dircat (New_Groups_File);
+
+   Outgoing_Bad_Dir = slrn_spool_dircat (Outgoing_Dir, SLRNPULL_OUTGOING_BAD_DIR, 0);
+   if (Outgoing_Bad_Dir == NULL)
+     {
+	Exit_Code = SLRN_EXIT_MALLOC_FAILED;
+	slrn_exit_error (_("Out of memory."));
+     }
+
+   if (-1 == do_mkdir (SlrnPull_Spool_News_Dir, 1))
+     return -1;
+
+   if (-1 == do_mkdir (Data_Dir, 1))
+     return -1;
+
+   Overview_File = SLRN_SPOOL_NOV_FILE;
+   Group_Min_Max_File = ".minmax";
+   Server_Min_File = ".servermin";
+   Pending_File = ".pending";
+   Article_Index_File = SLRN_SPOOL_ARTINDEX;
+
+   return 0;
+}
+
+/*}}}*/
+
+static NNTP_Artnum_Type *listgroup_numbers (NNTP_Type *s, Active_Group_Type *g, unsigned int *nump) /*{{{*/
+{
+   NNTP_Artnum_Type *numbers;
+   NNTP_Artnum_Type maxnum, curnum;
+   unsigned int max, num;
+   char buf[256];
+   int status;
+
+   status = nntp_listgroup (s, g->name);
+   if (status != OK_GROUP)
+     {
+	if (status == -1) log_error (_("Read failed."));
+	log_error (_("listgroup %s failed: %s"), g->name, nntp_map_code_to_string (status));
+	return NULL;
+     }
+
+   max = 0;
+   num = 0;
+   maxnum = 0;
+   numbers = NULL;
+
+   while (1 == (status = nntp_read_line (s, buf, sizeof (buf))))
+     {
+	if (num == max)
+	  {
+	     NNTP_Artnum_Type *newnums;
+
+	     max += 1000;
+	     newnums = (NNTP_Artnum_Type *) slrn_realloc ((char *) numbers, max * sizeof (NNTP_Artnum_Type), 1);
+	     if (newnums == NULL)
+	       {
+		  slrn_free ((char *)numbers);
+		  nntp_discard_output (s);
+		  return NULL;
+	       }
+	     numbers = newnums;
+	  }
+	curnum = NNTP_STR_TO_ARTNUM (buf);
+	if (curnum > maxnum) maxnum = curnum;
+	numbers[num] = curnum;
+	num++;
+     }
+
+   if (status == -1)
+     {
+	slrn_free ((char *) numbers);
+	return NULL;
+     }
+
+   *nump = num;
+   if (g->server_max < maxnum)
+     g->server_max = maxnum;
+   return numbers;
+}
+
+/*}}}*/
+
+static unsigned int Num_Duplicates;
+
+/* This function returns a malloc'ed array that contains all article numbers
+ * in group g on server s. *nump is set to the length of the array.
+ * If article numbers larger than g->server_max are found, that variable
+ * gets updated. */
+static NNTP_Artnum_Type *
+  list_server_numbers (NNTP_Type *s, Active_Group_Type *g,
+		       NNTP_Artnum_Type server_min, NNTP_Artnum_Type server_max,
+		       unsigned int *nump) /*{{{*/
+{
+   char *name;
+   NNTP_Artnum_Type min, max;
+   int status;
+   char buf [512];
+   NNTP_Artnum_Type *numbers;
+   unsigned int num_numbers, max_num_numbers;
+
+   *nump = 0;
+
+   name = g->name;
+   if (1 != nntp_has_cmd (s, "XHDR"))
+     return listgroup_numbers (s, g, nump);
+
+   /* Server seems to have XHDR.  Good. */
+   min = g->min;
+   max = g->max + 1;
+   if (max < min) max = min;
+
+   /* If this is the first time this group has been visited, then do not grab
+    * all the message-ids when the user specifies a limit to grab.
+    */
+   if ((max <= 1) && (g->max_to_get != 0)
+       && (server_max + 1 > server_min + g->max_to_get))
+     {
+	max = server_max - g->max_to_get + 1;
+	if (server_max >= server_min)
+	  log_message (_("The server may contain as many as " NNTP_FMT_ARTNUM  " articles in this group"),
+		       server_max - server_min + 1);
+	log_message (_("Only examining last %u articles since this is a new group"), g->max_to_get);
+     }
+
+   status = nntp_server_vcmd (s, ("XHDR Message-ID " NNTP_FMT_ARTNUM "-"), max);
+   if (status == -1)
+     {
+	log_error (_("Server failed to return proper code for XHDR.  The connection may be lost"));
 	return NULL;			       /* server closed? */
      }
-   if (status == 224) status = OK_HEAD;/* Micro$oft broken server */
-   if (status == ERR_ACCESS)
-     { /* Command disabled by administrator. When we first test this outside
-	* the group, the server won't tell us. Fall back to LISTGROUP ... */
-	return listgroup_numbers (s, g, nump);
+   if (status == 224) status = OK_HEAD;/* Micro$oft broken server */
+   if (status == ERR_ACCESS)
+     { /* Command disabled by administrator. When we first test this outside
+	* the group, the server won't tell us. Fall back to LISTGROUP ... */
+	return listgroup_numbers (s, g, nump);
+     }
+   if (status != OK_HEAD)
+     {
+	log_error (_("Server failed XHDR command: %s"), s->rspbuf);
+	return NULL;
+     }
+
+   num_numbers = 0;
+   max_num_numbers = 0;
+   numbers = NULL;
+
+   min = max;
+   while (1 == (status = nntp_read_line (s, buf, sizeof (buf))))
+     {
+	NNTP_Artnum_Type num;
+	char *b1, *b2;
+
+	num = NNTP_STR_TO_ARTNUM (buf);
+	b1 = slrn_strbyte (buf, '<');
+	if (b1 == NULL)
+	  {
+	     /* defective server?? */
+	     continue;
+	  }
+	b2 = slrn_strbyte (b1, '>');
+	if (b2 == NULL) continue;
+
+	b2++;
+	*b2 = 0;
+
+	if (num > max) max = num;
+
+	if (NULL != is_msgid_cached (b1, name, num, 0))
+	  {
+	     if (g->min > g->max) g->min = num;
+	     g->max = max;	       /* was: g->max = num */
+
+	     if (g->server_max < num) g->server_max = num;
+
+	     Num_Duplicates++;
+	     continue;
+	  }
+
+	if (num_numbers == max_num_numbers)
+	  {
+	     NNTP_Artnum_Type *newnums;
+
+	     max_num_numbers += 100;
+	     newnums = (NNTP_Artnum_Type *) slrn_realloc ((char *) numbers, max_num_numbers * sizeof (NNTP_Artnum_Type), 1);
+	     if (newnums == NULL)
+	       {
+		  slrn_free ((char *)numbers);
+		  nntp_discard_output (s);
+		  return NULL;
+	       }
+	     numbers = newnums;
+	  }
+	numbers [num_numbers] = num;
+	num_numbers++;
+     }
+
+   log_message (_("%s: Retrieving %s " NNTP_FMT_ARTRANGE "."), g->name,
+		g->headers_only ? _("headers") : _("articles"),
+		min, max);
+   if (num_numbers) g->server_max = max;
+   /* Otherwise, there were no unique articles in that range. */
+
+   if (status == -1)
+     {
+	slrn_free ((char *) numbers);
+	return NULL;
+     }
+
+   /* If there were no articles in the requested range, update g->max now
+    * so that we do not have to try this range next time.
+    *
+    * Unfortunately, this does not seem possible since the articles in the
+    * requested range may have been cancelled and the server may reuse the
+    * article numbers (yuk).  Note also that g->max has already been updated
+    * for duplicate articles.
+    */
+   if (numbers == NULL)
+     {
+#if 0
+	g->max = max;
+#else
+	log_message (_("%s: No articles in specified range."), g->name);
+#endif
+     }
+
+   *nump = num_numbers;
+   return numbers;
+}
+
+/*}}}*/
+
+static unsigned int Num_Killed;
+static unsigned int Num_Articles_Received;
+static unsigned int Num_Articles_To_Receive;
+
+static void print_time_stats (NNTP_Type *s, int do_log) /*{{{*/
+{
+   time_t now;
+   unsigned long in;
+   unsigned long elapsed_time;
+   unsigned int hour, min, sec;
+
+   if ((Stdout_Is_TTY == 0) && (do_log == 0))
+     return;
+
+   if ((s == NULL) || (s->tcp == NULL))
+     return;
+
+   time (&now);
+
+   elapsed_time = (unsigned long) now - (unsigned long) Start_Time;
+
+   if (elapsed_time == 0)
+     {
+	if (do_log == 0) return;
+	elapsed_time = 1;
+     }
+
+   in = sltcp_get_num_input_bytes (s->tcp);
+
+   hour = elapsed_time / 3600;
+   min = (elapsed_time - 3600 * hour) / 60;
+   sec = elapsed_time % 60;
+
+   if (Stdout_Is_TTY)
+     {
+
+	fprintf (stdout, _("%u/%u (%u killed), Time: %02u:%02u:%02u, BPS: %lu      "),
+		 Num_Articles_Received, Num_Articles_To_Receive, Num_Killed,
+		 hour, min, sec,
+		 (unsigned long) (in / elapsed_time));
+	fputc ('\r', stdout);
+	fflush (stdout);
+     }
+
+   if (do_log)
+     {
+	log_message (_("%s: %u/%u (%u killed), Time: %02u:%02u:%02u, BPS: %lu"),
+		     Current_Group->name,
+		     Num_Articles_Received, Num_Articles_To_Receive, Num_Killed,
+		     hour, min, sec,
+		     in / elapsed_time);
+     }
+}
+
+/*}}}*/
+
+/*{{{ Budgets */
+
+/* Bytes transferred over connections that have already been closed */
+static unsigned long Closed_Bytes_In, Closed_Bytes_Out;
+
+/* If non-zero, slrnpull stops pulling once this many bytes were received
+ * or this many seconds have passed since it was started.  The articles of
+ * the group that was being pulled are recorded in its pending file; the
+ * groups that were not reached keep their article ranges.  Either way, the
+ * next run picks up where this one stopped.
+ */
+static unsigned long Byte_Budget;
+static unsigned long Time_Budget;
+static time_t Budget_Start_Time;
+static int Budget_Exhausted;
+
+static int budget_exhausted (NNTP_Type *s) /*{{{*/
+{
+   unsigned long bytes;
+
+   if (Budget_Exhausted)
+     return 1;
+
+   if ((Time_Budget != 0)
+       && ((unsigned long) (time (NULL) - Budget_Start_Time) >= Time_Budget))
+     {
+	log_message (_("Time budget of %lu seconds used up."), Time_Budget);
+	Budget_Exhausted = 1;
+	return 1;
+     }
+
+   if (Byte_Budget == 0)
+     return 0;
+
+   bytes = Closed_Bytes_In;
+   if ((s != NULL) && (s->tcp != NULL))
+     bytes += sltcp_get_num_input_bytes (s->tcp);
+
+   if (bytes >= Byte_Budget)
+     {
+	log_message (_("Budget of %lu bytes used up."), Byte_Budget);
+	Budget_Exhausted = 1;
+     }
+   return Budget_Exhausted;
+}
+
+/*}}}*/
+
+/* Parses a number of bytes with an optional k, M or G suffix.  Returns 0
+ * if the string is not valid or the number is too large. */
+static unsigned long parse_byte_budget (char *str) /*{{{*/
+{
+   unsigned long val, factor = 1;
+   char *p;
+
+   errno = 0;
+   val = strtoul (str, &p, 10);
+   switch (*p)
+     {
+      case 'k': case 'K':
+	factor = 1024UL; p++;
+	break;
+      case 'm': case 'M':
+	factor = 1024UL * 1024UL; p++;
+	break;
+      case 'g': case 'G':
+	factor = 1024UL * 1024UL * 1024UL; p++;
+	break;
+     }
+   if ((p == str) || (*p != 0))
+     return 0;
+
+   if ((errno == ERANGE) || (val > ULONG_MAX / factor))
+     {
+	fprintf (stderr, _("%s bytes is too large.\n"), str);
+	return 0;
+     }
+   return val * factor;
+}
+
+/*}}}*/
+
+/* Articles that get fetched first when there is a budget */
+typedef struct
+{
+   NNTP_Artnum_Type num;
+   int score;
+}
+Scored_Article_Type;
+
+static int scored_article_cmp (Scored_Article_Type *a, Scored_Article_Type *b) /*{{{*/
+{
+   if (a->score != b->score)
+     return (a->score > b->score) ? -1 : 1;
+   if (a->num != b->num)
+     return (a->num < b->num) ? -1 : 1;
+   return 0;
+}
+
+/*}}}*/
+
+/* Sorts numbers[] by descending score, so that the best articles are
+ * fetched before the budget runs out. */
+static void sort_numbers_by_score (NNTP_Artnum_Type *numbers, int *scores, /*{{{*/
+				   unsigned int num)
+{
+   Scored_Article_Type *arts;
+   void (*qsort_fun) (char *, unsigned int, int,
+		      int (*)(Scored_Article_Type *, Scored_Article_Type *));
+   unsigned int i;
+
+   if (num < 2)
+     return;
+
+   arts = (Scored_Article_Type *) slrn_malloc (num * sizeof (Scored_Article_Type), 0, 1);
+   if (arts == NULL)
+     return;
+
+   for (i = 0; i < num; i++)
+     {
+	arts[i].num = numbers[i];
+	arts[i].score = scores[i];
+     }
+
+   qsort_fun = (void (*)(char *, unsigned int, int,
+			 int (*)(Scored_Article_Type *, Scored_Article_Type *))) qsort;
+   (*qsort_fun) ((char *) arts, num, sizeof (Scored_Article_Type), scored_article_cmp);
+
+   for (i = 0; i < num; i++)
+     numbers[i] = arts[i].num;
+
+   slrn_free ((char *) arts);
+}
+
+/*}}}*/
+
+/*}}}*/
+
+/*{{{ Pipelining */
+
+#ifndef SLRN_MAX_QUEUED
+# define SLRN_MAX_QUEUED 10
+#endif
+#define SLRNPULL_MIN_PIPELINE	2
+#define SLRNPULL_MAX_PIPELINE	64
+
+/* The number of commands that are kept outstanding while fetching
+ * articles.  It is adapted to the bandwidth-delay product of the
+ * connection: the round trip time is measured on the GROUP command, and
+ * the throughput while fetching.  If there is no clock with sub-second
+ * resolution, it stays at SLRN_MAX_QUEUED.
+ */
+static unsigned int Pipeline_Depth = SLRN_MAX_QUEUED;
+static unsigned long Rtt_Usecs;
+
+/* Returns a time stamp in microseconds, or 0 if that is not available. */
+static unsigned long get_usecs (void) /*{{{*/
+{
+#ifdef HAVE_GETTIMEOFDAY
+   struct timeval tv;
+
+   if (0 == gettimeofday (&tv, NULL))
+     return (unsigned long) tv.tv_sec * 1000000UL + (unsigned long) tv.tv_usec;
+#endif
+   return 0;
+}
+
+/*}}}*/
+
+static void add_rtt_sample (unsigned long start) /*{{{*/
+{
+   unsigned long rtt;
+
+   if (start == 0)
+     return;
+
+   rtt = get_usecs () - start;
+   if (rtt == 0)
+     return;
+
+   if (Rtt_Usecs == 0)
+     Rtt_Usecs = rtt;
+   else
+     Rtt_Usecs = (3 * Rtt_Usecs + rtt) / 4;
+}
+
+/*}}}*/
+
+/* Called after num_responses responses were received in usecs
+ * microseconds.  To keep the link busy, twice as many commands as complete
+ * within one round trip are kept outstanding.
+ */
+static void update_pipeline_depth (unsigned int num_responses, unsigned long usecs) /*{{{*/
+{
+   double target;
+   unsigned int depth;
+
+   if ((Rtt_Usecs == 0) || (usecs == 0) || (num_responses == 0))
+     return;
+
+   target = 1.0 + 2.0 * num_responses * ((double) Rtt_Usecs / (double) usecs);
+   if (target > SLRNPULL_MAX_PIPELINE)
+     target = SLRNPULL_MAX_PIPELINE;
+
+   depth = (Pipeline_Depth + (unsigned int) target + 1) / 2;
+   if (depth < SLRNPULL_MIN_PIPELINE)
+     depth = SLRNPULL_MIN_PIPELINE;
+   if (depth > SLRNPULL_MAX_PIPELINE)
+     depth = SLRNPULL_MAX_PIPELINE;
+
+   Pipeline_Depth = depth;
+}
+
+/*}}}*/
+
+/*}}}*/
+
+static int write_xover_line (FILE *fp, Slrn_XOver_Type *xov) /*{{{*/
+{
+   if (fp == NULL)
+     return 0;
+
+#if CREATE_OVERVIEW
+   if ((EOF == fprintf (fp,
+			(NNTP_FMT_ARTNUM "\t%s\t%s\t%s\t%s\t%s\t%d\t%d"),
+			xov->id, xov->subject_malloced,
+			xov->from, xov->date_malloced, xov->message_id,
+			xov->references, xov->bytes, xov->lines))
+       || ((xov->xref != NULL) && (xov->xref[0] != 0)
+	   && (EOF == fprintf (fp, "\tXref: %s", xov->xref)))
+       || (EOF == fputc ('\n', fp)))
+     {
+	log_error (_("Error writing to overview database:%s:" NNTP_FMT_ARTNUM), Current_Group->name, xov->id);
+	return -1;
+     }
+#else
+   (void) xov;
+#endif
+   return 0;
+}
+
+/*}}}*/
+
+static int make_article_filename (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
+				  char *file, size_t size)
+{
+   char buf[256];
+
+   (void) SLsnprintf (buf, sizeof (buf), NNTP_FMT_ARTNUM, n);
+
+   if ((-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, file, size))
+       || (-1 == slrn_dircat (file, buf, file, size)))
+     return -1;
+
+   return 0;
+}
+
+/*}}}*/
+
+#define SPOOL_WRITE_BUFFER_SIZE	0x10000
+
+/*{{{ Packed spool */
+
+/* See the article index for the format of the segments.  Only one segment
+ * (the last one of the group that is being pulled) is open for writing.
+ */
+static int Packed_Spool;
+static FILE *Segment_Fp;
+static Active_Group_Type *Segment_Group;
+static unsigned int Segment_Num;
+static long Segment_Record_Start;      /* of the article being written */
+static long Segment_Data_Start;
+static time_t Segment_Record_Time;
+
+/* The index of Segment_Group, to find the articles that get their body
+ * in the marked-bodies mode. */
+static Article_Index_Type *Packed_Entries;
+static unsigned int Num_Packed_Entries;
+
+static unsigned int find_last_segment (char *dir) /*{{{*/
+{
+   Slrn_Dir_Type *dp;
+   Slrn_Dirent_Type *df;
+   unsigned int len = strlen (SLRN_SPOOL_SEGMENT);
+   unsigned int last = 0;
+
+   if (NULL == (dp = slrn_open_dir (dir)))
+     return 0;
+
+   while (NULL != (df = slrn_read_dir (dp)))
+     {
+	unsigned int seg;
+	char ch;
+
+	if ((0 == strncmp (df->name, SLRN_SPOOL_SEGMENT, len))
+	    && (1 == sscanf (df->name + len, "%u%c", &seg, &ch))
+	    && (seg > last))
+	  last = seg;
+     }
+   slrn_close_dir (dp);
+   return last;
+}
+
+/*}}}*/
+
+/* Closes the current segment.  The next article goes to a new one. */
+static void abandon_segment (void) /*{{{*/
+{
+   if (Segment_Fp != NULL)
+     (void) fclose (Segment_Fp);
+   Segment_Fp = NULL;
+   Segment_Num++;
+}
+
+/*}}}*/
+
+static void close_segment (void) /*{{{*/
+{
+   if ((Segment_Fp != NULL)
+       && (-1 == slrn_fclose (Segment_Fp)))
+     log_error (_("Error closing segment %u of %s."), Segment_Num, Segment_Group->name);
+
+   Segment_Fp = NULL;
+   Segment_Group = NULL;
+   Segment_Num = 0;
+
+   slrn_free ((char *) Packed_Entries);
+   Packed_Entries = NULL;
+   Num_Packed_Entries = 0;
+}
+
+/*}}}*/
+
+/* Starts a new article in the last segment of g and returns the segment.
+ * file must have room for SLRN_MAX_PATH_LEN + 1 characters; the name of
+ * the segment is put there. */
+static FILE *open_segment_record (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
+				  char *file)
+{
+   char dir [SLRN_MAX_PATH_LEN + 1];
+
+   if (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, dir, sizeof (dir)))
+     return NULL;
+
+   if (Segment_Group != g)
+     {
+	close_segment ();
+	Segment_Group = g;
+     }
+   if (Segment_Num == 0)
+     {
+	if (0 == (Segment_Num = find_last_segment (dir)))
+	  Segment_Num = 1;
+     }
+
+   if (-1 == make_segment_filename (dir, Segment_Num, file, SLRN_MAX_PATH_LEN + 1))
+     return NULL;
+
+   if (Segment_Fp == NULL)
+     {
+	if ((NULL == (Segment_Fp = fopen (file, "r+b")))
+	    && (NULL == (Segment_Fp = fopen (file, "w+b"))))
+	  {
+	     log_error (_("Unable to open %s for writing."), file);
+	     return NULL;
+	  }
+	(void) setvbuf (Segment_Fp, NULL, _IOFBF, SPOOL_WRITE_BUFFER_SIZE);
+     }
+
+   Segment_Record_Time = time (NULL);
+
+   if ((-1 == fseek (Segment_Fp, 0, SEEK_END))
+       || (-1 == (Segment_Record_Start = ftell (Segment_Fp)))
+       || (EOF == fprintf (Segment_Fp, SEGMENT_HEADER_FMT, 'x', n, 0UL,
+			   (unsigned long) Segment_Record_Time))
+       || (-1 == (Segment_Data_Start = ftell (Segment_Fp))))
+     {
+	log_error (_("Error writing to %s."), file);
+	abandon_segment ();
+	return NULL;
      }
-   if (status != OK_HEAD)
+
+   return Segment_Fp;
+}
+
+/*}}}*/
+
+/* Completes the header of the article that was started by
+ * open_segment_record.  If ok is zero, the article is marked as invalid.
+ * Returns 0 if the article was stored. */
+static int close_segment_record (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
+				 char *file, int ok, int has_body)
+{
+   Article_Index_Type e;
+   long end;
+
+   if ((-1 == (end = ftell (Segment_Fp)))
+       || (-1 == fseek (Segment_Fp, Segment_Record_Start, SEEK_SET))
+       || (EOF == fprintf (Segment_Fp, SEGMENT_HEADER_FMT, (ok ? 'a' : 'x'), n,
+			   (unsigned long) (end - Segment_Data_Start),
+			   (unsigned long) Segment_Record_Time))
+       || (-1 == fseek (Segment_Fp, 0, SEEK_END))
+       || (EOF == fflush (Segment_Fp)))
      {
-	log_error (_("Server failed XHDR command: %s"), s->rspbuf);
+	log_error (_("Error writing to %s."), file);
+	abandon_segment ();
+	return -1;
+     }
+
+   if (ok == 0)
+     return -1;
+
+   e.num = n;
+   e.time = Segment_Record_Time;
+   e.size = (unsigned long) (end - Segment_Data_Start);
+   e.has_body = has_body;
+   e.seg = Segment_Num;
+   e.offset = (unsigned long) Segment_Data_Start;
+   add_to_article_index (g, &e);
+
+   if (end >= SLRNPULL_SEGMENT_SIZE)
+     {
+	if (-1 == slrn_fclose (Segment_Fp))
+	  log_error (_("Error writing to %s."), file);
+	Segment_Fp = NULL;
+	Segment_Num++;
+     }
+   return 0;
+}
+
+/*}}}*/
+
+/* Returns the segment of e, positioned at the start of the article. */
+static FILE *open_packed_article (char *dir, Article_Index_Type *e) /*{{{*/
+{
+   char file [SLRN_MAX_PATH_LEN + 1];
+   FILE *fp;
+
+   if ((-1 == make_segment_filename (dir, e->seg, file, sizeof (file)))
+       || (NULL == (fp = fopen (file, "rb"))))
+     return NULL;
+
+   if (-1 == fseek (fp, (long) e->offset, SEEK_SET))
+     {
+	fclose (fp);
 	return NULL;
      }
+   return fp;
+}
 
-   num_numbers = 0;
-   max_num_numbers = 0;
-   numbers = NULL;
+/*}}}*/
 
-   min = max;
-   while (1 == (status = nntp_read_line (s, buf, sizeof (buf))))
+static Article_Index_Type *find_packed_article (Active_Group_Type *g, /*{{{*/
+						NNTP_Artnum_Type n)
+{
+   Article_Index_Type *e;
+
+   if (Segment_Group != g)
      {
-	NNTP_Artnum_Type num;
-	char *b1, *b2;
+	close_segment ();
+	Segment_Group = g;
+     }
 
-	num = NNTP_STR_TO_ARTNUM (buf);
-	b1 = slrn_strbyte (buf, '<');
-	if (b1 == NULL)
-	  {
-	     /* defective server?? */
-	     continue;
-	  }
-	b2 = slrn_strbyte (b1, '>');
-	if (b2 == NULL) continue;
+   if (Packed_Entries == NULL)
+     {
+	if (Article_Index_Fp != NULL)
+	  (void) fflush (Article_Index_Fp);
+	(void) read_article_index (g, &Packed_Entries, &Num_Packed_Entries);
+     }
 
-	b2++;
-	*b2 = 0;
+   e = find_article_index_entry (Packed_Entries, Num_Packed_Entries, n);
+   if ((e == NULL) || (e->seg == 0))
+     return NULL;
+   return e;
+}
 
-	if (num > max) max = num;
+/*}}}*/
 
-	if (NULL != is_msgid_cached (b1, name, num, 0))
-	  {
-	     if (g->min > g->max) g->min = num;
-	     g->max = max;	       /* was: g->max = num */
+static int copy_bytes (FILE *in, FILE *out, unsigned long len) /*{{{*/
+{
+   char buf [4096];
 
-	     if (g->server_max < num) g->server_max = num;
+   while (len > 0)
+     {
+	size_t n = sizeof (buf);
 
-	     Num_Duplicates++;
-	     continue;
-	  }
+	if (n > len)
+	  n = len;
+	if ((n != fread (buf, 1, n, in))
+	    || (n != fwrite (buf, 1, n, out)))
+	  return -1;
+	len -= n;
+     }
+   return 0;
+}
 
-	if (num_numbers == max_num_numbers)
-	  {
-	     NNTP_Artnum_Type *newnums;
+/*}}}*/
 
-	     max_num_numbers += 100;
-	     newnums = (NNTP_Artnum_Type *) slrn_realloc ((char *) numbers, max_num_numbers * sizeof (NNTP_Artnum_Type), 1);
-	     if (newnums == NULL)
-	       {
-		  slrn_free ((char *)numbers);
-		  nntp_discard_output (s);
-		  return NULL;
-	       }
-	     numbers = newnums;
-	  }
-	numbers [num_numbers] = num;
-	num_numbers++;
+/* Copies the valid articles of segment seg (file) in dir to the new
+ * segment new_seg and updates their entries.  The old segment is kept:
+ * it must not be removed before the index that points to the new one has
+ * been written.  A reader that still uses the old index then finds the
+ * segment missing instead of getting the bytes of another article. */
+static int rewrite_segment (char *dir, char *file, unsigned int seg, /*{{{*/
+			    unsigned int new_seg,
+			    Article_Index_Type *entries, unsigned int num)
+{
+   char new_file [SLRN_MAX_PATH_LEN + 1];
+   char tmp_file [SLRN_MAX_PATH_LEN + 5];
+   unsigned long *offsets;
+   FILE *in, *out;
+   unsigned int i, n;
+   int ok;
+
+   n = 0;
+   for (i = 0; i < num; i++)
+     {
+	if ((entries[i].seg == seg) && (entries[i].size != (unsigned long) -1))
+	  n++;
      }
+   if (n == 0)
+     return 0;
 
-   log_message (_("%s: Retrieving %s " NNTP_FMT_ARTRANGE "."), g->name,
-		g->headers_only ? _("headers") : _("articles"),
-		min, max);
-   if (num_numbers) g->server_max = max;
-   /* Otherwise, there were no unique articles in that range. */
+   if (-1 == make_segment_filename (dir, new_seg, new_file, sizeof (new_file)))
+     return -1;
 
-   if (status == -1)
+   if (NULL == (offsets = (unsigned long *) slrn_malloc (n * sizeof (unsigned long), 0, 1)))
+     return -1;
+
+   (void) SLsnprintf (tmp_file, sizeof (tmp_file), "%s.tmp", new_file);
+   in = fopen (file, "rb");
+   out = fopen (tmp_file, "wb");
+   ok = ((in != NULL) && (out != NULL));
+
+   n = 0;
+   for (i = 0; ok && (i < num); i++)
      {
-	slrn_free ((char *) numbers);
-	return NULL;
+	Article_Index_Type *e = entries + i;
+	long pos = -1;
+
+	if ((e->seg != seg) || (e->size == (unsigned long) -1))
+	  continue;
+
+	ok = ((EOF != fprintf (out, SEGMENT_HEADER_FMT, 'a', e->num, e->size,
+			       (unsigned long) e->time))
+	      && (-1 != (pos = ftell (out)))
+	      && (-1 != fseek (in, (long) e->offset, SEEK_SET))
+	      && (-1 != copy_bytes (in, out, e->size)));
+	if (ok)
+	  offsets[n++] = (unsigned long) pos;
      }
 
-   /* If there were no articles in the requested range, update g->max now
-    * so that we do not have to try this range next time.
-    *
-    * Unfortunately, this does not seem possible since the articles in the
-    * requested range may have been cancelled and the server may reuse the
-    * article numbers (yuk).  Note also that g->max has already been updated
-    * for duplicate articles.
-    */
-   if (numbers == NULL)
+   if (in != NULL)
+     fclose (in);
+   if ((out != NULL) && (-1 == slrn_fclose (out)))
+     ok = 0;
+
+   if ((ok == 0) || (-1 == slrn_move_file (tmp_file, new_file)))
      {
-#if 0
-	g->max = max;
-#else
-	log_message (_("%s: No articles in specified range."), g->name);
-#endif
+	log_error (_("Unable to compact %s."), file);
+	(void) slrn_delete_file (tmp_file);
+	slrn_free ((char *) offsets);
+	return -1;
      }
 
-   *nump = num_numbers;
-   return numbers;
+   n = 0;
+   for (i = 0; i < num; i++)
+     {
+	if ((entries[i].seg == seg) && (entries[i].size != (unsigned long) -1))
+	  {
+	     entries[i].seg = new_seg;
+	     entries[i].offset = offsets[n++];
+	  }
+     }
+   slrn_free ((char *) offsets);
+   return 0;
 }
 
 /*}}}*/
 
-static unsigned int Num_Killed;
-static unsigned int Num_Articles_Received;
-static unsigned int Num_Articles_To_Receive;
+/* Removes the segments in dir that contain no valid articles any more and
+ * copies the articles of those that are more than half garbage to new
+ * segments.  Entries of expired articles have a size of -1.  The numbers
+ * of the segments that were copied are added to *oldp; they have to be
+ * removed with delete_segments once the index has been written.  Returns
+ * 1 if articles were moved (so that the index needs to be written), 0 if
+ * not.  The directory is only read if there are packed articles. */
+static int compact_segments (char *dir, Article_Index_Type *entries, /*{{{*/
+			     unsigned int num, Slrn_Range_Type **oldp)
+{
+   char file [SLRN_MAX_PATH_LEN + 1];
+   Slrn_Dir_Type *dp;
+   Slrn_Dirent_Type *df;
+   unsigned long *live = NULL;
+   unsigned int i, max_seg = 0, first_new_seg, new_seg;
+   unsigned int len = strlen (SLRN_SPOOL_SEGMENT);
+   int moved = 0;
 
-static void print_time_stats (NNTP_Type *s, int do_log) /*{{{*/
+   for (i = 0; i < num; i++)
+     {
+	if (entries[i].seg > max_seg)
+	  max_seg = entries[i].seg;
+     }
+
+   if (max_seg == 0)
+     return 0;
+
+   live = (unsigned long *) slrn_malloc ((max_seg + 1) * sizeof (unsigned long), 1, 1);
+   if (live == NULL)
+     return 0;
+
+   for (i = 0; i < num; i++)
+     {
+	if (entries[i].size != (unsigned long) -1)
+	  live [entries[i].seg] += entries[i].size;
+     }
+
+   /* The segments that are written here are skipped by the scan below. */
+   first_new_seg = new_seg = find_last_segment (dir) + 1;
+   if (first_new_seg <= max_seg)
+     first_new_seg = new_seg = max_seg + 1;
+
+   if (NULL == (dp = slrn_open_dir (dir)))
+     {
+	slrn_free ((char *) live);
+	return 0;
+     }
+
+   while (NULL != (df = slrn_read_dir (dp)))
+     {
+	unsigned long live_bytes;
+	unsigned int seg;
+	struct stat st;
+	char ch;
+
+	if ((0 != strncmp (df->name, SLRN_SPOOL_SEGMENT, len))
+	    || (1 != sscanf (df->name + len, "%u%c", &seg, &ch))
+	    || (seg >= first_new_seg)
+	    || (-1 == slrn_dircat (dir, df->name, file, sizeof (file)))
+	    || (-1 == stat (file, &st)))
+	  continue;
+
+	live_bytes = (seg <= max_seg) ? live [seg] : 0;
+
+	if (live_bytes == 0)
+	  {
+	     if (-1 == slrn_delete_file (file))
+	       log_error (_("Unable to delete %s."), file);
+	  }
+	else if ((2 * live_bytes < (unsigned long) st.st_size)
+		 && (0 == rewrite_segment (dir, file, seg, new_seg, entries, num)))
+	  {
+	     *oldp = slrn_ranges_add (*oldp, seg, seg);
+	     new_seg++;
+	     moved = 1;
+	  }
+     }
+
+   slrn_close_dir (dp);
+   slrn_free ((char *) live);
+   return moved;
+}
+
+/*}}}*/
+
+/* Removes the segments that were replaced by compact_segments. */
+static void delete_segments (char *dir, Slrn_Range_Type *r) /*{{{*/
 {
-   time_t now;
-   unsigned long in;
-   unsigned long elapsed_time;
-   unsigned int hour, min, sec;
+   char file [SLRN_MAX_PATH_LEN + 1];
+   NNTP_Artnum_Type seg;
 
-   if ((Stdout_Is_TTY == 0) && (do_log == 0))
-     return;
+   while (r != NULL)
+     {
+	for (seg = r->min; seg <= r->max; seg++)
+	  {
+	     if ((-1 == make_segment_filename (dir, (unsigned int) seg, file, sizeof (file)))
+		 || (-1 == slrn_delete_file (file)))
+	       log_error (_("Unable to delete %s."), file);
+	  }
+	r = r->next;
+     }
+}
 
-   if ((s == NULL) || (s->tcp == NULL))
-     return;
+/*}}}*/
 
-   time (&now);
+/*}}}*/
 
-   elapsed_time = (unsigned long) now - (unsigned long) Start_Time;
+/* Articles are written to a temporary file in the spool directory of the
+ * group first, which is renamed when it is complete.  So there are never
+ * partial articles in the spool, and an article is never held in memory as
+ * a whole.  Since the name of the temporary file does not consist of digits
+ * only, it is never taken for an article.  In a packed spool, the article
+ * is written to the end of the segment directly and marked as invalid if
+ * it cannot be completed.
+ */
 
-   if (elapsed_time == 0)
+/* file must have room for SLRN_MAX_PATH_LEN + 1 characters and tmp_file
+ * for SLRN_MAX_PATH_LEN + 5.
+ */
+static FILE *open_article_tmp_file (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
+				    char *file, char *tmp_file)
+{
+   FILE *fp;
+
+   if (-1 == make_article_filename (g, n, file, SLRN_MAX_PATH_LEN + 1))
+     return NULL;
+
+   if (Packed_Spool)
+     return open_segment_record (g, n, tmp_file);
+   (void) SLsnprintf (tmp_file, SLRN_MAX_PATH_LEN + 5, "%s.tmp", file);
+
+#ifdef __OS2__
+   fp = fopen (tmp_file, "wb");
+#else
+   fp = fopen (tmp_file, "w");
+#endif
+   if (fp == NULL)
      {
-	if (do_log == 0) return;
-	elapsed_time = 1;
+	log_error (_("Unable to open %s for writing."), tmp_file);
+	return NULL;
      }
 
-   in = sltcp_get_num_input_bytes (s->tcp);
+   (void) setvbuf (fp, NULL, _IOFBF, SPOOL_WRITE_BUFFER_SIZE);
+   return fp;
+}
 
-   hour = elapsed_time / 3600;
-   min = (elapsed_time - 3600 * hour) / 60;
-   sec = elapsed_time % 60;
+/*}}}*/
 
-   if (Stdout_Is_TTY)
+/* Closes fp.  If ok is non-zero, the temporary file is moved into place
+ * as article n of g; otherwise, it is removed.  Returns 0 if the article
+ * was stored. */
+static int close_article_tmp_file (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
+				   FILE *fp, char *file, char *tmp_file, int ok,
+				   int has_body)
+{
+   Article_Index_Type e;
+   struct stat st;
+
+   if (Packed_Spool)
+     return close_segment_record (g, n, tmp_file, ok, has_body);
+
+   /* Nothing is written after this, so the mtime is final. */
+   if ((0 != fflush (fp)) || (-1 == fstat (fileno (fp), &st)))
      {
+	st.st_mtime = time (NULL);
+	st.st_size = 0;
+     }
 
-	fprintf (stdout, _("%u/%u (%u killed), Time: %02u:%02u:%02u, BPS: %lu      "),
-		 Num_Articles_Received, Num_Articles_To_Receive, Num_Killed,
-		 hour, min, sec,
-		 (unsigned long) (in / elapsed_time));
-	fputc ('\r', stdout);
-	fflush (stdout);
+   if ((-1 == slrn_fclose (fp)) && ok)
+     {
+	log_error (_("Error writing to %s."), tmp_file);
+	ok = 0;
      }
 
-   if (do_log)
+   if (ok && (-1 == slrn_move_file (tmp_file, file)))
      {
-	log_message (_("%s: %u/%u (%u killed), Time: %02u:%02u:%02u, BPS: %lu"),
-		     Current_Group->name,
-		     Num_Articles_Received, Num_Articles_To_Receive, Num_Killed,
-		     hour, min, sec,
-		     in / elapsed_time);
+	log_error (_("Unable to rename %s to %s."), tmp_file, file);
+	ok = 0;
+     }
+
+   if (ok == 0)
+     {
+	slrn_delete_file (tmp_file);
+	return -1;
      }
+
+   e.num = n;
+   e.time = st.st_mtime;
+   e.size = (unsigned long) st.st_size;
+   e.has_body = has_body;
+   e.seg = 0;
+   e.offset = 0;
+   add_to_article_index (g, &e);
+   return 0;
 }
 
 /*}}}*/
 
-static int write_xover_line (FILE *fp, Slrn_XOver_Type *xov) /*{{{*/
+/* Copies the rest of a server response to fp.  Nothing is written unless
+ * *okp is non-zero; *okp is cleared if writing fails.  Returns -1 if the
+ * connection failed, 0 otherwise.
+ */
+static int copy_response_to_fp (NNTP_Type *s, FILE *fp, int *okp) /*{{{*/
 {
-   if (fp == NULL)
-     return 0;
+   char line [NNTP_BUFFER_SIZE];
+   int status;
 
-#if CREATE_OVERVIEW
-   if ((EOF == fprintf (fp,
-			(NNTP_FMT_ARTNUM "\t%s\t%s\t%s\t%s\t%s\t%d\t%d"),
-			xov->id, xov->subject_malloced,
-			xov->from, xov->date_malloced, xov->message_id,
-			xov->references, xov->bytes, xov->lines))
-       || ((xov->xref != NULL) && (xov->xref[0] != 0)
-	   && (EOF == fprintf (fp, "\tXref: %s", xov->xref)))
-       || (EOF == fputc ('\n', fp)))
+   while (1 == (status = nntp_read_line (s, line, sizeof (line))))
      {
-	log_error (_("Error writing to overview database:%s:" NNTP_FMT_ARTNUM), Current_Group->name, xov->id);
-	return -1;
+	if ((*okp != 0)
+	    && ((EOF == fputs (line, fp)) || (EOF == fputc ('\n', fp))))
+	  *okp = 0;
      }
-#else
-   (void) xov;
-#endif
-   return 0;
+
+   return (status == -1) ? -1 : 0;
 }
 
 /*}}}*/
 
-static int append_body (Active_Group_Type *g, NNTP_Artnum_Type n, char *body) /*{{{*/
+static int copy_file_to_fp (char *file, FILE *fp) /*{{{*/
 {
-   char file[SLRN_MAX_PATH_LEN + 1];
-   char buf[256];
-   FILE *fp;
-
-   (void) SLsnprintf (buf, sizeof(buf), NNTP_FMT_ARTNUM, n);
-
-   if ((-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname,
-			   file, sizeof (file)))
-       || (-1 == slrn_dircat (file, buf, file, sizeof (file))))
-     return -1;
+   char buf [4096];
+   FILE *in;
+   size_t n;
+   int ret = 0;
 
 #ifdef __OS2__
-   fp = fopen (file, "ab");
+   in = fopen (file, "rb");
 #else
-   fp = fopen (file, "a");
+   in = fopen (file, "r");
 #endif
-   if (fp == NULL)
+   if (in == NULL)
      {
-	log_error (_("Unable to open %s for writing."), file);
+	log_error (_("Unable to open %s."), file);
 	return -1;
      }
 
-   if ((EOF == fputc ('\n', fp)) ||
-       (EOF == fputs (body, fp)))
+   while (0 != (n = fread (buf, 1, sizeof (buf), in)))
      {
-	log_error (_("Error writing to %s."), file);
-	fclose (fp);
-	slrn_delete_file (file);
-	return -1;
+	if (n != fwrite (buf, 1, n, fp))
+	  {
+	     ret = -1;
+	     break;
+	  }
      }
 
-   if (-1 == slrn_fclose (fp))
+   fclose (in);
+   return ret;
+}
+
+/*}}}*/
+
+/* Copies article n of g, which is either in file or in a segment. */
+static int copy_stored_article (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
+				char *file, FILE *fp)
+{
+   char dir [SLRN_MAX_PATH_LEN + 1];
+   Article_Index_Type *e;
+   FILE *in;
+   int ret;
+
+   if (1 == slrn_file_exists (file))
+     return copy_file_to_fp (file, fp);
+
+   if ((NULL == (e = find_packed_article (g, n)))
+       || (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, dir, sizeof (dir)))
+       || (NULL == (in = open_packed_article (dir, e))))
      {
-	log_error (_("Error writing to %s."), file);
-	slrn_delete_file (file);
+	log_error (_("Unable to open %s."), file);
 	return -1;
      }
 
-   return 0;
+   ret = copy_bytes (in, fp, e->size);
+   fclose (in);
+   return ret;
 }
+
 /*}}}*/
 
 static int write_head_and_body (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*/
-				char *head, char *body,
+				char *head, int body_written,
 				Slrn_XOver_Type *xov, FILE *xov_fp)
 {
    char file [SLRN_MAX_PATH_LEN + 1];
-   char buf[256];
+   char tmp_file [SLRN_MAX_PATH_LEN + 5];
    FILE *fp;
 
    if (head == NULL)
@@ -1188,39 +2602,21 @@ static int write_head_and_body (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*
 	return 0;
      }
 
-   (void) SLsnprintf (buf, sizeof (buf), NNTP_FMT_ARTNUM, n);
-
-   if ((-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname,
-			   file, sizeof (file)))
-       || (-1 == slrn_dircat (file, buf, file, sizeof (file))))
-     return -1;
-
-#ifdef __OS2__
-   fp = fopen (file, "wb");
-#else
-   fp = fopen (file, "w");
-#endif
-   if (fp == NULL)
+   /* Otherwise, fetch_body_to_file has stored the whole article already. */
+   if (body_written == 0)
      {
-	log_error (_("Unable to open %s for writing."), file);
-	return -1;
-     }
+	if (NULL == (fp = open_article_tmp_file (g, n, file, tmp_file)))
+	  return -1;
 
-   if ((EOF == fputs (head, fp)) ||
-       ((body!=NULL) && ((EOF == fputc ('\n', fp)) ||
-			 (EOF == fputs (body, fp)))))
-     {
-	log_error (_("Error writing to %s."), file);
-	fclose (fp);
-	slrn_delete_file (file);
-	return -1;
-     }
+	if (EOF == fputs (head, fp))
+	  {
+	     log_error (_("Error writing to %s."), tmp_file);
+	     (void) close_article_tmp_file (g, n, fp, file, tmp_file, 0, 0);
+	     return -1;
+	  }
 
-   if (-1 == slrn_fclose (fp))
-     {
-	log_error (_("Error writing to %s."), file);
-	slrn_delete_file (file);
-	return -1;
+	if (-1 == close_article_tmp_file (g, n, fp, file, tmp_file, 1, 0))
+	  return -1;
      }
 
    if (-1 == write_xover_line (xov_fp, xov))
@@ -1234,11 +2630,19 @@ static int write_head_and_body (Active_Group_Type *g, NNTP_Artnum_Type n, /*{{{*
 
 /*}}}*/
 
-static int fetch_body (NNTP_Type *s, char **body) /*{{{*/
+/* Reads the response to a BODY command and stores the article in the
+ * spool.  If head is NULL, the header is taken from the article that is
+ * already in the spool (see get_marked_bodies).  Returns 1 if the article
+ * was stored, 0 if not, and -1 if the connection failed.
+ */
+static int fetch_body_to_file (NNTP_Type *s, Active_Group_Type *g, /*{{{*/
+			       NNTP_Artnum_Type n, char *head)
 {
-   int status;
-
-   *body = NULL;
+   char file [SLRN_MAX_PATH_LEN + 1];
+   char tmp_file [SLRN_MAX_PATH_LEN + 5];
+   FILE *fp;
+   int status, ok;
+   int has_body = 1;
 
    print_time_stats (s, 0);
 
@@ -1249,29 +2653,61 @@ static int fetch_body (NNTP_Type *s, char **body) /*{{{*/
    if (status != OK_BODY)
      return 0;
 
-   if (NULL == (*body = nntp_read_and_malloc (s)))
+   ok = 0;
+   if (NULL != (fp = open_article_tmp_file (g, n, file, tmp_file)))
+     {
+	if (head != NULL)
+	  ok = (EOF != fputs (head, fp));
+	else
+	  ok = (-1 != copy_stored_article (g, n, file, fp));
+
+	if (ok)
+	  ok = (EOF != fputc ('\n', fp));
+     }
+
+   status = copy_response_to_fp (s, fp, &ok);
+
+   if (fp != NULL)
+     {
+	if ((ok == 0) && (status != -1))
+	  log_error (_("Error writing to %s."), tmp_file);
+	if (-1 == close_article_tmp_file (g, n, fp, file, tmp_file, ok && (status != -1), has_body))
+	  ok = 0;
+     }
+
+   /* The header was taken from a file of its own, which is obsolete now. */
+   if (ok && Packed_Spool && (head == NULL) && (1 == slrn_file_exists (file)))
+     (void) slrn_delete_file (file);
+
+   if (status == -1)
      return -1;
 
-   return 0;
+   return ok;
 }
 
 /*}}}*/
 
-static int get_bodies (NNTP_Type *s, NNTP_Artnum_Type *numbers, /*{{{*/
-		       char **heads, char **bodies, unsigned int num)
+/* If heads is NULL, the bodies of all articles are requested; otherwise,
+ * only of those with a head.  Upon return, have_body[i] is non-zero if the
+ * whole article numbers[i] was stored.
+ */
+static int get_bodies (NNTP_Type *s, Active_Group_Type *g, /*{{{*/
+		       NNTP_Artnum_Type *numbers, char **heads,
+		       int *have_body, unsigned int num)
 {
    unsigned int i;
-   char buf[256], *b;
+   char buf[32*SLRNPULL_MAX_PIPELINE], *b;
    char *crlf;
+   int status;
 
    crlf = "";
    b = buf;
 
    for (i = 0; i < num; i++)
      {
-	bodies [i] = NULL;
+	have_body [i] = 0;
 
-	if (heads[i] == NULL)
+	if ((heads != NULL) && (heads[i] == NULL))
 	  continue;
 
 	(void) SLsnprintf (b, sizeof (buf) - (size_t)(b - buf),
@@ -1289,11 +2725,14 @@ static int get_bodies (NNTP_Type *s, NNTP_Artnum_Type *numbers, /*{{{*/
 
    for (i = 0; i < num; i++)
      {
-	if (heads [i] == NULL)
+	if ((heads != NULL) && (heads[i] == NULL))
 	  continue;
 
-	if (-1 == fetch_body (s, bodies + i))
+	if (-1 == (status = fetch_body_to_file (s, g, numbers[i],
+						(heads != NULL) ? heads[i] : NULL)))
 	  return -1;
+
+	have_body [i] = status;
      }
 
    return 0;
@@ -1308,12 +2747,55 @@ static void free_header_data (Slrn_Header_Type *h)
    slrn_free (h->from);
    slrn_free (h->date);
    slrn_free (h->msgid);
-   slrn_free (h->refs);
+   slrn_free_references (h->refs, h->num_refs);
    slrn_free (h->xref);
    slrn_free (h->realname);
    slrn_free_additional_headers (h->add_hdrs);
 }
 
+static void free_score_debug_info (Slrn_Score_Debug_Info_Type *sdi) /*{{{*/
+{
+   while (sdi != NULL)
+     {
+	Slrn_Score_Debug_Info_Type *hlp = sdi->next;
+	slrn_free ((char *)sdi);
+	sdi = hlp;
+     }
+}
+
+/*}}}*/
+
+/* Writes an entry for an article that was killed or requested to the
+ * kill log. */
+static void log_score (Slrn_Header_Type *h, int score, Slrn_Score_Debug_Info_Type *sdi) /*{{{*/
+{
+   if (KLog_Fp == NULL)
+     return;
+
+   if (score < Kill_Score)
+     fprintf (KLog_Fp, _("Score %d killed article %s\n"), score, h->msgid);
+   else
+     fprintf (KLog_Fp, _("Score %d requested article %s\n"), score, h->msgid);
+   while (sdi != NULL)
+     {
+	if (sdi->description [0] != 0)
+	  fprintf (KLog_Fp, _(" Score %c%5i: %s (%s:%i)\n"),
+		   (sdi->stop_here ? '=' : ' '), sdi->score,
+		   sdi->description, sdi->filename, sdi->linenumber);
+	else
+	  fprintf (KLog_Fp, _(" Score %c%5i: %s:%i\n"),
+		   (sdi->stop_here ? '=' : ' '), sdi->score,
+		   sdi->filename, sdi->linenumber);
+	sdi = sdi->next;
+     }
+   fprintf (KLog_Fp, _("  Newsgroup: %s\n  From: %s\n  Subject: %s\n\n"),
+	    Current_Group->name, h->from, h->subject);
+   /* Keep entries of parallel workers apart */
+   fflush (KLog_Fp);
+}
+
+/*}}}*/
+
 static int fetch_head (NNTP_Type *s,  Active_Group_Type *g, NNTP_Artnum_Type n, char **headers, Slrn_XOver_Type *xov) /*{{{*/
 {
    int status;
@@ -1358,28 +2840,7 @@ static int fetch_head (NNTP_Type *s,  Active_Group_Type *g, NNTP_Artnum_Type n,
    score = slrn_score_header (&h, Current_Group->name, (KLog_Fp != NULL) ? &sdi : NULL);
    if ((score < Kill_Score) || ((score >= Fetch_Score) && Use_Fetch_Score && g->headers_only))
      {
-	if (KLog_Fp != NULL)
-	  {
-	     Slrn_Score_Debug_Info_Type *hlp = sdi;
-	     if (score < Kill_Score)
-	       fprintf (KLog_Fp, _("Score %d killed article %s\n"), score, h.msgid);
-	     else
-	       fprintf (KLog_Fp, _("Score %d requested article %s\n"), score, h.msgid);
-	     while (hlp != NULL)
-	       {
-		  if (hlp->description [0] != 0)
-		    fprintf (KLog_Fp, _(" Score %c%5i: %s (%s:%i)\n"),
-			     (hlp->stop_here ? '=' : ' '), hlp->score,
-			     hlp->description, hlp->filename, hlp->linenumber);
-		  else
-		    fprintf (KLog_Fp, _(" Score %c%5i: %s:%i\n"),
-			     (hlp->stop_here ? '=' : ' '), hlp->score,
-			     hlp->filename, hlp->linenumber);
-		  hlp = hlp->next;
-	       }
-	     fprintf (KLog_Fp, _("  Newsgroup: %s\n  From: %s\n  Subject: %s\n\n"),
-		      Current_Group->name, h.from, h.subject);
-	  }
+	log_score (&h, score, sdi);
 	if (score < Kill_Score)
 	  {
 	     Num_Killed++;
@@ -1391,13 +2852,7 @@ static int fetch_head (NNTP_Type *s,  Active_Group_Type *g, NNTP_Artnum_Type n,
 /*	return 0; */
      }
 
-   while (sdi != NULL)
-     {
-	Slrn_Score_Debug_Info_Type *hlp = sdi->next;
-	slrn_free ((char *)sdi);
-	sdi = hlp;
-     }
-
+   free_score_debug_info (sdi);
    free_header_data (&h);
 
 #if 0
@@ -1413,7 +2868,7 @@ static int get_heads (NNTP_Type *s,  Active_Group_Type *g, NNTP_Artnum_Type *num
 		      Slrn_XOver_Type *xovs, unsigned int num)
 {
    unsigned int i;
-   char buf[20*SLRN_MAX_QUEUED];
+   char buf[32*SLRNPULL_MAX_PIPELINE];
    char *b;
    char *crlf;
 
@@ -1424,7 +2879,7 @@ static int get_heads (NNTP_Type *s,  Active_Group_Type *g, NNTP_Artnum_Type *num
    for (i = 0; i < num; i++)
      {
 	unsigned int len = sizeof (buf) - (size_t) (b - buf);
-	if (len < 20)
+	if (len < 32)
 	  slrn_exit_error (_("Internal error: Buffer in get_heads not large enough!"));
 	(void) SLsnprintf (b, len, "%shead " NNTP_FMT_ARTNUM, crlf, numbers[i]);
 	crlf = "\r\n";
@@ -1477,8 +2932,7 @@ static FILE *open_xover_file (Active_Group_Type *g, char *mode) /*{{{*/
 
 static void get_marked_bodies (NNTP_Type *s, Active_Group_Type *g) /*{{{*/
 {
-   char *heads[SLRN_MAX_QUEUED];
-   char *bodies[SLRN_MAX_QUEUED];
+   int have_body[SLRN_MAX_QUEUED];
    NNTP_Artnum_Type numbers[SLRN_MAX_QUEUED];
    unsigned int i, num;
    NNTP_Artnum_Type max;
@@ -1500,11 +2954,6 @@ static void get_marked_bodies (NNTP_Type *s, Active_Group_Type *g) /*{{{*/
 
    log_message (_("%s: Retrieving requested article bodies."), g->name);
 
-   for (i = 0; i < SLRN_MAX_QUEUED; i++)
-     {
-	heads[i] = ""; /* insert dummy headers so get_bodies won't skip them */
-     }
-
    max = r->min;
    while (r != NULL)
      {
@@ -1525,24 +2974,16 @@ static void get_marked_bodies (NNTP_Type *s, Active_Group_Type *g) /*{{{*/
 	  }
 	num = i;
 
-	if (-1 == get_bodies (s, numbers, heads, bodies, num))
+	/* The requests remain until the bodies are there */
+	if (budget_exhausted (s)
+	    || (-1 == get_bodies (s, g, numbers, NULL, have_body, num)))
 	  break;
 
 	Num_Articles_Received += num;
 
-	for (i=0; i < num; i++)
-	  {
-	     if ((bodies[i]!=NULL) &&
-		 (-1 == append_body (g, numbers[i], bodies[i])))
-	       {
-		  slrn_free(bodies[i]);
-		  bodies[i] = NULL;
-	       }
-	  }
-
 	/* Update headers list */
 	i=0;
-	while ((i<num) && (bodies[i]==NULL))
+	while ((i<num) && (have_body[i]==0))
 	  i++;
 	if (i<num)
 	  {
@@ -1552,7 +2993,7 @@ static void get_marked_bodies (NNTP_Type *s, Active_Group_Type *g) /*{{{*/
 	     while (i < num)
 	       {
 		  i++;
-		  while ((i < num) && (bodies[i]==NULL))
+		  while ((i < num) && (have_body[i]==0))
 		    i++; /* skip bodies that were unavailable */
 		  if ((i==num) || (numbers[i] > bmax+1))
 		    {
@@ -1564,58 +3005,236 @@ static void get_marked_bodies (NNTP_Type *s, Active_Group_Type *g) /*{{{*/
 		    bmax++;
 	       }
 	  }
-
-	/* Free bodies */
-	for (i=0; i < num; i++)
-	  slrn_free(bodies[i]);
      }
    print_time_stats (s, 1);
 }
 /*}}}*/
 
-static int get_articles (NNTP_Type *s, Active_Group_Type *g, NNTP_Artnum_Type *numbers, unsigned int num) /*{{{*/
+/* Reads the response to an ARTICLE command and writes it to the spool.
+ * Only the header is kept in memory (to create the overview entry); the
+ * body is written out line by line as it arrives.
+ */
+static int fetch_article (NNTP_Type *s, Active_Group_Type *g, /*{{{*/
+			  NNTP_Artnum_Type n, FILE *xov_fp)
 {
-   unsigned int i;
-#ifndef SLRN_MAX_QUEUED
-# define SLRN_MAX_QUEUED 10
-#endif
-   char *heads[SLRN_MAX_QUEUED];
-   char *bodies[SLRN_MAX_QUEUED];
-   Slrn_XOver_Type xovs [SLRN_MAX_QUEUED];
-   int ret;
+   char line [NNTP_BUFFER_SIZE];
+   char file [SLRN_MAX_PATH_LEN + 1];
+   char tmp_file [SLRN_MAX_PATH_LEN + 5];
+   char *head = NULL;
+   unsigned int head_len = 0, head_len_max = 0;
+   Slrn_XOver_Type xov;
+   Slrn_Header_Type h;
    FILE *fp;
+   int status, ok, has_body;
 
-   if (-1 == get_heads (s, g, numbers, heads, xovs, num))
+   print_time_stats (s, 0);
+
+   status = nntp_get_server_response (s);
+   if (status == -1)
      return -1;
 
-   ret = 0;
+   if (status != OK_ARTICLE)
+     {
+	/* The article is not available. */
+	if (g->min > g->max) g->min = n;
+	g->max = n;
+	return 0;
+     }
 
-   if ((g->headers_only) ||
-       (-1 != get_bodies (s, numbers, heads, bodies, num)))
+   fp = open_article_tmp_file (g, n, file, tmp_file);
+   ok = (fp != NULL);
+
+   /* Keep the header in memory */
+   while (1 == (status = nntp_read_line (s, line, sizeof (line))))
      {
-	fp = open_xover_file (g, "a");
+	unsigned int len;
 
-	for (i = 0; i < num; i++)
+	if (line[0] == 0)
+	  break;
+
+	len = strlen (line);
+	if (len + head_len + 2 > head_len_max)
 	  {
-	     if (-1 == write_head_and_body (g, numbers[i], heads[i],
-					    g->headers_only ? NULL : bodies[i],
-					    xovs + i, fp))
+	     char *new_head;
+
+	     head_len_max += 1024 + len;
+	     if (NULL == (new_head = slrn_realloc (head, head_len_max, 0)))
 	       {
-		  ret = -1;
-		  break;
+		  ok = 0;
+		  continue;
 	       }
+	     head = new_head;
+	  }
+	strcpy (head + head_len, line); /* safe */
+	head_len += len;
+	head [head_len++] = '\n';
+	head [head_len] = 0;
+     }
+
+   if (ok && (head != NULL) && (EOF == fputs (head, fp)))
+     ok = 0;
+
+   /* The body follows the empty line */
+   has_body = (status == 1);
+   if (has_body)
+     {
+	if (ok && (EOF == fputc ('\n', fp)))
+	  ok = 0;
+	status = copy_response_to_fp (s, fp, &ok);
+     }
+
+   if (fp != NULL)
+     {
+	if ((ok == 0) && (status != -1))
+	  log_error (_("Error writing to %s."), tmp_file);
+	if (-1 == close_article_tmp_file (g, n, fp, file, tmp_file, ok && (status != -1), has_body))
+	  ok = 0;
+     }
+
+   if (status == -1)
+     {
+	slrn_free (head);
+	return -1;
+     }
+
+   memset ((char *) &xov, 0, sizeof (Slrn_XOver_Type));
+   if ((ok == 0) || (head == NULL)
+       || (-1 == xover_parse_head (n, head, &xov)))
+     {
+	slrn_free (head);
+	return 0;
+     }
+   slrn_free (head);
+
+   memset ((char *) &h, 0, sizeof (Slrn_Header_Type));
+   slrn_map_xover_to_header (&xov, &h, 0);
+   (void) is_msgid_cached (h.msgid, g->name, n, 1);
+   free_header_data (&h);
+
+   status = write_xover_line (xov_fp, &xov);
+   slrn_free_xover_data (&xov);
+   if (status == -1)
+     return 0;
+
+   if (g->min > g->max) g->active_min = g->min = n;
+   g->active_max = g->max = n;
+
+   return 0;
+}
+
+/*}}}*/
+
+/* Fetches the articles with a single ARTICLE command each.  This is only
+ * used when the articles do not have to be scored on their full headers.
+ * Whenever a response has been read, a new command is sent, so that
+ * Pipeline_Depth commands are outstanding at any time.
+ * Returns the number of articles that were processed, which is less than
+ * num if an error occurred or the budget ran out.
+ */
+static unsigned int get_whole_articles (NNTP_Type *s, Active_Group_Type *g, /*{{{*/
+					NNTP_Artnum_Type *numbers, unsigned int num)
+{
+   char buf[32];
+   unsigned int sent, done, num_measured;
+   unsigned long start;
+   FILE *fp;
+
+   fp = open_xover_file (g, "a");
+
+   sent = done = num_measured = 0;
+   start = get_usecs ();
+   while (done < num)
+     {
+	while ((sent < num) && (sent - done < Pipeline_Depth)
+	       && (SLKeyBoard_Quit == 0) && (0 == budget_exhausted (s)))
+	  {
+	     int status;
+
+	     (void) SLsnprintf (buf, sizeof (buf), "article " NNTP_FMT_ARTNUM,
+				numbers[sent]);
+	     /* Do not reconnect while responses are outstanding. */
+	     if (sent == done)
+	       status = nntp_start_server_cmd (s, buf);
+	     else
+	       status = nntp_puts_server (s, buf);
+	     if (status == -1)
+	       break;
+	     sent++;
+	  }
+	if (sent == done)
+	  break;
+
+	if (-1 == fetch_article (s, g, numbers[done], fp))
+	  break;
+	done++;
+	Num_Articles_Received++;
+
+	/* Adapt the depth about once per window */
+	if (++num_measured >= Pipeline_Depth)
+	  {
+	     unsigned long now = get_usecs ();
+	     update_pipeline_depth (num_measured, now - start);
+	     start = now;
+	     num_measured = 0;
+	  }
+     }
+
+   if ((fp != NULL) && (-1 == slrn_fclose (fp)))
+     log_error (_("Error closing overview file for %s."), g->name);
+
+   return done;
+}
+
+/*}}}*/
+
+static int get_articles (NNTP_Type *s, Active_Group_Type *g, NNTP_Artnum_Type *numbers, unsigned int num) /*{{{*/
+{
+   unsigned int i;
+   char *heads[SLRNPULL_MAX_PIPELINE];
+   int have_body[SLRNPULL_MAX_PIPELINE];
+   Slrn_XOver_Type xovs [SLRNPULL_MAX_PIPELINE];
+   int ret, status;
+   FILE *fp;
+
+   if (-1 == get_heads (s, g, numbers, heads, xovs, num))
+     return -1;
+
+   ret = 0;
+
+   status = 0;
+   for (i = 0; i < num; i++)
+     have_body[i] = 0;
+   if (g->headers_only == 0)
+     status = get_bodies (s, g, numbers, heads, have_body, num);
+
+   fp = open_xover_file (g, "a");
+
+   for (i = 0; i < num; i++)
+     {
+	/* If the connection failed, only the complete articles are kept. */
+	if ((status == -1) && (have_body[i] == 0))
+	  continue;
+
+	if (-1 == write_head_and_body (g, numbers[i], heads[i], have_body[i],
+				       xovs + i, fp))
+	  {
+	     ret = -1;
+	     break;
 	  }
+     }
 
-	if (fp != NULL)
+   if (fp != NULL)
+     {
+	if (-1 == slrn_fclose (fp))
 	  {
-	     if (-1 == slrn_fclose (fp))
-	       {
-		  log_error (_("Error closing overview file for %s."), g->name);
-		  ret = -1;
-	       }
+	     log_error (_("Error closing overview file for %s."), g->name);
+	     ret = -1;
 	  }
      }
 
+   if (status == -1)
+     ret = -1;
+
    if (g->headers_only) /* "register" new articles without body */
      {
 	NNTP_Artnum_Type bmin, bmax;
@@ -1643,8 +3262,6 @@ static int get_articles (NNTP_Type *s, Active_Group_Type *g, NNTP_Artnum_Type *n
 
    for (i = 0; i < num; i++)
      {
-	if (!g->headers_only)
-	  slrn_free (bodies[i]);
 	slrn_free (heads[i]);
 	slrn_free_xover_data (xovs+i);
      }
@@ -1653,6 +3270,177 @@ static int get_articles (NNTP_Type *s, Active_Group_Type *g, NNTP_Artnum_Type *n
 
 /*}}}*/
 
+/* Scores the articles in numbers[] on the overview data from the server and
+ * removes those that get killed, so that their headers need not be fetched.
+ * This is skipped if the score file needs headers that are not part of the
+ * overview, since those articles have to be scored on their full headers.
+ * The survivors are scored again when their headers arrive.  If scores is
+ * not NULL, it receives the scores of the survivors (numbers[] must be
+ * sorted for this).
+ * Returns 1 if the articles were scored, 0 if not and -1 if the connection
+ * to the server is unusable.
+ */
+static int prescore_numbers (NNTP_Type *s, Active_Group_Type *g, /*{{{*/
+			     NNTP_Artnum_Type *numbers, int *scores,
+			     unsigned int *nump)
+{
+   char buf [NNTP_BUFFER_SIZE];
+   Slrn_Range_Type *killed = NULL;
+   NNTP_Artnum_Type min, max;
+   unsigned int i, j, num = *nump;
+   int status;
+
+   /* Additional_Headers lists the headers requested by the score file */
+   if ((num == 0) || (Additional_Headers != NULL))
+     return 0;
+
+   min = max = numbers[0];
+   for (i = 1; i < num; i++)
+     {
+	if (numbers[i] < min) min = numbers[i];
+	if (numbers[i] > max) max = numbers[i];
+     }
+
+   status = nntp_xover_cmd (s, min, max);
+   if (status == -1)
+     return -1;
+   if (status != OK_XOVER)
+     return 0;
+
+   if (scores != NULL)
+     {
+	for (i = 0; i < num; i++)
+	  scores[i] = 0;
+     }
+
+   while (1 == (status = nntp_read_line (s, buf, sizeof (buf))))
+     {
+	Slrn_Score_Debug_Info_Type *sdi = NULL;
+	Slrn_XOver_Type xov;
+	Slrn_Header_Type h;
+	int score;
+
+	memset ((char *) &xov, 0, sizeof (Slrn_XOver_Type));
+	if (-1 == parse_xover_line (buf, &xov))
+	  continue;
+
+	memset ((char *) &h, 0, sizeof (Slrn_Header_Type));
+	slrn_map_xover_to_header (&xov, &h, 1);
+
+	score = slrn_score_header (&h, g->name, (KLog_Fp != NULL) ? &sdi : NULL);
+	if (score < Kill_Score)
+	  {
+	     log_score (&h, score, sdi);
+	     (void) is_msgid_cached (h.msgid, g->name, h.number, 1);
+	     killed = slrn_ranges_add (killed, h.number, h.number);
+	     Num_Killed++;
+	  }
+	else if (scores != NULL)
+	  {
+	     unsigned int lo = 0, hi = num;
+
+	     while (lo < hi)
+	       {
+		  unsigned int mid = lo + (hi - lo) / 2;
+		  if (numbers[mid] < h.number)
+		    lo = mid + 1;
+		  else
+		    hi = mid;
+	       }
+	     if ((lo < num) && (numbers[lo] == h.number))
+	       scores[lo] = score;
+	  }
+
+	free_score_debug_info (sdi);
+	free_header_data (&h);
+     }
+
+   if (killed != NULL)
+     {
+	j = 0;
+	for (i = 0; i < num; i++)
+	  {
+	     if (slrn_ranges_is_member (killed, numbers[i]))
+	       continue;
+	     if (scores != NULL)
+	       scores[j] = scores[i];
+	     numbers[j++] = numbers[i];
+	  }
+	slrn_ranges_free (killed);
+
+	log_message (_("%s: %u articles killed on overview data."), g->name, num - j);
+	*nump = j;
+     }
+
+   return (status == -1) ? -1 : 1;
+}
+
+/*}}}*/
+
+/* Puts the pending articles of g that are still on the server in front of
+ * the new articles numbers[*ip...*nump-1].  On return, *ip is 0.
+ */
+static int add_pending_numbers (Active_Group_Type *g, NNTP_Artnum_Type server_min, /*{{{*/
+				NNTP_Artnum_Type **numbersp, unsigned int *nump,
+				unsigned int *ip)
+{
+   NNTP_Artnum_Type *numbers, *new_numbers;
+   NNTP_Artnum_Type n, limit;
+   Slrn_Range_Type *r;
+   unsigned int num, i, num_pending;
+
+   numbers = *numbersp;
+   num = *nump;
+   i = *ip;
+
+   /* Skip what is among the new articles anyway */
+   limit = (i < num) ? numbers[i] : g->server_max + 1;
+
+   num_pending = 0;
+   for (r = g->pending; r != NULL; r = r->next)
+     {
+	for (n = (r->min < server_min) ? server_min : r->min;
+	     (n <= r->max) && (n < limit); n++)
+	  num_pending++;
+     }
+
+   if (num_pending == 0)
+     {
+	slrn_ranges_free (g->pending);
+	g->pending = NULL;
+	return 0;
+     }
+
+   new_numbers = (NNTP_Artnum_Type *) slrn_malloc ((num_pending + num - i) * sizeof (NNTP_Artnum_Type), 0, 1);
+   if (new_numbers == NULL)
+     return -1;
+
+   num_pending = 0;
+   for (r = g->pending; r != NULL; r = r->next)
+     {
+	for (n = (r->min < server_min) ? server_min : r->min;
+	     (n <= r->max) && (n < limit); n++)
+	  new_numbers[num_pending++] = n;
+     }
+   log_message (_("%s: %u articles left over from the last run."),
+		g->name, num_pending);
+
+   if (i < num)
+     memcpy ((char *) (new_numbers + num_pending), (char *) (numbers + i),
+	     (num - i) * sizeof (NNTP_Artnum_Type));
+
+   slrn_ranges_free (g->pending);
+   g->pending = NULL;
+   slrn_free ((char *) numbers);
+
+   *numbersp = new_numbers;
+   *nump = num_pending + num - i;
+   *ip = 0;
+   return 0;
+}
+
+/*}}}*/
+
 static int get_group_articles (NNTP_Type *s, Active_Group_Type *g,
 			       NNTP_Artnum_Type server_min, NNTP_Artnum_Type server_max, int marked_bodies) /*{{{*/
 {
@@ -1661,6 +3449,7 @@ static int get_group_articles (NNTP_Type *s, Active_Group_Type *g,
 	NNTP_Artnum_Type gmin, gmax;
 	NNTP_Artnum_Type *numbers;
 	unsigned int num_numbers, i;
+	int whole_articles;
 
 	Num_Articles_Received = 0;
 	Num_Killed = 0;
@@ -1669,55 +3458,107 @@ static int get_group_articles (NNTP_Type *s, Active_Group_Type *g,
 	gmin = g->min;
 	gmax = g->max;
 
+	numbers = NULL;
+	num_numbers = i = 0;
+
 	if (((server_min > server_max) || (server_max < 0))
 	    || ((server_max <= gmax) && (gmin <= gmax)))
+	  log_message (_("%s: no new articles available."), g->name);
+	else
 	  {
-	     log_message (_("%s: no new articles available."), g->name);
-	     goto fetch_marked_bodies;
-	  }
+	     Num_Duplicates = 0;
+	     numbers = list_server_numbers (s, g, server_min, server_max, &num_numbers);
+	     if (Num_Duplicates)
+	       log_message (_("%u duplicates removed leaving %u/%u."),
+			    Num_Duplicates, num_numbers, num_numbers + Num_Duplicates);
 
-	Num_Duplicates = 0;
-	numbers = list_server_numbers (s, g, server_min, server_max, &num_numbers);
-	if (Num_Duplicates)
-	  log_message (_("%u duplicates removed leaving %u/%u."),
-		       Num_Duplicates, num_numbers, num_numbers + Num_Duplicates);
+	     if (numbers == NULL) return -1;
 
-	if (numbers == NULL) return -1;
+	     while ((i < num_numbers) && (numbers[i] <= gmax))
+	       i++;
 
-	i = 0;
-	while ((i < num_numbers) && (numbers[i] <= gmax))
-	  i++;
+	     if (i == num_numbers)
+	       {
+		  g->max = g->server_max;
+		  log_message (_("%s: No new articles available."), g->name);
+	       }
+	     else
+	       {
+		  log_message (_("%s: %u articles available."), g->name, num_numbers - i);
+
+		  /* Hmmm...  How shall g->max_to_get be defined?  Here I assume that it
+		   * means to attempt to retrieve the last max_to_get articles.
+		   */
+		  if ((g->max_to_get != 0) && (g->max_to_get + i < num_numbers))
+		    {
+		       log_message (_("%s: Only retrieving last %u articles."), g->name, g->max_to_get);
+		       i = num_numbers - g->max_to_get;
+		    }
+	       }
+	  }
+
+	if (-1 == add_pending_numbers (g, server_min, &numbers, &num_numbers, &i))
+	  {
+	     slrn_free ((char *) numbers);
+	     return -1;
+	  }
 
 	if (i == num_numbers)
 	  {
-	     g->max = g->server_max;
-	     log_message (_("%s: No new articles available."), g->name);
 	     slrn_free ((char *) numbers);
 	     goto fetch_marked_bodies;
 	  }
 
-	log_message (_("%s: %u articles available."), g->name, num_numbers - i);
+	/* If the articles need not be scored on their full headers, fetch
+	 * them with ARTICLE instead of HEAD and BODY. */
+	whole_articles = (g->headers_only == 0);
 
-	/* Hmmm...  How shall g->max_to_get be defined?  Here I assume that it
-	 * means to attempt to retrieve the last max_to_get articles.
-	 */
-	if ((g->max_to_get != 0) && (g->max_to_get + i < num_numbers))
+	if (1 == slrn_open_score (g->name))
 	  {
-	     log_message (_("%s: Only retrieving last %u articles."), g->name, g->max_to_get);
-	     i = num_numbers - g->max_to_get;
-	  }
+	     unsigned int num_left = num_numbers - i;
+	     int *scores = NULL;
+	     int status;
+
+	     /* With a budget, the articles are fetched in the order of
+	      * their scores. */
+	     if (Byte_Budget || Time_Budget)
+	       scores = (int *) slrn_malloc (num_left * sizeof (int), 0, 1);
 
-	(void) slrn_open_score (g->name);
+	     if (-1 == (status = prescore_numbers (s, g, numbers + i, scores, &num_left)))
+	       {
+		  (void) slrn_close_score ();
+		  slrn_free ((char *) scores);
+		  slrn_free ((char *) numbers);
+		  return -1;
+	       }
+	     num_numbers = i + num_left;
+	     if (status == 0)
+	       whole_articles = 0;
+	     else if (scores != NULL)
+	       sort_numbers_by_score (numbers + i, scores, num_left);
+	     slrn_free ((char *) scores);
+	  }
 
 	Num_Articles_To_Receive = num_numbers - i;
 
-	while (i < num_numbers)
+	if (whole_articles)
+	  {
+	     print_time_stats (s, 0);
+	     i += get_whole_articles (s, g, numbers + i, num_numbers - i);
+	     if (Budget_Exhausted == 0)
+	       i = num_numbers;
+	  }
+
+	/* Bodies are requested only after the heads have been scored, so
+	 * this is done in batches of Pipeline_Depth articles. */
+	while ((i < num_numbers) && (0 == budget_exhausted (s)))
 	  {
-	     NNTP_Artnum_Type ns[SLRN_MAX_QUEUED];
+	     NNTP_Artnum_Type ns[SLRNPULL_MAX_PIPELINE];
+	     unsigned long start;
 	     unsigned int j;
 
 	     j = 0;
-	     while ((i < num_numbers) && (j < SLRN_MAX_QUEUED))
+	     while ((i < num_numbers) && (j < Pipeline_Depth))
 	       {
 		  ns[j] = numbers[i];
 		  i++;
@@ -1725,11 +3566,23 @@ static int get_group_articles (NNTP_Type *s, Active_Group_Type *g,
 	       }
 
 	     print_time_stats (s, 0);
+	     start = get_usecs ();
 	     (void) get_articles (s, g, ns, j);
+	     update_pipeline_depth (j, get_usecs () - start);
 
 	     Num_Articles_Received += j;
 	  }
 
+	/* Otherwise, the articles that could not be fetched are lost */
+	if (Budget_Exhausted)
+	  {
+	     if (i < num_numbers)
+	       log_message (_("%s: %u articles left for the next run."),
+			    g->name, num_numbers - i);
+	     for (; i < num_numbers; i++)
+	       g->pending = slrn_ranges_add (g->pending, numbers[i], numbers[i]);
+	  }
+
 	g->max = g->server_max;
 
 	(void) slrn_close_score ();
@@ -1745,47 +3598,68 @@ static int get_group_articles (NNTP_Type *s, Active_Group_Type *g,
    /* Don't request bodies that are no longer there. */
    if (server_min > 1)
      g->requests = slrn_ranges_remove (g->requests, 1, server_min-1);
-   get_marked_bodies (s, g);
+   if (0 == budget_exhausted (s))
+     get_marked_bodies (s, g);
 
    return 0;
 }
 
 /*}}}*/
 
-static int pull_news (NNTP_Type *s, int marked_bodies) /*{{{*/
+/* Returns -1 if the connection to the server is unusable or the budget
+ * is used up. */
+static int pull_group (NNTP_Type *s, Active_Group_Type *g, int marked_bodies) /*{{{*/
 {
+   NNTP_Artnum_Type min, max;
+   unsigned long start;
    int status;
-   Active_Group_Type *g;
 
-   g = Active_Groups;
-   while (g != NULL)
+   if (budget_exhausted (s))
+     return -1;
+
+   log_message (_("Fetching articles for %s."), g->name);
+
+   start = get_usecs ();
+   status = nntp_select_group (s, g->name, &min, &max);
+   add_rtt_sample (start);
+   if (status != OK_GROUP)
      {
-	NNTP_Artnum_Type min, max;
+	log_error (_("Error selecting group %s.  Code = %d: %s"), g->name,
+		   status, nntp_map_code_to_string (status));
+
+	return (status == -1) ? -1 : 0;
+     }
 
-	log_message (_("Fetching articles for %s."), g->name);
+   write_server_min_file (g, min);
+   if (g->server_max > max)
+     g->server_max = max;
 
-	status = nntp_select_group (s, g->name, &min, &max);
-	if (status != OK_GROUP)
-	  {
-	     log_error (_("Error selecting group %s.  Code = %d: %s"), g->name,
-			status, nntp_map_code_to_string (status));
+   Current_Group = g;
 
-	     if (status == -1)
-	       break;
+   if (marked_bodies == 0)
+     read_pending_file (g);
 
-	     g = g->next;
-	     continue;
-	  }
+   (void) get_group_articles (s, g, min, max, marked_bodies);
 
-	write_server_min_file (g, min);
-	if (g->server_max > max)
-	  g->server_max = max;
+   if (marked_bodies == 0)
+     write_pending_file (g);
+   (void) write_headers_file (g);
+   close_segment ();
+   close_article_index ();
+   return 0;
+}
 
-	Current_Group = g;
+/*}}}*/
 
-	(void) get_group_articles (s, g, min, max, marked_bodies);
+static int pull_news (NNTP_Type *s, int marked_bodies) /*{{{*/
+{
+   Active_Group_Type *g;
 
-	(void) write_headers_file (g);
+   g = Active_Groups;
+   while (g != NULL)
+     {
+	if (-1 == pull_group (s, g, marked_bodies))
+	  break;
 
 	g = g->next;
      }
@@ -1944,12 +3818,27 @@ static int post_outgoing (NNTP_Type *s) /*{{{*/
 
 /*}}}*/
 
+#if SLRNPULL_HAS_WORKERS
+static int Num_Workers = 1;
+/* In a worker process, this is where the new state of the groups it pulled
+ * goes (see write_worker_results).  It is NULL in the main process. */
+static FILE *Worker_Result_Fp;
+static int write_worker_results (void);
+static void close_log_files (void);
+#endif
+
 static int write_active (void) /*{{{*/
 {
    Active_Group_Type *g = Active_Groups;
    FILE *fp;
    char file [SLRN_MAX_PATH_LEN + 5];
 
+#if SLRNPULL_HAS_WORKERS
+   /* Only the main process may write the active file */
+   if (Worker_Result_Fp != NULL)
+     return write_worker_results ();
+#endif
+
    (void) SLsnprintf (file, sizeof (file), "%s.tmp", Active_File);
 
    fp = fopen (file, "w");
@@ -2031,54 +3920,329 @@ static int open_servers (char *host) /*{{{*/
 
    NNTP_Connection_Lost_Hook = connection_lost_hook;
 
-   sltcp_reset_num_io_bytes (Pull_Server->tcp);
-   time (&Start_Time);
+   sltcp_reset_num_io_bytes (Pull_Server->tcp);
+   time (&Start_Time);
+
+   /* Probe for XHDR now because DNEWS does not handle probing later properly. */
+   (void) nntp_has_cmd (Pull_Server, "XHDR");
+   return 0;
+}
+
+/*}}}*/
+
+static void print_stats (unsigned long bytes_in, unsigned long bytes_out) /*{{{*/
+{
+   time_t done;
+
+   if (Actual_Start_Time == 0)
+    done = 0;
+   else
+     time (&done);
+
+   log_message (_("A total of %lu bytes received, %lu bytes sent in %ld seconds."),
+		bytes_in, bytes_out, (long) done - (long) Actual_Start_Time);
+}
+
+/*}}}*/
+
+static void close_pull_server (void) /*{{{*/
+{
+   if (Pull_Server != NULL)
+     {
+	if (Pull_Server->tcp != NULL)
+	  {
+	     Closed_Bytes_In += sltcp_get_num_input_bytes (Pull_Server->tcp);
+	     Closed_Bytes_Out += sltcp_get_num_output_bytes (Pull_Server->tcp);
+	  }
+	nntp_close_server (Pull_Server);
+     }
+   Pull_Server = NULL;
+}
+
+/*}}}*/
+
+static void close_servers (void) /*{{{*/
+{
+#if SLRN_USE_SLTCP
+   (void) sltcp_close_sltcp ();
+#endif
+
+   close_pull_server ();
+
+#if SLRNPULL_HAS_WORKERS
+   if (Worker_Result_Fp != NULL)
+     {
+	/* The main process prints the total */
+	(void) fprintf (Worker_Result_Fp, "* %lu %lu\n",
+			Closed_Bytes_In, Closed_Bytes_Out);
+	(void) fflush (Worker_Result_Fp);
+	return;
+     }
+#endif
+   print_stats (Closed_Bytes_In, Closed_Bytes_Out);
+}
+
+/*}}}*/
+
+#if SLRNPULL_HAS_WORKERS
+/* Parallel pulling works like this: the main process forks Num_Workers
+ * worker processes and sends them the indices of the groups through a
+ * pipe.  Each worker opens its own connection to the server and pulls the
+ * groups it reads from the pipe.  Since every group has its own spool
+ * directory, the workers do not get in each other's way.  When done, a
+ * worker writes the new article ranges of its groups to a temporary file
+ * that the main process reads after the worker exited.  The main process
+ * then writes the active file as usual.  Expiring (and rebuilding the
+ * overview files) works the same way, except that no connections are
+ * needed.
+ *
+ * Note that the message-id cache that is used to avoid fetching cross-posted
+ * articles twice is not shared between the workers.
+ */
+
+typedef int (*Group_Job_Type) (Active_Group_Type *, int);
+
+static int write_worker_results (void) /*{{{*/
+{
+   Active_Group_Type *g;
+
+   rewind (Worker_Result_Fp);
+   for (g = Active_Groups; g != NULL; g = g->next)
+     {
+	if (0 == (g->flags & GROUP_DONE))
+	  continue;
+
+	if (EOF == fprintf (Worker_Result_Fp,
+			    "%s " NNTP_FMT_ARTNUM_2 " " NNTP_FMT_ARTNUM_2 " " NNTP_FMT_ARTNUM "\n",
+			    g->name, g->min, g->max, g->active_min, g->active_max,
+			    g->server_max))
+	  return -1;
+     }
+   return (EOF == fflush (Worker_Result_Fp)) ? -1 : 0;
+}
+
+/*}}}*/
+
+static void read_worker_results (FILE *fp) /*{{{*/
+{
+   char line [MAX_GROUP_NAME_LEN + 128];
+
+   rewind (fp);
+   while (NULL != fgets (line, sizeof (line), fp))
+     {
+	NNTP_Artnum_Type min, max, active_min, active_max, server_max;
+	unsigned long bytes_in, bytes_out;
+	Active_Group_Type *g;
+	char *p;
+
+	if (line[0] == '*')
+	  {
+	     if (2 == sscanf (line + 1, "%lu %lu", &bytes_in, &bytes_out))
+	       {
+		  Closed_Bytes_In += bytes_in;
+		  Closed_Bytes_Out += bytes_out;
+	       }
+	     continue;
+	  }
+
+	if (NULL == (p = strchr (line, ' ')))
+	  continue;
+	*p++ = 0;
+
+	if ((NULL == (g = find_group_type (line)))
+	    || (5 != sscanf (p, NNTP_FMT_ARTNUM_2 " " NNTP_FMT_ARTNUM_2 " " NNTP_FMT_ARTNUM,
+			     &min, &max, &active_min, &active_max, &server_max)))
+	  continue;
+
+	g->min = min;
+	g->max = max;
+	g->active_min = active_min;
+	g->active_max = active_max;
+	g->server_max = server_max;
+     }
+}
+
+/*}}}*/
+
+/* If host is NULL, the jobs do not need a server connection. */
+static void run_worker (char *host, int job_fd, Group_Job_Type job, int arg) /*{{{*/
+{
+   int i;
+
+   /* Progress lines of several processes would be unreadable */
+   Stdout_Is_TTY = 0;
+
+   if ((host != NULL) && (-1 == open_servers (host)))
+     {
+	Exit_Code = SLRN_EXIT_CONNECTION_FAILED;
+	slrn_exit_error (_("Unable to initialize server."));
+     }
+
+   while (sizeof (int) == read (job_fd, (char *) &i, sizeof (int)))
+     {
+	Active_Group_Type *g = Active_Groups;
+
+	(void) handle_interrupts ();
+
+	while ((i > 0) && (g != NULL))
+	  {
+	     g = g->next;
+	     i--;
+	  }
+	if (g == NULL)
+	  continue;
+
+	g->flags |= GROUP_DONE;
+	if (-1 == (*job) (g, arg))
+	  break;
+     }
+
+   if (-1 == write_active ())
+     Exit_Code = SLRN_EXIT_FILEIO;
+   else
+     Exit_Code = 0;
 
-   /* Probe for XHDR now because DNEWS does not handle probing later properly. */
-   (void) nntp_has_cmd (Pull_Server, "XHDR");
-   return 0;
+   if (host != NULL)
+     close_servers ();
+   close_log_files ();
+   exit (Exit_Code);
 }
 
 /*}}}*/
 
-static void print_stats (unsigned long bytes_in, unsigned long bytes_out) /*{{{*/
+static int pull_group_job (Active_Group_Type *g, int marked_bodies) /*{{{*/
 {
-   time_t done;
-
-   if (Actual_Start_Time == 0)
-    done = 0;
-   else
-     time (&done);
-
-   log_message (_("A total of %lu bytes received, %lu bytes sent in %ld seconds."),
-		bytes_in, bytes_out, (long) done - (long) Actual_Start_Time);
+   return pull_group (Pull_Server, g, marked_bodies);
 }
 
 /*}}}*/
 
-static void close_servers (void) /*{{{*/
+/* Runs job (g, arg) for all groups in Num_Workers processes.  Returns 0
+ * if this is not possible, in which case the caller should process the
+ * groups itself.  If host is not NULL, the workers connect to it and
+ * the connection of the main process is closed. */
+static int run_parallel_jobs (char *host, Group_Job_Type job, int arg) /*{{{*/
 {
-   unsigned long bytes_in = 0;
-   unsigned long bytes_out = 0;
+   FILE *result_fps [SLRNPULL_MAX_WORKERS];
+   pid_t pids [SLRNPULL_MAX_WORKERS];
+   Active_Group_Type *g;
+   int job_fds[2];
+   int i, num_groups, num_workers;
 
-#if SLRN_USE_SLTCP
-   (void) sltcp_close_sltcp ();
-#endif
+   num_groups = 0;
+   for (g = Active_Groups; g != NULL; g = g->next)
+     num_groups++;
 
-   if (Pull_Server != NULL)
+   num_workers = Num_Workers;
+   if (num_workers > num_groups)
+     num_workers = num_groups;
+   if (num_workers < 2)
+     return 0;
+
+   if (-1 == pipe (job_fds))
      {
-	if (Pull_Server->tcp != NULL)
+	log_error (_("Unable to create a pipe for the workers."));
+	return 0;
+     }
+
+   /* The workers open their own connections */
+   if (host != NULL)
+     close_pull_server ();
+
+   log_message (_("Starting %d worker processes."), num_workers);
+
+   for (i = 0; i < num_workers; i++)
+     {
+	pids[i] = -1;
+	if (NULL == (result_fps[i] = tmpfile ()))
 	  {
-	     bytes_in = sltcp_get_num_input_bytes (Pull_Server->tcp);
-	     bytes_out = sltcp_get_num_output_bytes (Pull_Server->tcp);
+	     log_error (_("Unable to create a temporary file for worker %d."), i);
+	     continue;
+	  }
+
+	/* Do not let the workers inherit unwritten output */
+	(void) fflush (NULL);
+
+	if (-1 == (pids[i] = fork ()))
+	  {
+	     log_error (_("Unable to fork worker %d (errno = %d)."), i, errno);
+	     fclose (result_fps[i]);
+	     result_fps[i] = NULL;
+	     continue;
+	  }
+
+	if (pids[i] == 0)
+	  {
+	     int j;
+	     for (j = 0; j < i; j++)
+	       if (result_fps[j] != NULL) fclose (result_fps[j]);
+
+	     close (job_fds[1]);
+	     Worker_Result_Fp = result_fps[i];
+
+	     /* Each worker counts its own bytes and gets an equal share of
+	      * what is left of the byte budget. */
+	     if (Byte_Budget != 0)
+	       {
+		  if (Byte_Budget > Closed_Bytes_In)
+		    Byte_Budget = (Byte_Budget - Closed_Bytes_In) / num_workers + 1;
+		  else
+		    Byte_Budget = 1;
+	       }
+	     Closed_Bytes_In = Closed_Bytes_Out = 0;
+	     run_worker (host, job_fds[0], job, arg);
+	     /* not reached */
 	  }
-	nntp_close_server (Pull_Server);
      }
-   Pull_Server = NULL;
-   print_stats (bytes_in, bytes_out);
+   close (job_fds[0]);
+
+   for (i = 0; i < num_groups; i++)
+     {
+	if (sizeof (int) != write (job_fds[1], (char *) &i, sizeof (int)))
+	  {
+	     if (errno == EINTR)
+	       {
+		  i--;
+		  continue;
+	       }
+	     log_error (_("Unable to send groups to the workers (errno = %d)."), errno);
+	     break;
+	  }
+     }
+   close (job_fds[1]);
+
+   for (i = 0; i < num_workers; i++)
+     {
+	int status, ret, code = 0;
+
+	if (pids[i] > 0)
+	  {
+	     while ((-1 == (ret = waitpid (pids[i], &status, 0))) && (errno == EINTR))
+	       ;
+	     if (ret == -1)
+	       code = SLRN_EXIT_UNKNOWN;
+	     else if (WIFEXITED (status))
+	       code = WEXITSTATUS (status);
+	     else if (WIFSIGNALED (status))
+	       {
+		  log_error (_("Worker %d was killed by signal %d."), i, WTERMSIG (status));
+		  code = SLRN_EXIT_SIGNALED;
+	       }
+	  }
+	if ((code != 0) && (Worker_Exit_Code == 0))
+	  Worker_Exit_Code = code;
+	if (result_fps[i] != NULL)
+	  {
+	     read_worker_results (result_fps[i]);
+	     fclose (result_fps[i]);
+	  }
+     }
+
+   return 1;
 }
 
 /*}}}*/
+#endif				       /* SLRNPULL_HAS_WORKERS */
 
 static void init_signals (void);
 
@@ -2136,6 +4300,7 @@ static void usage (char *pgm, char *rootdir) /*{{{*/
  Options:\n\
   -d SPOOLDIR          Spool directory to use.\n\
   -h HOSTNAME          Hostname of NNTP server to connect to.\n\
+  -j N                 Pull the groups over N connections at once.\n\
   --debug FILE         Write dialogue with server to FILE.\n\
   --expire             Perform expiration, but do not pull news.\n\
   --fetch-score SCORE  Fetch article bodies with a score of at least SCORE\n\
@@ -2145,8 +4310,11 @@ static void usage (char *pgm, char *rootdir) /*{{{*/
   --kill-score SCORE   Kill articles with a score below SCORE.\n\
   --logfile FILE       Use FILE as the log file.\n\
   --marked-bodies      Only fetch bodies that were marked for download.\n\
+  --max-bytes SIZE     Stop pulling after receiving SIZE bytes (k, M, G).\n\
+  --max-time SECONDS   Stop pulling after SECONDS seconds.\n\
   --new-groups         Get a list of new groups.\n\
   --no-post            Do not post news.\n\
+  --packed-spool       Store new articles in segment files.\n\
   --post-only          Post news, but do not pull new news.\n\
   --rebuild            Like --expire; additionally rebuilds overview files.\n\
   --version            Show the version number.\n\
@@ -2229,6 +4397,7 @@ int main (int argc, char **argv) /*{{{*/
    logfile = SLRNPULL_LOGFILE;
 
    dir = getenv ("SLRNPULL_ROOT");
+   time (&Budget_Start_Time);
 
    while (argc > 0)
      {
@@ -2243,6 +4412,16 @@ int main (int argc, char **argv) /*{{{*/
 	     host = *argv;
 	     argv++; argc--;
 	  }
+#if SLRNPULL_HAS_WORKERS
+	else if (!strcmp (arg, "-j") && (argc > 0))
+	  {
+	     Num_Workers = atoi (*argv);
+	     if (Num_Workers < 1) Num_Workers = 1;
+	     if (Num_Workers > SLRNPULL_MAX_WORKERS)
+	       Num_Workers = SLRNPULL_MAX_WORKERS;
+	     argv++; argc--;
+	  }
+#endif
 	else if (!strcmp (arg, "-d") && (argc > 0))
 	  {
 	     dir = *argv;
@@ -2261,6 +4440,8 @@ int main (int argc, char **argv) /*{{{*/
 	  check_new_groups = 1;
 	else if (!strcmp (arg, "--marked-bodies"))
 	  marked_bodies = 1;
+	else if (!strcmp (arg, "--packed-spool"))
+	  Packed_Spool = 1;
 	else if (!strcmp (arg, "--version"))
 	  show_version (pgm);
 	else if (!strcmp (arg, "--logfile") && (argc > 0))
@@ -2273,6 +4454,18 @@ int main (int argc, char **argv) /*{{{*/
 	     kill_logfile = *argv;
 	     argv++; argc--;
 	  }
+	else if (!strcmp (arg, "--max-bytes") && (argc > 0))
+	  {
+	     if (0 == (Byte_Budget = parse_byte_budget (*argv)))
+	       usage (pgm, dir);
+	     argv++; argc--;
+	  }
+	else if (!strcmp (arg, "--max-time") && (argc > 0))
+	  {
+	     long seconds = atol (*argv);
+	     Time_Budget = (seconds > 0) ? (unsigned long) seconds : 0;
+	     argv++; argc--;
+	  }
 	else if (!strcmp (arg, "--kill-score") && (argc > 0))
 	  {
 	     Kill_Score = atoi (*argv);
@@ -2357,7 +4550,7 @@ int main (int argc, char **argv) /*{{{*/
 	  slrn_exit_error (NULL);
 
 	close_log_files ();
-	return 0;
+	return Worker_Exit_Code;
      }
 
    if (-1 == read_score_file ())
@@ -2381,7 +4574,10 @@ int main (int argc, char **argv) /*{{{*/
    if (post_mode != 1)
      {
 	init_signals ();
-	pull_news (Pull_Server, marked_bodies);
+#if SLRNPULL_HAS_WORKERS
+	if (0 == run_parallel_jobs (host, pull_group_job, marked_bodies))
+#endif
+	  pull_news (Pull_Server, marked_bodies);
 	if (-1 == write_active ())
 	  {
 	     Exit_Code = SLRN_EXIT_FILEIO;
@@ -2393,7 +4589,7 @@ int main (int argc, char **argv) /*{{{*/
 
    close_log_files ();
 
-   return 0;
+   return Worker_Exit_Code;
 }
 
 /*}}}*/
@@ -2678,28 +4874,28 @@ static void slrn_art_free_article_line (Slrn_Article_Line_Type *l)
 #endif
 /*}}}*/
 
-static char *read_header_from_file (char *file, int *has_body)
+/* Reads at most size bytes (unless size is -1) */
+static char *read_header_from_file (FILE *fp, unsigned long size, int *has_body)
 {
-   FILE *fp;
    char line [NNTP_BUFFER_SIZE];
    char *mbuf;
    unsigned int buffer_len, buffer_len_max;
 
-   if (NULL == (fp = fopen (file, "r")))
-     return NULL;
-
    mbuf = NULL;
    buffer_len_max = buffer_len = 0;
+   *line = 0;
 
-   while (NULL != fgets (line, sizeof(line), fp))
+   while ((size != 0) && (NULL != fgets (line, sizeof(line), fp)))
      {
 	unsigned int len;
 
+	len = strlen (line);
+	if (size != (unsigned long) -1)
+	  size = (len < size) ? size - len : 0;
+
 	if ((*line == '\n') || (*line == '\r'))
 	  break;
 
-	len = strlen (line);
-
 	if (len + buffer_len + 4 > buffer_len_max)
 	  {
 	     char *new_mbuf;
@@ -2722,7 +4918,6 @@ static char *read_header_from_file (char *file, int *has_body)
 
    *has_body = (line != NULL) && ((*line == '\n') || (*line == '\r'));
 
-   fclose (fp);
    return mbuf;
 }
 
@@ -2737,12 +4932,16 @@ static int sort_artnums_cmp (NNTP_Artnum_Type *a, NNTP_Artnum_Type *b)
  * write an overview-file entry for a single article
  * returns -1 on error, 0 if header is missing, 1 otherwise
  */
-static int write_overview_entry(FILE *xov_fp, NNTP_Artnum_Type id, char *dir)
+/* The entries tell where packed articles are. */
+static int write_overview_entry(FILE *xov_fp, NNTP_Artnum_Type id, char *dir,
+				Article_Index_Type *entries, unsigned int n_entries)
 {
    char file [SLRN_MAX_PATH_LEN + 1];
    char *header;
    struct stat st;
    Slrn_XOver_Type xov;
+   Article_Index_Type *e;
+   FILE *fp;
    int has_body;
    char buf[256];
 
@@ -2754,16 +4953,30 @@ static int write_overview_entry(FILE *xov_fp, NNTP_Artnum_Type id, char *dir)
         return -1;
      }
 
-   if (-1 == stat (file, &st))
+   e = find_article_index_entry (entries, n_entries, id);
+   if ((e != NULL) && (e->seg != 0))
      {
-        log_error (_("Unable to stat %s."), file);
-        return -1;
+	fp = open_packed_article (dir, e);
+	header = (fp == NULL) ? NULL : read_header_from_file (fp, e->size, &has_body);
+     }
+   else
+     {
+	if (-1 == stat (file, &st))
+	  {
+	     log_error (_("Unable to stat %s."), file);
+	     return -1;
+	  }
+
+	if (0 == S_ISREG(st.st_mode))
+	  return 1;
+
+	fp = fopen (file, "r");
+	header = (fp == NULL) ? NULL : read_header_from_file (fp, (unsigned long) -1, &has_body);
      }
 
-   if (0 == S_ISREG(st.st_mode))
-     return 1;
+   if (fp != NULL)
+     fclose (fp);
 
-   header = read_header_from_file (file, &has_body);
    if (header == NULL)
      {
         log_error(_("Unable to read header " NNTP_FMT_ARTNUM " in %s."), id, file);
@@ -2801,26 +5014,107 @@ static void progress_update_overview(int i, int n_nums, Active_Group_Type *g, in
    fflush (stdout);
 }
 
-/* Now also updates g->headers */
-static int create_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums, unsigned int n_nums)
+static int make_overview_filenames (Active_Group_Type *g, char *file, char *newfile)
+{
+   if ((-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, file, SLRN_MAX_PATH_LEN + 1)) ||
+       (-1 == slrn_dircat (file, Overview_File, file, SLRN_MAX_PATH_LEN + 1)))
+     {
+        log_error (_("Unable to create filename for overview file.\n"));
+        return -1;
+     }
+   slrn_strncpy (newfile, file, SLRN_MAX_PATH_LEN - 5);
+   strcat (newfile, "-new"); /* safe */
+   return 0;
+}
+
+/*
+ * Reads the next line of an overview file and returns its article number,
+ * or -1 at the end of the file.  The rest of a line that does not fit into
+ * buf is skipped and buf is set to "", so that the line is not copied.
+ */
+static NNTP_Artnum_Type read_overview_line (FILE *fp, char *buf, unsigned int size)
+{
+   NNTP_Artnum_Type nr;
+   unsigned int len;
+   int ch;
+
+   if (NULL == fgets (buf, size, fp))
+     return -1;
+
+   nr = NNTP_STR_TO_ARTNUM (buf);
+   len = strlen (buf);
+   if ((len == 0) || (buf [len - 1] != '\n'))
+     {
+	while ((EOF != (ch = getc (fp))) && (ch != '\n'))
+	  ;
+	*buf = 0;
+     }
+   return nr;
+}
+
+/*
+ * Returns 1 if buf looks like a complete overview line for article nr,
+ * i.e. it starts with that number and has all the mandatory fields.
+ */
+static int is_overview_line_ok (char *buf, NNTP_Artnum_Type nr)
+{
+   char numbuf [64];
+   unsigned int len, num_tabs = 0;
+   char *p;
+
+   sprintf (numbuf, NNTP_FMT_ARTNUM, nr); /* safe */
+   len = strlen (numbuf);
+   if (strncmp (buf, numbuf, len) || (buf[len] != '\t'))
+     return 0;
+
+   for (p = buf; *p != 0; p++)
+     {
+	if (*p == '\t')
+	  num_tabs++;
+     }
+   /* number, subject, from, date, message-id, references, bytes, lines */
+   return (num_tabs >= 7) && (p[-1] == '\n');
+}
+
+/*
+ * Now also updates g->headers.  The entries in checkpoint (if any) are
+ * those of the articles that did not change since the overview file was
+ * last written (see expire_group); their lines are copied from the old
+ * overview file instead of parsing the articles again, unless they are
+ * missing or damaged.
+ */
+static int create_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums, unsigned int n_nums,
+				    Article_Index_Type *entries, unsigned int n_entries,
+				    Article_Index_Type *checkpoint, unsigned int n_checkpoint)
 {
+   char file [SLRN_MAX_PATH_LEN + 1];
+   char newfile [SLRN_MAX_PATH_LEN + 1];
    char dir [SLRN_MAX_PATH_LEN + 1];
-   FILE *xov_fp;
-   unsigned int i;
+   char buf [4096];
+   NNTP_Artnum_Type xov_nr = 0;
+   FILE *xov_fp, *old_xov_fp;
+   unsigned int i, n_reused = 0, n_repaired = 0;
    NNTP_Artnum_Type bmin, bmax;
    Slrn_Range_Type *headers = NULL;
    void (*qsort_fun) (char *, unsigned int, int, int (*)(NNTP_Artnum_Type *, NNTP_Artnum_Type *));
 
    log_message (_("Creating Overview file for %s..."), g->name);
 
-   xov_fp = open_xover_file (g, "w");
+   if ((-1 == make_overview_filenames (g, file, newfile))
+       || (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname,
+			      dir, sizeof (dir))))
+     return -1;
 
+   xov_fp = fopen (newfile, "w");
    if (xov_fp == NULL)
-     return -1;
+     {
+	log_error (_("Unable to open new overview file %s.\n"), newfile);
+	return -1;
+     }
 
-   if (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname,
-			  dir, sizeof (dir)))
-     return -1;
+   old_xov_fp = NULL;
+   if (n_checkpoint != 0)
+     old_xov_fp = fopen (file, "r");
 
    if ((nums != NULL) && (n_nums != 0))
      {
@@ -2842,13 +5136,31 @@ static int create_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
    bmin = bmax = -1;
    for (i = 0; i < n_nums; i++)
      {
-	int ret;
-        if (-1 == (ret = write_overview_entry(xov_fp, nums [i], dir)))
-          {
-             fclose(xov_fp);
-	     slrn_ranges_free (headers);
-             return -1;
-          }
+	Article_Index_Type *e;
+	int ret = -1;
+
+	if ((old_xov_fp != NULL)
+	    && (NULL != (e = find_article_index_entry (checkpoint, n_checkpoint, nums[i])))
+	    && (e->has_body != -1))
+	  {
+	     while ((xov_nr != -1) && (xov_nr < nums[i]))
+	       xov_nr = read_overview_line (old_xov_fp, buf, sizeof (buf));
+
+	     if ((xov_nr == nums[i]) && is_overview_line_ok (buf, nums[i]))
+	       {
+		  if (EOF == fputs (buf, xov_fp))
+		    break;
+		  ret = e->has_body;
+		  n_reused++;
+	       }
+	     else
+	       n_repaired++;
+	  }
+
+	if ((ret == -1)
+	    && (-1 == (ret = write_overview_entry(xov_fp, nums [i], dir, entries, n_entries))))
+	  break;
+
 	if ((ret == 0) && (bmin == -1))
 	  {
 	     bmin = bmax = nums[i];
@@ -2867,12 +5179,38 @@ static int create_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
 	if ((Stdout_Is_TTY) && (((i % 100) == 0) || (i+1 == n_nums)))
 	  progress_update_overview(i, n_nums, g, 1);
      }
+
+   if (old_xov_fp != NULL)
+     (void) fclose (old_xov_fp);
+
+   if ((-1 == slrn_fclose (xov_fp)) || (i < n_nums))
+     {
+	log_error (_("Unable to create the overview file for %s."), g->name);
+	(void) slrn_delete_file (newfile);
+	slrn_ranges_free (headers);
+	return -1;
+     }
+
+   if (-1 == slrn_move_file (newfile, file))
+     {
+	log_error (_("failed to rename %s to %s."), newfile, file);
+	slrn_ranges_free (headers);
+	return -1;
+     }
+
+   if (n_reused != 0)
+     log_message (_("%u of %u overview entries in %s were unchanged."),
+		  n_reused, n_nums, g->name);
+   if (n_repaired != 0)
+     log_message (_("%u missing or damaged overview entries in %s were recreated."),
+		  n_repaired, g->name);
+
    if (bmin != -1)
      headers = slrn_ranges_add (headers, bmin, bmax);
 
    slrn_ranges_free (g->headers);
    g->headers = headers;
-   return slrn_fclose (xov_fp);
+   return 0;
 }
 
 /*
@@ -2880,7 +5218,8 @@ static int create_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
  * which is a lot faster than recreating the entire file. If the overview
  * file cannot be opened for reading, a new one is created.
  */
-static int update_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums, unsigned int n_nums)
+static int update_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums, unsigned int n_nums,
+				    Article_Index_Type *entries, unsigned int n_entries)
 {
    char file [SLRN_MAX_PATH_LEN + 1];
    char newfile [SLRN_MAX_PATH_LEN + 1];
@@ -2893,18 +5232,14 @@ static int update_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
 
    xov_fp = open_xover_file (g, "r");
    if (xov_fp == NULL)
-     return create_overview_for_dir (g, nums, n_nums);
+     return create_overview_for_dir (g, nums, n_nums, entries, n_entries, NULL, 0);
 
    new_xov_fp = NULL;
-   if ((-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname, file, sizeof (file))) ||
-       (-1 == slrn_dircat (file, Overview_File, file, sizeof (file))))
+   if (-1 == make_overview_filenames (g, file, newfile))
      {
-        log_error (_("Unable to create filename for overview file.\n"));
         (void) slrn_fclose (xov_fp);
         return -1;
      }
-   slrn_strncpy (newfile, file, SLRN_MAX_PATH_LEN - 5);
-   strcat (newfile, "-new"); /* safe */
 
    new_xov_fp = fopen (newfile, "w");
    if (new_xov_fp == NULL)
@@ -2951,7 +5286,7 @@ static int update_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
 	       {
 		  while (i < n_nums)
 		    {
-		       if (-1 == write_overview_entry (new_xov_fp, nums [i], dir))
+		       if (-1 == write_overview_entry (new_xov_fp, nums [i], dir, entries, n_entries))
 			 break;
 
 		       if ((Stdout_Is_TTY) && (((i % 100) == 0) || (i+1 == n_nums)))
@@ -2976,7 +5311,7 @@ static int update_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
 	/* In case entries are missing, insert as many as needed */
 	while (nums [i] < xov_nr)
 	  {
-	     if (-1 == write_overview_entry (new_xov_fp, nums[i], dir))
+	     if (-1 == write_overview_entry (new_xov_fp, nums[i], dir, entries, n_entries))
 	       goto end_of_loop; /* break 2 */
 	     if ((Stdout_Is_TTY) && (((i % 100) == 0) || (i+1 == n_nums)))
 	       progress_update_overview(i, n_nums, g, 0);
@@ -3008,84 +5343,86 @@ static int update_overview_for_dir (Active_Group_Type *g, NNTP_Artnum_Type *nums
 
 static int expire_group (Active_Group_Type *g, int rebuild) /*{{{*/
 {
-   Slrn_Dir_Type *dp;
-   Slrn_Dirent_Type *df;
    char dir [SLRN_MAX_PATH_LEN + 1];
    char file [SLRN_MAX_PATH_LEN + 1];
+   Article_Index_Type *entries;
+   Article_Index_Type *checkpoint = NULL;
+   unsigned int n_checkpoint = 0;
    NNTP_Artnum_Type *ok_names;
-   unsigned int i, n, num_ok_names, max_num_ok_names;
+   unsigned int i, n, num_ok_names;
    unsigned int num_expired = 0;
    unsigned int left, right, cutoff;
-   void (*qsort_fun) (char *, unsigned int, int, int (*)(NNTP_Artnum_Type *, NNTP_Artnum_Type *));
    time_t expire_time;
    int perform_expire = 1;
+   int scanned = 0;
+   int moved;
+   Slrn_Range_Type *old_segments = NULL;
 
    if (g->expire_days == 0)
      perform_expire = 0;
 
-   /* First, make a list of all articles in this group. */
    if (-1 == slrn_dircat (SlrnPull_Spool_News_Dir, g->dirname,
 			  dir, sizeof (dir)))
      return -1;
 
-   dp = slrn_open_dir (dir);
-   if (dp == NULL)
-     {
-	log_error (_("opendir %s failed."), dir);
-	return -1;
-     }
+   close_article_index ();
+   close_segment ();
 
-   ok_names = NULL;
-   max_num_ok_names = num_ok_names = 0;
+   /* First, get a list of all articles in this group.  The directory is
+    * only scanned if there is no index yet or the overview is rebuilt.
+    * In the latter case, the old index is the checkpoint that tells which
+    * articles have not changed. */
+   if (rebuild)
+     (void) read_article_index (g, &checkpoint, &n_checkpoint);
 
-   while (NULL != (df = slrn_read_dir (dp)))
+   if (rebuild || (-1 == read_article_index (g, &entries, &num_ok_names)))
      {
-	char *name, *p;
-	NNTP_Artnum_Type id;
-
-	name = df->name;
-
-	/* Look for names composed of digits.  Skip others. */
-	p = name;
-	while (*p && isdigit (*p)) p++;
-	if (*p != 0) continue;
-
-	if ((1 != sscanf (name, NNTP_FMT_ARTNUM, &id))
-	    || (id < 0))
-	  continue;		       /* hmm... I'm paranoid. */
-
-	if (num_ok_names == max_num_ok_names)
+	if (-1 == scan_article_index (g, &entries, &num_ok_names))
 	  {
-	     max_num_ok_names += 500;
-	     ok_names = (NNTP_Artnum_Type *) slrn_realloc ((char *) ok_names, max_num_ok_names * sizeof (NNTP_Artnum_Type), 1);
-	     if (ok_names == NULL)
-	       {
-		  log_error (_("malloc error. Unable to expire group %s."), g->name);
-		  slrn_close_dir (dp);
-		  return -1;
-	       }
+	     slrn_free ((char *) checkpoint);
+	     return -1;
 	  }
-
-	ok_names [num_ok_names] = id;
-	num_ok_names++;
+	scanned = 1;
      }
 
-   slrn_close_dir (dp);
-
    if (num_ok_names==0) /* nothing to do */
-     return 0;
+     {
+	slrn_free ((char *) entries);
+	slrn_free ((char *) checkpoint);
+	(void) write_article_index (g, NULL, 0);
+	return 0;
+     }
 
-   /* Now, sort the array and use a binary search to find the lowest article
-    * number we don't want to expire.
-    */
-   qsort_fun = (void (*)(char *, unsigned int, int,
-			 int (*)(NNTP_Artnum_Type *, NNTP_Artnum_Type*))) qsort;
+   ok_names = (NNTP_Artnum_Type *) slrn_malloc (num_ok_names * sizeof (NNTP_Artnum_Type), 0, 1);
+   if (ok_names == NULL)
+     {
+	log_error (_("malloc error. Unable to expire group %s."), g->name);
+	slrn_free ((char *) entries);
+	slrn_free ((char *) checkpoint);
+	return -1;
+     }
+   for (i = 0; i < num_ok_names; i++)
+     {
+	Article_Index_Type *e;
 
-   (*qsort_fun) ((char *) ok_names, num_ok_names, sizeof (NNTP_Artnum_Type), sort_artnums_cmp);
+	ok_names[i] = entries[i].num;
+
+	/* Keep the has_body flag of the articles that did not change;
+	 * all others are marked as changed in the checkpoint. */
+	if (NULL == (e = find_article_index_entry (checkpoint, n_checkpoint, entries[i].num)))
+	  continue;
+	if ((e->time == entries[i].time) && (e->size == entries[i].size))
+	  entries[i].has_body = e->has_body;
+	else
+	  e->has_body = -1;
+     }
 
    time (&expire_time);
    expire_time -= g->expire_days * (24 * 60 * 60);
 
+   /* Use a binary search to find the lowest article number we don't want
+    * to expire.
+    */
    if (perform_expire == 0)
      cutoff = 0;
    else
@@ -3096,39 +5433,12 @@ static int expire_group (Active_Group_Type *g, int rebuild) /*{{{*/
 	 * article we want to keep. */
 	while (left < right)
 	  {
-	     char buf[256];
-	     struct stat st;
-
 	     cutoff = (left + right) / 2;
 
-	     sprintf (buf, NNTP_FMT_ARTNUM, ok_names[cutoff]); /* safe */
-
-	     if (-1 == slrn_dircat (dir, buf, file, sizeof (file)))
-	       goto stat_error;
-
-	     if (-1 == stat (file, &st))
-	       {
-		  log_error (_("Unable to stat %s."), file);
-		  goto stat_error;
-	       }
-
-	     if (0 == S_ISREG(st.st_mode))
-	       goto stat_error;
-
-	     if (st.st_mtime > expire_time)
+	     if (entries[cutoff].time > expire_time)
 	       right = cutoff;
 	     else
 	       left = cutoff+1;
-
-	     continue;
-
-	     stat_error:
-	     /* throw out the faulty entry */
-	     if (cutoff < num_ok_names-1)
-	       memmove (ok_names+cutoff, ok_names+cutoff+1, num_ok_names-cutoff-1);
-	     if (right==num_ok_names)
-	       right--;
-	     num_ok_names--;
 	  }
 	cutoff = left;
      }
@@ -3179,32 +5489,82 @@ static int expire_group (Active_Group_Type *g, int rebuild) /*{{{*/
 	  g->headers = slrn_ranges_remove (g->headers, 1, server_min-1);
      }
 
-   /* Now, actually delete the files on disk. */
+   /* Now, actually delete the files on disk.  Packed articles are removed
+    * when their segment is compacted. */
    for (i=0; i < cutoff; i++)
      {
 	char buf[256];
-	sprintf (buf, NNTP_FMT_ARTNUM, ok_names[i]); /* safe */
+	Article_Index_Type *e;
 
-	if ((-1 == slrn_dircat (dir, buf, file, sizeof (file))) ||
-	    (-1 == slrn_delete_file (file)))
-	  log_error (_("Unable to expire %s."), file);
-	else
-	  num_expired++;
+	e = find_article_index_entry (entries, num_ok_names, ok_names[i]);
+	if ((e == NULL) || (e->seg == 0))
+	  {
+	     sprintf (buf, NNTP_FMT_ARTNUM, ok_names[i]); /* safe */
+
+	     /* If the file is already gone, just drop it from the index. */
+	     if ((-1 == slrn_dircat (dir, buf, file, sizeof (file))) ||
+		 ((-1 == slrn_delete_file (file)) && (errno != ENOENT)))
+	       {
+		  log_error (_("Unable to expire %s."), file);
+		  continue;
+	       }
+	  }
+	num_expired++;
+
+	/* Mark the entry as expired */
+	if (e != NULL)
+	  e->size = (unsigned long) -1;
      }
 
+   moved = compact_segments (dir, entries, num_ok_names, &old_segments);
+
    if (num_expired > 0)
      {
         log_message (_("%u articles expired in %s."), num_expired, g->name);
         if (rebuild == 0)
-          (void) update_overview_for_dir (g, ok_names+cutoff, num_ok_names-cutoff);
+          (void) update_overview_for_dir (g, ok_names+cutoff, num_ok_names-cutoff,
+					  entries, num_ok_names);
         else
-          (void) create_overview_for_dir (g, ok_names+cutoff, num_ok_names-cutoff);
+          (void) create_overview_for_dir (g, ok_names+cutoff, num_ok_names-cutoff,
+					  entries, num_ok_names, checkpoint, n_checkpoint);
      }
    else if (rebuild == 1)
-     (void) create_overview_for_dir (g, ok_names+cutoff, num_ok_names-cutoff);
+     (void) create_overview_for_dir (g, ok_names+cutoff, num_ok_names-cutoff,
+				     entries, num_ok_names, checkpoint, n_checkpoint);
 
    slrn_free ((char *) ok_names);
+   slrn_free ((char *) checkpoint);
+
+   /* Write the index of the remaining articles.  Where it is not known
+    * whether an article has a body, g->headers is the best guess. */
+   if ((num_expired > 0) || scanned || moved)
+     {
+	n = 0;
+	for (i = 0; i < num_ok_names; i++)
+	  {
+	     if (entries[i].size == (unsigned long) -1)
+	       continue;
+	     if (entries[i].has_body == -1)
+	       entries[i].has_body = !slrn_ranges_is_member (g->headers, entries[i].num);
+	     entries[n++] = entries[i];
+	  }
+	/* If the index cannot be written, the old one still refers to the
+	 * segments that were copied. */
+	if (0 == write_article_index (g, entries, n))
+	  delete_segments (dir, old_segments);
+     }
+   slrn_ranges_free (old_segments);
+   slrn_free ((char *) entries);
+
+   return 0;
+}
+
+/*}}}*/
 
+static int expire_group_job (Active_Group_Type *g, int rebuild) /*{{{*/
+{
+   (void) expire_group (g, rebuild);
+   (void) write_headers_file (g);
    return 0;
 }
 
@@ -3218,6 +5578,11 @@ static int do_expire (int rebuild) /*{{{*/
 
    init_signals ();
 
+#if SLRNPULL_HAS_WORKERS
+   if (1 == run_parallel_jobs (NULL, expire_group_job, rebuild))
+     g = NULL;
+#endif
+
    while (g != NULL)
      {
 	if (Terminate_Slrn_Pull_Requested)
@@ -3228,11 +5593,18 @@ static int do_expire (int rebuild) /*{{{*/
 	     slrn_exit_error (NULL);
 	  }
 
-	(void) expire_group (g, rebuild);
-	(void) write_headers_file (g);
+	(void) expire_group_job (g, rebuild);
 	g = g->next;
      }
 
+   if (Terminate_Slrn_Pull_Requested)
+     {
+	log_error (_("Termination requested.  Shutting down."));
+	(void) write_active ();
+	Exit_Code = SLRN_EXIT_SIGNALED;
+	slrn_exit_error (NULL);
+     }
+
    return write_active ();
 }
 
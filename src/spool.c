@@ -54,6 +54,14 @@
 # define SLRN_SPOOL_NOV_FILE ".overview"
 #endif
 
+#ifndef SLRN_SPOOL_ARTINDEX
+# define SLRN_SPOOL_ARTINDEX ".artindex"
+#endif
+
+#ifndef SLRN_SPOOL_SEGMENT
+# define SLRN_SPOOL_SEGMENT ".pack."
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <assert.h>
@@ -108,6 +116,25 @@ static int Spool_Doing_XPat;	       /* reading xpat */
 static char *Spool_XHdr_Field;	       /* when reading xhdr */
 static int Spool_fhead=0; /* if non-0 we're emulating "HEAD" so stop on blank line */
 static int Spool_fFakingActive=0; /* if non-0 we're doing funky stuff with MH folders */
+static long Spool_fh_left = -1; /* bytes left of a packed article, or -1 */
+
+/* slrnpull may store articles in segment files instead of one file per
+ * article.  Where they are is recorded in the article index of the group,
+ * which is only read if an article does not have a file of its own.
+ */
+typedef struct
+{
+   NNTP_Artnum_Type num;
+   unsigned int seg;		       /* 0 if the article has its own file */
+   unsigned long offset;
+   unsigned long size;
+   unsigned int seq;		       /* line number in the index */
+}
+Spool_Packed_Type;
+
+static Spool_Packed_Type *Spool_Packed;
+static unsigned int Spool_Num_Packed;
+static int Spool_Packed_Read;	       /* non-zero if the index was read */
 
 static int spool_fake_active( char *);
 static int spool_fakeactive_read_line(char *, int);
@@ -167,6 +194,7 @@ static int spool_fclose_local (void)
 #endif
    Spool_Output_Regexp = NULL;
    Spool_Ignore_Comments=0;
+   Spool_fh_left = -1;
 
    if (Spool_fh_local != NULL)
      {
@@ -421,13 +449,138 @@ static int spool_find_artnum_from_msgid (char *msgid, NNTP_Artnum_Type *idp)
    return -1;
 }
 
+static void spool_free_packed (void)
+{
+   slrn_free ((char *) Spool_Packed);
+   Spool_Packed = NULL;
+   Spool_Num_Packed = 0;
+   Spool_Packed_Read = 0;
+}
+
+static int spool_packed_cmp (Spool_Packed_Type *a, Spool_Packed_Type *b)
+{
+   if (a->num > b->num) return 1;
+   if (a->num < b->num) return -1;
+   if (a->seq > b->seq) return 1;
+   if (a->seq < b->seq) return -1;
+   return 0;
+}
+
+/* Reads the lines "number mtime size body segment offset" of the article
+ * index.  For each article, only the last line counts. */
+static void spool_read_packed_index (void)
+{
+   void (*qsort_fun) (char *, unsigned int, int, int (*)(Spool_Packed_Type *, Spool_Packed_Type *));
+   char line [256];
+   unsigned int i, j, max = 0;
+   char *file;
+   FILE *fp;
+
+   Spool_Packed_Read = 1;
+
+   file = slrn_spool_dircat (Spool_Group, SLRN_SPOOL_ARTINDEX, 0);
+   fp = fopen (file, "r");
+   SLFREE (file);
+   if (fp == NULL)
+     return;
+
+   while (NULL != fgets (line, sizeof (line), fp))
+     {
+	Spool_Packed_Type *p;
+	NNTP_Artnum_Type num;
+	unsigned long t, size, offset;
+	unsigned int seg = 0;
+	int has_body;
+
+	if (3 > sscanf (line, NNTP_FMT_ARTNUM " %lu %lu %d %u %lu",
+			&num, &t, &size, &has_body, &seg, &offset))
+	  continue;
+
+	if (Spool_Num_Packed == max)
+	  {
+	     max += 500;
+	     p = (Spool_Packed_Type *) slrn_realloc ((char *) Spool_Packed, max * sizeof (Spool_Packed_Type), 1);
+	     if (p == NULL)
+	       break;
+	     Spool_Packed = p;
+	  }
+	p = Spool_Packed + Spool_Num_Packed;
+	p->num = num;
+	p->seg = seg;
+	p->offset = (seg == 0) ? 0 : offset;
+	p->size = size;
+	p->seq = Spool_Num_Packed++;
+     }
+   fclose (fp);
+
+   if (Spool_Num_Packed == 0)
+     return;
+
+   qsort_fun = (void (*)(char *, unsigned int, int,
+			 int (*)(Spool_Packed_Type *, Spool_Packed_Type *))) qsort;
+   (*qsort_fun) ((char *) Spool_Packed, Spool_Num_Packed, sizeof (Spool_Packed_Type), spool_packed_cmp);
+
+   /* Keep the last entry of each article */
+   j = 0;
+   for (i = 1; i < Spool_Num_Packed; i++)
+     {
+	if (Spool_Packed[i].num != Spool_Packed[j].num)
+	  j++;
+	Spool_Packed[j] = Spool_Packed[i];
+     }
+   Spool_Num_Packed = j + 1;
+
+   debug_output (NULL, -1, "%u articles in the index of %s", Spool_Num_Packed, Spool_Group);
+}
+
+static Spool_Packed_Type *spool_find_packed (NNTP_Artnum_Type num)
+{
+   unsigned int left = 0, right;
+
+   if (Spool_Packed_Read == 0)
+     spool_read_packed_index ();
+
+   right = Spool_Num_Packed;
+   while (left < right)
+     {
+	unsigned int mid = (left + right) / 2;
+
+	if (Spool_Packed[mid].num == num)
+	  return (Spool_Packed[mid].seg == 0) ? NULL : Spool_Packed + mid;
+	if (Spool_Packed[mid].num < num)
+	  left = mid + 1;
+	else
+	  right = mid;
+     }
+   return NULL;
+}
+
 static FILE *spool_open_article_num (NNTP_Artnum_Type num)
 {
    char buf [SLRN_MAX_PATH_LEN];
+   Spool_Packed_Type *p;
+   FILE *fp;
 
    slrn_snprintf (buf, sizeof (buf), ("%s/" NNTP_FMT_ARTNUM), Spool_Group, num);
 
-   return fopen (buf,"r");
+   if ((NULL != (fp = fopen (buf,"r")))
+       || (NULL == (p = spool_find_packed (num))))
+     return fp;
+
+   slrn_snprintf (buf, sizeof (buf), "%s/%s%u", Spool_Group, SLRN_SPOOL_SEGMENT, p->seg);
+   if (NULL == (fp = fopen (buf, "rb")))
+     return NULL;
+
+   if (-1 == fseek (fp, (long) p->offset, SEEK_SET))
+     {
+	debug_output (__FILE__, __LINE__, "fseek returned -1; errno %d (%s).", errno, strerror(errno));
+	fclose (fp);
+	return NULL;
+     }
+
+   /* The caller has called spool_fclose_local already. */
+   Spool_fh_left = (long) p->size;
+   return fp;
 }
 
 static int spool_article_num_exists (NNTP_Artnum_Type num)
@@ -436,7 +589,8 @@ static int spool_article_num_exists (NNTP_Artnum_Type num)
 
    slrn_snprintf (buf, sizeof (buf), ("%s/" NNTP_FMT_ARTNUM), Spool_Group, num);
 
-   if (1 == slrn_file_exists (buf))
+   if ((1 == slrn_file_exists (buf))
+       || (NULL != spool_find_packed (num)))
      return 0;
 
    return -1;
@@ -445,9 +599,14 @@ static int spool_article_num_exists (NNTP_Artnum_Type num)
 static int spool_get_article_size (NNTP_Artnum_Type num)
 {
    char buf [SLRN_MAX_PATH_LEN];
+   Spool_Packed_Type *p;
 
    slrn_snprintf (buf, sizeof (buf), ("%s/" NNTP_FMT_ARTNUM), Spool_Group, num);
 
+   if ((1 != slrn_file_exists (buf))
+       && (NULL != (p = spool_find_packed (num))))
+     return (int) p->size;
+
    return slrn_file_size (buf);
 }
 
@@ -995,6 +1154,7 @@ static int spool_select_group (char *name, NNTP_Artnum_Type *min, NNTP_Artnum_Ty
 
    slrn_free (Spool_Group);
    slrn_free (Spool_Group_Name);
+   spool_free_packed ();
 
    Spool_Group = slrn_spool_dircat (Slrn_Spool_Root, name, 1);
    Spool_Group_Name = slrn_safe_strmalloc (name);
@@ -1039,6 +1199,7 @@ static void spool_close_server (void)
 {
    slrn_free (Spool_Group);
    Spool_Group = NULL;
+   spool_free_packed ();
 
    spool_fclose_local();
 
@@ -1081,8 +1242,21 @@ static int spool_read_fhlocal (char *line, unsigned int len)
    do
      {
 	if ((NULL == Spool_fh_local)
-	    || (NULL == fgets (line, len, Spool_fh_local))
-	    || (Spool_fhead && (line[0]=='\n')))
+	    || (Spool_fh_left == 0)
+	    || (NULL == fgets (line, len, Spool_fh_local)))
+	  {
+	     spool_fclose_local();
+	     return 0;
+	  }
+
+	/* Do not read beyond the end of a packed article */
+	if (Spool_fh_left != -1)
+	  {
+	     long n = (long) strlen (line);
+	     Spool_fh_left = (n < Spool_fh_left) ? Spool_fh_left - n : 0;
+	  }
+
+	if (Spool_fhead && (line[0]=='\n'))
 	  {
 	     spool_fclose_local();
 	     return 0;
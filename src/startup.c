@@ -32,6 +32,7 @@
 #endif
 
 #include <string.h>
+#include <ctype.h>
 #include <slang.h>
 
 #include "jdmacros.h"
@@ -40,6 +41,7 @@
 #include "group.h"
 #include "misc.h"
 #include "art.h"
+#include "artcache.h"
 #include "post.h"
 #include "startup.h"
 #include "score.h"
@@ -149,6 +151,25 @@ SLRegexp_Type *Slrn_Ignore_Quote_Regexp [SLRN_MAX_REGEXP + 1];
 SLRegexp_Type *Slrn_Strip_Re_Regexp [SLRN_MAX_REGEXP + 1];
 SLRegexp_Type *Slrn_Strip_Sig_Regexp [SLRN_MAX_REGEXP + 1];
 SLRegexp_Type *Slrn_Strip_Was_Regexp [SLRN_MAX_REGEXP + 1];
+
+/* The first bytes that the regexps in the tables above can match (see
+ * slrn_regexp_first_bytes); any is the union over the table. */
+typedef struct
+{
+   SLRegexp_Type **table;
+   unsigned char first [SLRN_MAX_REGEXP][32];
+   unsigned char any [32];
+}
+Regexp_First_Bytes_Type;
+
+static Regexp_First_Bytes_Type Regexp_First_Bytes [] =
+{
+     {Slrn_Ignore_Quote_Regexp},
+     {Slrn_Strip_Re_Regexp},
+     {Slrn_Strip_Sig_Regexp},
+     {Slrn_Strip_Was_Regexp},
+     {NULL}
+};
 int Slrn_Autobaud = 0;
 char *Slrn_Score_File;
 int Slrn_Scroll_By_Page;
@@ -380,10 +401,163 @@ static SLRegexp_Type *compile_quote_regexp (char *str) /*{{{*/
    return r;
 }
 
+/*}}}*/
+
+static Regexp_First_Bytes_Type *find_first_bytes (SLRegexp_Type **regexp_table) /*{{{*/
+{
+   Regexp_First_Bytes_Type *f = Regexp_First_Bytes;
+
+   while (f->table != NULL)
+     {
+	if (f->table == regexp_table)
+	  return f;
+	f++;
+     }
+   return NULL;
+}
+
+/*}}}*/
+
+unsigned char *slrn_regexp_first_bytes (SLRegexp_Type **regexp_table, int i) /*{{{*/
+{
+   Regexp_First_Bytes_Type *f;
+
+   if (NULL == (f = find_first_bytes (regexp_table)))
+     return NULL;
+
+   if ((i < 0) || (i >= SLRN_MAX_REGEXP))
+     return f->any;
+   return f->first[i];
+}
+
+/*}}}*/
+
+/* Computes the set of bytes that a string matched by pat may start with.
+ * It only needs to be a superset, so leading literals, bracket expressions
+ * and optional atoms are looked at; anything more involved sets all bits.
+ * Whether pat is anchored does not matter, as callers only want matches
+ * that start at the beginning of the string anyway. */
+static void regexp_first_bytes (char *pat, unsigned char *set) /*{{{*/
+{
+   unsigned char *p = (unsigned char *) pat;
+   unsigned char atom [32];
+   unsigned int ch, last, prev, i;
+   int negate, optional;
+
+   memset ((char *) set, 0, 32);
+
+   if (*p == '^') p++;
+
+   while (1)
+     {
+	memset ((char *) atom, 0, 32);
+	ch = *p++;
+
+	if (ch == '[')
+	  {
+	     negate = 0;
+	     if (*p == '^')
+	       {
+		  negate = 1;
+		  p++;
+	       }
+	     prev = 256;		       /* no range start */
+	     if (*p == ']')
+	       {
+		  atom[']' >> 3] |= 1 << (']' & 7);
+		  prev = *p++;
+	       }
+	     while (*p != ']')
+	       {
+		  ch = *p;
+		  if ((ch == 0) || (ch == '\\') || (ch & 0x80))
+		    goto match_anything;
+
+		  if ((ch == '-') && (prev != 256) && (p[1] != ']'))
+		    {
+		       last = p[1];
+		       if ((last == 0) || (last == '\\') || (last & 0x80)
+			   || (last < prev))
+			 goto match_anything;
+		       for (i = prev; i <= last; i++)
+			 atom[i >> 3] |= 1 << (i & 7);
+		       prev = 256;
+		       p += 2;
+		       continue;
+		    }
+		  atom[ch >> 3] |= 1 << (ch & 7);
+		  prev = ch;
+		  p++;
+	       }
+	     p++;
+	     if (negate)
+	       {
+		  for (i = 0; i < 32; i++)
+		    atom[i] = ~atom[i];
+	       }
+	  }
+	else
+	  {
+	     if (ch == '\\')
+	       {
+		  /* \( \< \d and friends are not literals */
+		  ch = *p++;
+		  if ((ch == 0) || isalnum (ch) || (NULL != strchr ("()<>{}", (char) ch)))
+		    goto match_anything;
+	       }
+	     else if ((ch == 0) || (NULL != strchr (".$*+?", (char) ch)))
+	       goto match_anything;
+
+	     if (ch & 0x80)
+	       goto match_anything;      /* may be part of a multibyte char */
+	     atom[ch >> 3] |= 1 << (ch & 7);
+	  }
+
+	optional = 0;
+	if ((*p == '*') || (*p == '?'))
+	  {
+	     optional = 1;
+	     p++;
+	  }
+	else if (*p == '+')
+	  p++;
+	else if ((*p == '\\') && (p[1] == '{'))
+	  goto match_anything;
+
+	for (i = 0; i < 32; i++)
+	  set[i] |= atom[i];
+
+	if (optional == 0)
+	  return;
+     }
+
+   match_anything:
+   memset ((char *) set, 0xFF, 32);
+}
+
+/*}}}*/
+
+static void set_table_regexp (SLRegexp_Type **regexp_table, /*{{{*/
+			      unsigned int i, char *str)
+{
+   Regexp_First_Bytes_Type *f;
+   unsigned int j;
+
+   regexp_table[i] = compile_quote_regexp (str);
+
+   if (NULL == (f = find_first_bytes (regexp_table)))
+     return;
+
+   regexp_first_bytes (str, f->first[i]);
+   for (j = 0; j < 32; j++)
+     f->any[j] |= f->first[i][j];
+}
+
 /*}}}*/
 void slrn_generic_regexp_fun (int argc, SLcmd_Cmd_Table_Type *cmd_table,
 				     SLRegexp_Type **regexp_table) /*{{{*/
 {
+   Regexp_First_Bytes_Type *f;
    unsigned int i;
    SLRegexp_Type *r;
 
@@ -408,9 +582,15 @@ void slrn_generic_regexp_fun (int argc, SLcmd_Cmd_Table_Type *cmd_table,
 	  }
      }
 
+   if (NULL != (f = find_first_bytes (regexp_table)))
+     {
+	memset ((char *) f->first, 0, sizeof (f->first));
+	memset ((char *) f->any, 0, sizeof (f->any));
+     }
+
    for (i = 1; i < (unsigned int) argc; i++)
      {
-	regexp_table[i-1] = compile_quote_regexp (cmd_table->string_args[i]);
+	set_table_regexp (regexp_table, i-1, cmd_table->string_args[i]);
      }
 }
 
@@ -638,6 +818,10 @@ Slrn_Int_Var_Type Slrn_Int_Variables [] = /*{{{*/
      {"use_uudeview", NULL, NULL},
 #endif
      {"lines_per_update", &Slrn_Reads_Per_Update, NULL},
+     {"header_page_size", &Slrn_Header_Page_Size, NULL},
+     {"prefetch_depth", &Slrn_Prefetch_Depth, NULL},
+     {"prefetch_cache_size", &Slrn_Prefetch_Cache_Size, NULL},
+     {"article_cache_size", &Slrn_Article_Cache_Size, NULL},
      {"min_high_score", &Slrn_High_Score_Min, NULL},
      {"max_low_score", &Slrn_Low_Score_Max, NULL},
      {"kill_score", &Slrn_Kill_Score_Max, NULL},
@@ -760,6 +944,7 @@ Slrn_Str_Var_Type Slrn_Str_Variables [] = /*{{{*/
      {"save_replies", &Slrn_Save_Replies_File, NULL},
      {"save_directory", &Slrn_Save_Directory, NULL},
      {"postpone_directory", &Slrn_Postpone_Dir, NULL},
+     {"article_cache_directory", &Slrn_Article_Cache_Dir, NULL},
      {"signature", &Slrn_User_Info.signature, NULL},
      {"signoff_string", &Slrn_Signoff_String, NULL},
      {"custom_headers", &Slrn_Post_Custom_Headers, NULL},
@@ -1811,8 +1996,8 @@ void slrn_startup_initialize (void) /*{{{*/
    SLang_init_case_tables ();
    slrn_help_init_keysym_table ();
 
-   Slrn_Ignore_Quote_Regexp[0] = compile_quote_regexp ("^ ? ?[><:=|]");
-   Slrn_Strip_Sig_Regexp[0] = compile_quote_regexp ("^-- $");
+   set_table_regexp (Slrn_Ignore_Quote_Regexp, 0, "^ ? ?[><:=|]");
+   set_table_regexp (Slrn_Strip_Sig_Regexp, 0, "^-- $");
 
    h = Color_Handles;
    while (h->name != NULL)
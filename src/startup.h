@@ -40,6 +40,14 @@ extern char *slrn_get_charset (char *name);
 /* struct SLRegexp_Type; */
 extern void slrn_generic_regexp_fun (int, SLcmd_Cmd_Table_Type *, SLRegexp_Type **);
 
+/* Returns the set of bytes that a string has to start with for the i-th
+ * regexp of a table (or any of them if i is -1) to match at its beginning,
+ * or NULL if nothing is known about the table.  Test it with
+ * SLRN_BYTE_IN_SET before calling the regexp engine. */
+extern unsigned char *slrn_regexp_first_bytes (SLRegexp_Type **, int);
+#define SLRN_BYTE_IN_SET(set,ch) \
+   ((set)[((unsigned char) (ch)) >> 3] & (1 << (((unsigned char) (ch)) & 7)))
+
 typedef struct Slrn_Int_Var_Type
 {
    char *what;
@@ -392,7 +392,7 @@ void slrn_map_xover_to_header (Slrn_XOver_Type *xov, Slrn_Header_Type *h, int fr
    h->subject = slrn_safe_strmalloc (xov->subject_malloced);
    h->from = slrn_safe_strmalloc(xov->from);
    h->date = slrn_safe_strmalloc (xov->date_malloced);
-   h->refs = slrn_safe_strmalloc (xov->references);
+   h->refs = slrn_intern_references (xov->references, &h->num_refs);
    h->xref = slrn_safe_strmalloc (xov->xref);
 
    h->lines = xov->lines;
@@ -662,6 +662,84 @@ static Slrn_Header_Line_Type *copy_add_headers (Slrn_Header_Line_Type *l, /*{{{*
 
 /*}}}*/
 
+/* The line consists of:
+ * id|subj|from|date|msgid|refs|bytes|line|misc stuff
+ * Here '|' is a TAB.  The following code parses this.
+ */
+static int parse_xover_line (char *buf, Slrn_XOver_Type *xov) /*{{{*/
+{
+   char *b;
+   int i;
+   NNTP_Artnum_Type id;
+   Slrn_Header_Line_Type *addh;
+   Overview_Fmt_Type *t = Overview_Fmt;
+
+   for (addh = Additional_Headers; addh != NULL; addh = addh->next)
+     addh->value = NULL;
+   Xref = NULL;
+
+   b = buf;
+
+   while (*b && (*b != '\t')) b++;
+   if (*b) *b++ = 0;
+   id = NNTP_STR_TO_ARTNUM (buf);
+
+   for (i = 0; i < 7; ++i)
+     {
+	Xover_Headers[i].value = b;
+	while (*b && (*b != '\t')) b++;
+	if (*b) *b++ = 0;
+     }
+
+   if (t == NULL)
+     /* we don't know OVERVIEW.FMT, so just look for Xref */
+     {
+	while (*b != 0)
+	  {
+	     char *xb = b;
+
+	     /* skip to next field. */
+	     while (*b && (*b != '\t')) b++;
+	     if (*b) *b++ = 0;
+
+	     if (0 == slrn_case_strncmp ( xb, "Xref: ", 6))
+	       {
+		  Xref = xb + 6;
+		  break;
+	       }
+	  }
+     }
+   else
+     {
+	while (t != NULL)
+	  {
+	     char *xb = b;
+
+	     while (*b && (*b != '\t')) b++;
+	     if (*b) *b++ = 0;
+
+	     if (t->value != NULL)
+	       {
+		  if (t->full)
+		    {
+		       if ((NULL != (xb = slrn_strbyte (xb, ':'))) && (0 != *(++xb)))
+			 *t->value = ++xb;
+		       else
+			 *t->value = "";
+		    }
+		  else
+		    *t->value = xb;
+	       }
+
+	     t = t->next;
+	  }
+     }
+
+   return parsed_headers_to_xover (id, xov);
+}
+
+/*}}}*/
+
 #ifndef SLRNPULL_CODE
 static int XOver_Done;
 static NNTP_Artnum_Type XOver_Min, XOver_Max, XOver_Next;
@@ -830,83 +908,6 @@ int slrn_open_xover (NNTP_Artnum_Type min, NNTP_Artnum_Type max) /*{{{*/
 
 /*}}}*/
 
-/* The line consists of:
- * id|subj|from|date|msgid|refs|bytes|line|misc stuff
- * Here '|' is a TAB.  The following code parses this.
- */
-static int parse_xover_line (char *buf, Slrn_XOver_Type *xov) /*{{{*/
-{
-   char *b;
-   int i;
-   NNTP_Artnum_Type id;
-   Slrn_Header_Line_Type *addh;
-   Overview_Fmt_Type *t = Overview_Fmt;
-
-   for (addh = Additional_Headers; addh != NULL; addh = addh->next)
-     addh->value = NULL;
-
-   b = buf;
-
-   while (*b && (*b != '\t')) b++;
-   if (*b) *b++ = 0;
-   id = NNTP_STR_TO_ARTNUM (buf);
-
-   for (i = 0; i < 7; ++i)
-     {
-	Xover_Headers[i].value = b;
-	while (*b && (*b != '\t')) b++;
-	if (*b) *b++ = 0;
-     }
-
-   if (t == NULL)
-     /* we don't know OVERVIEW.FMT, so just look for Xref */
-     {
-	while (*b != 0)
-	  {
-	     char *xb = b;
-
-	     /* skip to next field. */
-	     while (*b && (*b != '\t')) b++;
-	     if (*b) *b++ = 0;
-
-	     if (0 == slrn_case_strncmp ( xb, "Xref: ", 6))
-	       {
-		  Xref = xb + 6;
-		  break;
-	       }
-	  }
-     }
-   else
-     {
-	while (t != NULL)
-	  {
-	     char *xb = b;
-
-	     while (*b && (*b != '\t')) b++;
-	     if (*b) *b++ = 0;
-
-	     if (t->value != NULL)
-	       {
-		  if (t->full)
-		    {
-		       if ((NULL != (xb = slrn_strbyte (xb, ':'))) && (0 != *(++xb)))
-			 *t->value = ++xb;
-		       else
-			 *t->value = "";
-		    }
-		  else
-		    *t->value = xb;
-	       }
-
-	     t = t->next;
-	  }
-     }
-
-   return parsed_headers_to_xover (id, xov);
-}
-
-/*}}}*/
-
 /* Returns -1 upon error, 0, if done, and 1 upon success */
 int slrn_read_xover (Slrn_XOver_Type *xov) /*{{{*/
 {